@@ -30,15 +30,40 @@
  *  See readme.txt for information on how to build and use this library.
  */
 
+#include "btrace_config.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 typedef unsigned char bt_uint8_t;
+typedef unsigned short bt_uint16_t;
 typedef unsigned int bt_uint32_t;
 
+/* Host builds (BTRACE_HOST_BUILD) of the unwinder run on a workstation
+ * and read target memory through a bt_mem_reader_t.*/
+#ifdef BTRACE_HOST_BUILD
+#ifndef BTRACE_MEM_READER
+#define BTRACE_MEM_READER
+#endif
+#endif
+
+/*target address as a pointer, on the host it must not be dereferenced*/
+#define BT_ADDR_TO_PTR(_addr)  ((bt_uint32_t*)(unsigned long)(_addr))
+
+/*orders memory accesses between an interrupt (producer) and a task (consumer)*/
+#if defined(BTRACE_HOST_BUILD)
+#define BT_MEMORY_BARRIER() __sync_synchronize()
+#elif defined(__ARM_ARCH) && (__ARM_ARCH >= 7)
+#define BT_MEMORY_BARRIER() __asm__ __volatile__ ("dmb" ::: "memory")
+#else
+#define BT_MEMORY_BARRIER() __asm__ __volatile__ ("" ::: "memory")
+#endif
+
 /*closest 4 byte aligned value that is >= _n */
 #define ALIGN_4BYTES(_n)  (((_n) + 3) & ~3)
+/*closest 8 byte aligned value that is >= _n */
+#define ALIGN_8BYTES(_n)  (((_n) + 7) & ~7)
 
 /*inline assembly to read register*/
 #define  ARM_SP_READ(_val) __asm__ __volatile__ (" MOV   %0,sp":  "=r"  (_val))
@@ -46,6 +71,11 @@ typedef unsigned int bt_uint32_t;
 #define  ARM_PC_READ(_val) __asm__ __volatile__ (" MOV   %0,pc":  "=r"  (_val))
 #define  ARM_LR_READ(_val) __asm__ __volatile__ (" MOV   %0,lr":  "=r"  (_val))
 /*note: "_val" must not resolve to a function call when reading LR*/
+/*multiprocessor affinity register, ARMv7-A and later*/
+#define  ARM_MPIDR_READ(_val) __asm__ __volatile__ (" MRC   p15, 0, %0, c0, c0, 5": "=r" (_val))
+/*user read only thread ID register, ARMv6K/ARMv7-A and later, written from a privileged mode*/
+#define  ARM_TPIDRURO_READ(_val)  __asm__ __volatile__ (" MRC   p15, 0, %0, c13, c0, 3": "=r" (_val))
+#define  ARM_TPIDRURO_WRITE(_val) __asm__ __volatile__ (" MCR   p15, 0, %0, c13, c0, 3": : "r" (_val))
 
 /*code that call back function can return
  * to stop the trace before maxFrames are processed */
@@ -57,8 +87,44 @@ typedef unsigned int bt_uint32_t;
 
 /* Separate 1 KB stack used by backtrace exception return hook
  * Around 690 bytes of stack gets used if sprintf if called so anything
- * less than that, and this stops working*/
+ * less than that, and this stops working.
+ * If frames are only written to a record buffer (btrace_set_record_buffer)
+ * sprintf is never called and a smaller stack can be configured.*/
+#ifndef BTRACE_HOOK_STACK_SIZE
 #define BTRACE_HOOK_STACK_SIZE 0x400
+#endif
+
+/* Number of cores that may take an exception at the same time.
+ * Above 1, exceptionHandlerReturnHook picks the hook stack, the captured
+ * frame and the Exception_xxx slots of the core it runs on, indexed by
+ * BTRACE_CPU_INDEX(MPIDR), so every core traces its own fault in
+ * parallel. BTRACE_HOOK_STACK_SIZE is then per core. A core whose index
+ * is out of range uses the slots of core 0. If a record buffer is set it
+ * is divided into BTRACE_NUM_CPUS equal slices, one per core
+ * (see btrace_records -c).
+ * MPIDR can only be read from a privileged mode, so the exception handler
+ * reads it and returns to the hook entry of its core,
+ * BTRACE_HOOK_ENTRY(exceptionHandlerReturnHookPtr, core), instead of
+ * exceptionHandlerReturnHookPtr (see asm_hook_sample.txt). The hook runs
+ * in the interrupted mode, which may be USR. The context and print buffer
+ * of each core are static, the hook stack only holds the unwinder's own
+ * frames and sprintf's.*/
+#ifndef BTRACE_NUM_CPUS
+#define BTRACE_NUM_CPUS 1
+#endif
+
+#ifndef BTRACE_CPU_ID_MASK
+#define BTRACE_CPU_ID_MASK 0xFF /*affinity level 0, core within the cluster*/
+#endif
+
+/*slot index of the core with affinity register _mpidr*/
+#define BTRACE_CPU_INDEX(_mpidr) \
+	((((_mpidr) & BTRACE_CPU_ID_MASK) < BTRACE_NUM_CPUS) ? ((_mpidr) & BTRACE_CPU_ID_MASK) : 0)
+
+/*exceptionHandlerReturnHook has one entry of this size per core*/
+#define BTRACE_HOOK_ENTRY_BYTES 8
+#define BTRACE_HOOK_ENTRY(_hook, _cpu) \
+	((bt_uint32_t)(unsigned long)(_hook) + BTRACE_HOOK_ENTRY_BYTES * (_cpu))
 
 /* Note: The order of the fields in bt_stackframe_t can become
  * important if we wish to load /store all fields in a single
@@ -71,8 +137,14 @@ typedef struct StackFrame {
 	bt_uint32_t pc; /* program counter           */
 } bt_stackframe_t;
 
+#if (BTRACE_NUM_CPUS > 1)
+/*the exception handler on core n uses slot [n]*/
+extern bt_uint32_t*  Exception_LR[BTRACE_NUM_CPUS];
+extern bt_uint32_t*  Exception_Hook_LR[BTRACE_NUM_CPUS];
+#else
 extern bt_uint32_t*  Exception_LR;
 extern bt_uint32_t*  Exception_Hook_LR;
+#endif
 /*returns address of a global stack frame object*/
 extern bt_stackframe_t* get_frame_ptr(void);
 
@@ -80,13 +152,17 @@ extern bt_stackframe_t* get_frame_ptr(void);
 #define USE_BTRACE_STACK_FRAME_MACROS \
 	bt_stackframe_t* __sf_ptr
 
-/*macro to read FP,SP,LR and PC of local stack and store into _pst */
+/*macro to read FP,SP,LR and PC of local stack and store into _frame_ptr */
+#define SAVE_STACK_FRAME(_frame_ptr) \
+   ARM_FP_READ((_frame_ptr)->fp);\
+   ARM_SP_READ((_frame_ptr)->sp);\
+   ARM_LR_READ((_frame_ptr)->lr);\
+   ARM_PC_READ((_frame_ptr)->pc)
+
+/*macro to read FP,SP,LR and PC of local stack and store into the global frame */
 #define SAVE_LOCAL_STACK_FRAME \
    __sf_ptr = get_frame_ptr();\
-   ARM_FP_READ(__sf_ptr->fp);\
-   ARM_SP_READ(__sf_ptr->sp);\
-   ARM_LR_READ(__sf_ptr->lr);\
-   ARM_PC_READ(__sf_ptr->pc)
+   SAVE_STACK_FRAME(__sf_ptr)
 
 /* Use arm-none-eabi-addr2line.exe -f -e <executable> <program address value>
  * to get the function names,filename and line number*/
@@ -94,6 +170,146 @@ typedef int (*TraceCallbackFnPtr)( int frameIndex, bt_stackframe_t* pFrame, bt_u
 
 extern int btrace_callstack( TraceCallbackFnPtr callback_fn, int maxFrames );
 
+/* Same as btrace_callstack but starts from (and updates) the given frame
+ * instead of the global frame. Output goes to the sinks installed with
+ * btrace_set_print_fn / btrace_set_record_buffer.*/
+extern int btrace_callstack_frame( bt_stackframe_t* frame, TraceCallbackFnPtr callback_fn, int maxFrames );
+
+/* Build time unwind table.
+ * tools/btrace_mktable reads the linked image and emits one entry per
+ * function whose prologue it could decode. When a table is installed
+ * btrace_callstack binary searches it for each frame and only scans back
+ * for a push when the PC is not covered by the table or lies within the
+ * prologue of the function.
+ * Entries must be sorted by fn_start and must not overlap.*/
+
+/*prologue has "add fp, sp, #offset"*/
+#define BT_UNWIND_FP_FROM_SP  0x01
+
+typedef struct UnwindEntry {
+	bt_uint32_t fn_start;       /* address of first instruction of the function     */
+	bt_uint16_t fn_words;       /* size of the function in words                    */
+	bt_uint16_t sp_delta;       /* bytes pushed or reserved on stack by the prologue */
+	bt_uint8_t  prologue_words; /* words from fn_start to end of the last SP update */
+	bt_uint8_t  lr_slot;        /* LR saved at callerSP - 4 * lr_slot, 0 = not saved */
+	bt_uint8_t  fp_slot;        /* FP saved at callerSP - 4 * fp_slot, 0 = not saved */
+	bt_uint8_t  flags;          /* BT_UNWIND_xxx                                     */
+} bt_unwind_entry_t;
+
+/*installs the table (NULL to remove), returns number of entries installed*/
+extern int btrace_set_unwind_table( const bt_unwind_entry_t* table, int numEntries );
+
+/* Frame cache.
+ * If BTRACE_FRAME_CACHE_SIZE is defined as a non zero power of 2 when
+ * building the library, the result of each scan back to the start of a
+ * function is remembered in a direct mapped cache keyed by PC, so a frame
+ * that was traced before costs a few loads. Each entry takes 12 bytes.
+ * PCs covered by the unwind table do not use the cache.*/
+#ifndef BTRACE_FRAME_CACHE_SIZE
+#define BTRACE_FRAME_CACHE_SIZE 0
+#endif
+
+typedef struct FrameCacheStats {
+	bt_uint32_t hits;   /* frames resolved from the cache         */
+	bt_uint32_t misses; /* frames that had to be scanned          */
+} bt_frame_cache_stats_t;
+
+/* copies the counters to stats, returns number of entries in the cache.
+ * The counters are not updated atomically, they are approximate while
+ * several contexts trace at once.*/
+extern int btrace_frame_cache_stats( bt_frame_cache_stats_t* stats );
+
+/*invalidates all entries and clears counters, call after code is (re)loaded*/
+extern void btrace_frame_cache_flush( void );
+
+/* Memory reader.
+ * When the library is built with BTRACE_MEM_READER (implied by
+ * BTRACE_HOST_BUILD) every read of code or stack made by the unwinder goes
+ * through read_word instead of dereferencing the target address, so that
+ * a captured image can be unwound anywhere. read_word returns 0 on success
+ * and < 0 if addr was not captured, which ends the trace at that frame.
+ * A target build without a reader installed reads live memory.
+ * Each context (or cursor) can bring its own reader so that several
+ * images are unwound at once; btrace_set_mem_reader installs the one used
+ * by contexts that do not. Install it before tracing starts.*/
+typedef int (*BtReadWordFnPtr)( void* ctx, bt_uint32_t addr, bt_uint32_t* value );
+
+typedef struct MemReader {
+	BtReadWordFnPtr read_word;
+	void*           ctx;       /* passed back to read_word */
+} bt_mem_reader_t;
+
+#ifdef BTRACE_MEM_READER
+extern void btrace_set_mem_reader( const bt_mem_reader_t* reader );
+#endif
+
+/* Captured stack for unwinding away from the crashing device,
+ * a bt_snapshot_t header is followed by num_words words of stack
+ * starting at address stack_base (see tools/btrace_unwind).
+ * All fields are little endian.*/
+#define BT_SNAPSHOT_MAGIC  0x50534E42 /* "BNSP" */
+
+typedef struct Snapshot {
+	bt_uint32_t     magic;      /* BT_SNAPSHOT_MAGIC                  */
+	bt_stackframe_t frame;      /* registers at the point of capture  */
+	bt_uint32_t     stack_base; /* address of first captured word     */
+	bt_uint32_t     num_words;  /* words of stack following this header */
+} bt_snapshot_t;
+
+/* Deferred unwinding.
+ * With a snapshot buffer set, exceptionHandlerReturnHook does not trace.
+ * It copies the frame and the stack from SP up to stackLimit (0 = as much
+ * as fits) into the buffer as a bt_snapshot_t and returns straight away.
+ * The snapshot is unwound later by a low priority task, or after reset if
+ * the buffer is not cleared at boot, with btrace_unwind_snapshot, or on the
+ * host with tools/btrace_unwind. magic is written last, a snapshot with
+ * another magic is incomplete. With BTRACE_NUM_CPUS > 1 every core uses
+ * an equal slice of the buffer. NULL turns capture mode off.*/
+#ifndef BTRACE_HOST_BUILD
+extern void btrace_set_snapshot_buffer( bt_snapshot_t* buffer, int bufferBytes, bt_uint32_t stackLimit );
+
+/*captures frame and stack into snapshot, returns number of stack words copied or < 0*/
+extern int btrace_snapshot_frame( bt_snapshot_t* snapshot, int bufferBytes,
+                                  const bt_stackframe_t* frame, bt_uint32_t stackLimit );
+#endif
+
+/* Exception function.
+ * With an exception function set, exceptionHandlerReturnHook calls it with
+ * the core and the frame of the interrupted code instead of tracing or
+ * taking a snapshot, e.g. btrace_crash_exception (see btrace_crash.h).
+ * NULL restores the default. Returns the previous function.*/
+typedef void (*ExceptionFnPtr)(int cpu, const bt_stackframe_t* frame);
+
+extern ExceptionFnPtr btrace_set_exception_fn( ExceptionFnPtr exceptionFn );
+
+/* Direct capture.
+ * For handlers that do not return through exceptionHandlerReturnHook, e.g.
+ * a watchdog FIQ that has to capture a hung task without waiting for it.
+ * Called from an exception mode, btrace_capture_interrupted switches to
+ * the mode in SPSR, copies its FP, SP and LR into frame and switches back,
+ * frame->pc is set to pc, the address of the interrupted instruction
+ * (LR - 4 on entry to an IRQ or FIQ handler). Returns the CPSR_xxx_MODE
+ * the registers were read from, or -1 if the interrupted mode is the
+ * handler's own (see btrace_capture_mode). FP is banked only in FIQ mode;
+ * in other modes r11 must not have been changed by the handler yet for
+ * frame->fp to be valid.
+ * btrace_trace_interrupted captures the frame and passes it on like
+ * exceptionHandlerReturnHook does: to the exception function, into the
+ * snapshot buffer, or to the print function. Exception_LR is set to pc.
+ * It runs on the handler's stack, which must be large enough for the
+ * chosen sink.*/
+#ifndef BTRACE_HOST_BUILD
+extern int btrace_capture_interrupted( bt_stackframe_t* frame, bt_uint32_t pc ) __attribute__ ((naked));
+
+/*returns the interrupted mode or -1 if it cannot be captured*/
+extern int btrace_trace_interrupted( bt_uint32_t pc );
+#endif
+
+/* mode btrace_capture_interrupted reads the registers of code interrupted
+ * with spsr from, in a handler running with cpsr: the mode in spsr, or
+ * CPSR_SYS_MODE for user mode. -1 if that is the handler's own mode.*/
+extern int btrace_capture_mode( bt_uint32_t spsr, bt_uint32_t cpsr );
+
 /* Following functions are for printing callstack using a user specified TracePrintFnPtr type
  * when an abort happens. To do this, modifying the abort handler to update Exception_LR_Ptr with
  * the value of LR seen by it. then jump to exceptionHandlerReturnHook.
@@ -109,8 +325,241 @@ typedef int (*TracePrintFnPtr)(char* message);
 /*returns existing TracePrintFnPtr or NULL*/
 extern TracePrintFnPtr btrace_set_print_fn( TracePrintFnPtr print_fn, int maxFrames ) __attribute__ ((noinline));
 
+/*current TracePrintFnPtr or NULL*/
+extern TracePrintFnPtr btrace_get_print_fn( void );
+
+/* Binary frame records.
+ * Instead of formatting text, frames can be written as fixed size records
+ * into a buffer supplied by the caller. No sprintf or stack hungry calls are
+ * made, so this is the cheapest way to record a trace in exception context.
+ * tools/btrace_records turns a dump of the buffer back into the text
+ * printed by the print function. Record i holds frame i of the last trace
+ * and the record following the last frame is marked invalid.*/
+#define BT_RECORD_FP_FROM_SP   0x0001 /* function updated FP using SP      */
+#define BT_RECORD_LR_ON_STACK  0x0002 /* function saved LR on the stack    */
+#define BT_RECORD_FP_ON_STACK  0x0004 /* function saved FP on the stack    */
+#define BT_RECORD_VALID        0x8000
+
+typedef struct FrameRecord {
+	bt_uint32_t pc;
+	bt_uint32_t sp;
+	bt_uint32_t lr;
+	bt_uint32_t fp;
+	bt_uint32_t caller_sp;  /* SP on entry to the function              */
+	bt_uint16_t index;      /* frame index, 0 = innermost               */
+	bt_uint16_t flags;      /* BT_RECORD_xxx, 0 for an unused record     */
+} bt_frame_record_t;
+
+/* Used when btrace_callstack is called without a callback, takes precedence
+ * over the print function. NULL removes the buffer. Tracing stops when the
+ * buffer is full.*/
+extern void btrace_set_record_buffer( bt_frame_record_t* records, int maxRecords );
+
+/*number of records written by the last trace*/
+extern int btrace_get_record_count( void );
+
+/* number of records written to the slice of core cpu by its last
+ * exception hook trace. With BTRACE_NUM_CPUS > 1 the hook does not
+ * update btrace_get_record_count, on a single core this returns the same
+ * for cpu 0.*/
+extern int btrace_get_cpu_record_count( int cpu );
+
+/* Unwinding engines.
+ * BT_ENGINE_SCAN uses the unwind table, the frame cache and the prologue
+ * scanner. BT_ENGINE_EXIDX interprets the ARM EHABI unwind opcodes in
+ * .ARM.exidx / .ARM.extab (link with -funwind-tables or -fexceptions),
+ * found with a binary search, so it also handles thumb code and dynamic SP
+ * adjustments. The opcodes are exact at call sites; a frame interrupted in
+ * its prologue or epilogue is unwound correctly only by the scanner.
+ * BT_ENGINE_EXIDX_SCAN scans where the index has no usable entry.
+ * BT_ENGINE_FP_SCAN follows the frame pointer chain of code built with
+ * -fno-omit-frame-pointer (or -mapcs-frame, see BTRACE_APCS_FRAMES), two
+ * stack loads per frame, and scans only the first frame and frames whose
+ * FP does not validate: FP must lie within BTRACE_FP_MAX_FRAME bytes above
+ * SP, the saved FP must be 0 or above it, and the saved LR must be below
+ * _etext and follow a call instruction. In mixed builds a function without
+ * a frame pointer that leaves FP untouched passes these checks with its
+ * caller's FP, which hides its caller, so use it where functions that
+ * call others keep FP.*/
+#define BT_ENGINE_SCAN        0
+#define BT_ENGINE_EXIDX       1
+#define BT_ENGINE_EXIDX_SCAN  2
+#define BT_ENGINE_FP_SCAN     3
+
+#ifndef BTRACE_FP_MAX_FRAME
+#define BTRACE_FP_MAX_FRAME   0x10000
+#endif
+
+/* Location of .ARM.exidx. On the target __exidx_start and __exidx_end
+ * from the linker script are used if this was not called.
+ * Returns number of index entries.*/
+extern int btrace_set_exidx( bt_uint32_t start, bt_uint32_t end );
+
+/*engine used by btrace_callstack and the exception hook, returns the previous one*/
+extern int btrace_set_engine( int engine );
+
+/*engine used by btrace_callstack and the exception hook*/
+extern int btrace_get_engine( void );
+
+/* Reentrant unwinding.
+ * All state of a trace lives in a bt_unwind_ctx_t owned by the caller, so
+ * several traces can run at the same time on different tasks, interrupts
+ * or cores without locking. Fill in the frame (SAVE_STACK_FRAME), the limit
+ * and one sink, then call btrace_unwind.
+ * Sinks are tried in order: callback_fn, records, print_fn. print_fn needs
+ * print_buffer of at least BTRACE_PRINT_BUFFER_SIZE bytes.
+ * frame is the first member so a TraceCallbackFnPtr can cast pFrame back
+ * to its bt_unwind_ctx_t to reach user.
+ * With BTRACE_MEM_READER, reader (if not NULL) serves the reads of this
+ * context in place of the reader installed with btrace_set_mem_reader.
+ * The unwind table, the EHABI index and the frame cache are shared by all
+ * contexts; the table and index are set up before tracing, the cache is
+ * safe to share between contexts unwinding the same code (it is keyed by
+ * PC only) but its hit and miss counts (btrace_frame_cache_stats),
+ * like the unwinder statistics, are approximate while several contexts
+ * trace at once. btrace_last_stop_reason is that of whichever trace ended
+ * last. btrace_callstack is btrace_unwind on a context built from the
+ * globals.*/
+#define BTRACE_PRINT_BUFFER_SIZE 128
+
+typedef struct UnwindContext {
+	bt_stackframe_t    frame;         /* start frame, updated while unwinding   */
+	int                max_frames;
+	TraceCallbackFnPtr callback_fn;
+	bt_frame_record_t* records;
+	int                max_records;
+	int                num_records;   /* records written by the last unwind     */
+	TracePrintFnPtr    print_fn;
+	char*              print_buffer;  /* scratch for formatting a frame         */
+	int                engine;        /* BT_ENGINE_xxx                          */
+	void*              user;          /* not used by the library                */
+	int                stop_reason;   /* BT_STOP_xxx, why the last unwind ended */
+	const bt_mem_reader_t* reader;    /* NULL = btrace_set_mem_reader's reader  */
+} bt_unwind_ctx_t;
+
+/*clears all fields, engine defaults to BT_ENGINE_SCAN*/
+extern void btrace_init_context( bt_unwind_ctx_t* ctx );
+
+/*returns number of frames passed to the sink*/
+extern int btrace_unwind( bt_unwind_ctx_t* ctx );
+
+/*why a trace ended, see stop_reason and btrace_last_stop_reason*/
+#define BT_STOP_MAX_FRAMES    0 /* max_frames frames were unwound              */
+#define BT_STOP_CALLBACK      1 /* sink returned STOP_BTRACE or records full   */
+#define BT_STOP_END_OF_STACK  2 /* LR of 0 was saved, entry function reached   */
+#define BT_STOP_SP_FROM_REG   3 /* SP was adjusted by a register operand       */
+#define BT_STOP_ETEXT         4 /* scan for the prologue passed _etext         */
+#define BT_STOP_MEM_READ      5 /* code or stack not available to the reader   */
+#define BT_STOP_NO_EXIDX      6 /* no index entry or EXIDX_CANTUNWIND          */
+#define BT_STOP_BAD_EXIDX     7 /* unwind opcodes could not be interpreted     */
+#define BT_STOP_NUM_REASONS   8
+
+/*stop reason of the last btrace_callstack / exception hook trace*/
+extern int btrace_last_stop_reason( void );
+
+/*stop reason of the last exception hook trace of core cpu, see btrace_get_cpu_record_count*/
+extern int btrace_cpu_stop_reason( int cpu );
+
+/*short name of a BT_STOP_xxx value, for logs*/
+extern const char* btrace_stop_reason_name( int reason );
+
+/* Resumable unwinding.
+ * A bt_unwind_cursor_t holds all state needed to continue a trace, so it
+ * can be spread over several calls, e.g. a few frames per interrupt, and
+ * dropped as soon as a time budget runs out. Each btrace_cursor_next
+ * analyses one frame, the cost btrace_unwind pays per frame. No sink is
+ * involved, read the frame from the cursor or with btrace_cursor_frame.
+ *
+ *   btrace_cursor_init(&cursor, &frame, BT_ENGINE_SCAN);
+ *   while(time_left() && (btrace_cursor_next(&cursor) > 0))
+ *   {
+ *       ... cursor.frame.pc, cursor.caller_sp ...
+ *   }
+ *
+ * The stack being unwound must not change while the cursor is in use.
+ * btrace_unwind is a loop over a cursor.*/
+#define BT_CURSOR_RUNNING    -1
+
+typedef struct UnwindCursor {
+	bt_stackframe_t frame;       /* frame at the cursor                        */
+	bt_uint32_t     caller_sp;   /* SP on entry to the function of frame       */
+	bt_uint32_t     flags;       /* BT_RECORD_xxx bits of frame                */
+	int             index;       /* frame index, 0 = innermost, -1 before the first */
+	int             engine;      /* BT_ENGINE_xxx                              */
+	int             stop_reason; /* BT_CURSOR_RUNNING, or BT_STOP_xxx when done */
+	bt_uint32_t     fp_on_stack; /* FP and LR saved by frame, for the next step */
+	bt_uint32_t     lr_on_stack;
+	const bt_mem_reader_t* reader; /* NULL = btrace_set_mem_reader's reader    */
+	int             read_errors; /* reads of the current frame that failed     */
+} bt_unwind_cursor_t;
+
+/* places the cursor before frame, the first btrace_cursor_next analyses it.
+ * reader is cleared, set it after this call to read through another one.*/
+extern void btrace_cursor_init( bt_unwind_cursor_t* cursor, const bt_stackframe_t* frame, int engine );
+
+/* moves to the next frame (the caller of the current one).
+ * Returns 1 if the cursor holds a frame, 0 at the end of the stack or
+ * -BT_STOP_xxx on failure, and the same again on every later call.*/
+extern int btrace_cursor_next( bt_unwind_cursor_t* cursor );
+
+/*copies the frame at the cursor into record, returns 0 or -1 if there is none*/
+extern int btrace_cursor_frame( const bt_unwind_cursor_t* cursor, bt_frame_record_t* record );
+
+/* passes the frame at the cursor to the sink of ctx as btrace_unwind does,
+ * for unwinders that find their frames in another way (btrace_shadow.c).
+ * A caller_sp of 0 means no stack was walked: callbacks get a NULL sp_high
+ * and print_fn gets the PC only. Returns STOP_BTRACE if the sink asked to
+ * stop after this frame.*/
+extern int btrace_deliver_frame( int frameIndex, bt_unwind_ctx_t* ctx, const bt_unwind_cursor_t* cursor );
+
+/* address of the call that returns to returnAddr. An ARM call is 4 bytes
+ * back; in thumb code (bit 0 set) it is 2 bytes back for BLX <reg> and 4
+ * for BL, told apart by reading the code through reader (NULL = the
+ * reader of btrace_set_mem_reader).*/
+extern bt_uint32_t btrace_call_site( const bt_mem_reader_t* reader, bt_uint32_t returnAddr );
+
+/* Unwinder statistics.
+ * If BTRACE_STATS is defined as 1 when building the library, every trace
+ * updates the counters below. They are shared by all contexts and are not
+ * updated atomically, so they are approximate while several cores trace.
+ * _etext hits and END_OF_STACK terminations are stop_reasons[BT_STOP_ETEXT]
+ * and stop_reasons[BT_STOP_END_OF_STACK].*/
+#ifndef BTRACE_STATS
+#define BTRACE_STATS 0
+#endif
+
+/*opcode histogram buckets: 0, 1, 2-3, 4-7, .. 64 and more*/
+#define BTRACE_STATS_BUCKETS 8
+
+typedef struct UnwindStats {
+	bt_uint32_t traces;         /* calls to btrace_unwind                      */
+	bt_uint32_t frames;         /* frames unwound                              */
+	bt_uint32_t opcodes;        /* opcodes read scanning back for prologues    */
+	bt_uint32_t opcode_histogram[BTRACE_STATS_BUCKETS]; /* frames by opcodes read */
+	bt_uint32_t fp_corrections; /* SP on entry replaced by FP + 4              */
+	bt_uint32_t fp_frames;      /* frames taken from the FP chain              */
+	bt_uint32_t stop_reasons[BT_STOP_NUM_REASONS]; /* traces by BT_STOP_xxx   */
+} bt_unwind_stats_t;
+
+/*copies the counters to stats, returns BTRACE_STATS*/
+extern int btrace_unwind_stats( bt_unwind_stats_t* stats );
+
+extern void btrace_unwind_stats_reset( void );
+
+#ifdef BTRACE_MEM_READER
+/* Unwinds a snapshot with ctx (frame is taken from the snapshot). Stack
+ * reads are served from the snapshot, other reads go to the reader of ctx,
+ * else the installed memory reader or, on the target, to live memory.
+ * The global reader is not changed, so snapshots can be unwound on
+ * several threads at once.
+ * Returns number of frames or < 0 if the snapshot is not valid.*/
+extern int btrace_unwind_snapshot( const bt_snapshot_t* snapshot, bt_unwind_ctx_t* ctx );
+#endif
+
+#ifndef BTRACE_HOST_BUILD
 extern void exceptionHandlerReturnHook(void) __attribute__ ((naked)) __attribute__ ((used));
 extern void (*exceptionHandlerReturnHookPtr)(void) __attribute__ ((used));
+#endif
 
 #ifdef __cplusplus
 } /*extern C */
@@ -0,0 +1,109 @@
+/*
+ * The MIT License
+ *
+ * Copyright (c) 2013 Rakesh D Nair
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+*/
+
+#ifndef _BTRACE_CONFIG_H_
+#define _BTRACE_CONFIG_H_
+
+/*
+ * Build profiles of libbtrace.
+ *
+ * Select a target with -DBTRACE_PROFILE=BTRACE_PROFILE_xxx (or
+ * "make PROFILE=ARMV7A"), each profile sets defaults for the feature switches
+ * below. Any switch defined on the command line overrides its profile
+ * default. The switches are plain 0/1 constants tested with if() in the
+ * decoder, so the compiler drops the code of disabled features.
+ *
+ *   BTRACE_HAS_VFP      decode vpush / fstmdb when scanning a prologue
+ *   BTRACE_FP_FRAMES    trust FP set by "add fp, sp, #n" to correct the
+ *                       computed SP on entry (code built with frame pointers)
+ *   BTRACE_APCS_FRAMES  frames follow the -mapcs-frame layout (FP, SP, LR
+ *                       and PC saved) instead of gcc's push {fp, lr}, used
+ *                       by BT_ENGINE_FP_SCAN
+ *   BTRACE_TRACK_POPS   undo pops met while scanning back; off because gcc
+ *                       -O3 places pops in the middle of functions
+ *   BTRACE_CHECK_ETEXT  stop scanning at _etext from the linker script,
+ *                       NO_ETEXT_IN_LINKER_SCRIPT turns it off
+ */
+
+#define BTRACE_PROFILE_GENERIC  0 /* any ARM core, same as builds before profiles */
+#define BTRACE_PROFILE_ARMV5    1 /* ARM9E and similar, no VFP, APCS frames       */
+#define BTRACE_PROFILE_ARMV7A   2 /* Cortex-A with VFP / NEON                     */
+#define BTRACE_PROFILE_ARMV7R   3 /* Cortex-R, VFP, frame pointers omitted        */
+
+#ifndef BTRACE_PROFILE
+#define BTRACE_PROFILE BTRACE_PROFILE_GENERIC
+#endif
+
+#if (BTRACE_PROFILE == BTRACE_PROFILE_ARMV5)
+#define BTRACE_PROFILE_HAS_VFP    0
+#define BTRACE_PROFILE_FP_FRAMES  1
+#define BTRACE_PROFILE_APCS       1
+#elif (BTRACE_PROFILE == BTRACE_PROFILE_ARMV7A)
+#define BTRACE_PROFILE_HAS_VFP    1
+#define BTRACE_PROFILE_FP_FRAMES  1
+#define BTRACE_PROFILE_APCS       0
+#elif (BTRACE_PROFILE == BTRACE_PROFILE_ARMV7R)
+#define BTRACE_PROFILE_HAS_VFP    1
+#define BTRACE_PROFILE_FP_FRAMES  0
+#define BTRACE_PROFILE_APCS       0
+#elif (BTRACE_PROFILE == BTRACE_PROFILE_GENERIC)
+#define BTRACE_PROFILE_HAS_VFP    1
+#define BTRACE_PROFILE_FP_FRAMES  1
+#define BTRACE_PROFILE_APCS       0
+#else
+#error unknown BTRACE_PROFILE
+#endif
+
+#ifndef BTRACE_HAS_VFP
+#define BTRACE_HAS_VFP BTRACE_PROFILE_HAS_VFP
+#endif
+
+#ifndef BTRACE_FP_FRAMES
+#define BTRACE_FP_FRAMES BTRACE_PROFILE_FP_FRAMES
+#endif
+
+#ifndef BTRACE_APCS_FRAMES
+#define BTRACE_APCS_FRAMES BTRACE_PROFILE_APCS
+#endif
+
+#ifndef BTRACE_TRACK_POPS
+#define BTRACE_TRACK_POPS 0
+#endif
+
+/*there is no linker script symbol on the host, reads of code outside
+  the captured image fail instead*/
+#if defined(BTRACE_HOST_BUILD) && !defined(NO_ETEXT_IN_LINKER_SCRIPT)
+#define NO_ETEXT_IN_LINKER_SCRIPT
+#endif
+
+#ifndef BTRACE_CHECK_ETEXT
+#ifdef NO_ETEXT_IN_LINKER_SCRIPT
+#define BTRACE_CHECK_ETEXT 0
+#else
+#define BTRACE_CHECK_ETEXT 1
+#endif
+#endif
+
+#endif /*_BTRACE_CONFIG_H_*/
@@ -0,0 +1,127 @@
+/*
+ * The MIT License
+ *
+ * Copyright (c) 2013 Rakesh D Nair
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+*/
+
+#ifndef _BTRACE_CRASH_H_
+#define _BTRACE_CRASH_H_
+
+/*
+ * Crash records that survive a reset.
+ *
+ * Instead of printing the trace from the exception hook, which delays the
+ * reset by the time it takes to send every line, the trace is written as
+ * a binary record into a ring of BTRACE_CRASH_SLOTS records that is not
+ * cleared at boot. The system can reset as soon as the record is written,
+ * and the next boot reads the records back and prints them at leisure.
+ * The ring keeps the last BTRACE_CRASH_SLOTS crashes.
+ *
+ *   at boot:
+ *   if(btrace_crash_init() > 0)
+ *   {
+ *       btrace_crash_emit(uart_puts);
+ *       btrace_crash_clear();
+ *   }
+ *   btrace_set_exception_fn(btrace_crash_exception);
+ *
+ * The ring is placed in BTRACE_CRASH_SECTION, which the linker script
+ * must put in RAM that the startup code neither zeroes nor initialises,
+ * e.g. ".noinit (NOLOAD) : { *(.noinit) } > RAM". Each record carries a
+ * checksum and magic is written last, so a record cut short by a reset
+ * or left over from power up is thrown away by btrace_crash_init.
+ * If the ring is in cached memory BTRACE_CRASH_FLUSH must write the
+ * record back before the reset.
+ */
+
+#include "arm_btrace.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*number of crashes kept, must be a power of 2*/
+#ifndef BTRACE_CRASH_SLOTS
+#define BTRACE_CRASH_SLOTS 4
+#endif
+
+/*frames stored per crash*/
+#ifndef BTRACE_CRASH_MAX_DEPTH
+#define BTRACE_CRASH_MAX_DEPTH 16
+#endif
+
+/*section the ring is placed in*/
+#ifndef BTRACE_CRASH_SECTION
+#define BTRACE_CRASH_SECTION ".noinit"
+#endif
+
+/*called with the address and size of a record once it is complete*/
+#ifndef BTRACE_CRASH_FLUSH
+#define BTRACE_CRASH_FLUSH(_addr, _size)
+#endif
+
+#define BT_CRASH_MAGIC 0x31435442 /* "BTC1" */
+
+typedef struct CrashRecord {
+	bt_uint32_t     magic;       /* BT_CRASH_MAGIC once complete            */
+	bt_uint32_t     checksum;    /* FNV-1a of the fields below              */
+	bt_uint32_t     sequence;    /* counts crashes, selects the slot        */
+	bt_uint32_t     cpu;
+	bt_uint32_t     fault_lr;    /* LR seen by the exception handler        */
+	bt_uint32_t     stop_reason; /* why the unwind stopped, BT_STOP_xxx     */
+	bt_stackframe_t frame;       /* frame the unwind started from           */
+	bt_uint32_t     depth;       /* entries used in pcs                     */
+	bt_uint32_t     pcs[BTRACE_CRASH_MAX_DEPTH];
+} bt_crash_record_t;
+
+/* checks the ring after a reset, wipes incomplete or corrupt records.
+ * Must be called at boot before a crash can be recorded.
+ * Returns number of records kept.*/
+extern int btrace_crash_init( void );
+
+/* unwinds from frame and stores the trace as the newest record,
+ * replacing the oldest one if the ring is full. Returns frames stored.*/
+extern int btrace_crash_record( const bt_stackframe_t* frame, bt_uint32_t faultLr, int cpu );
+
+/*number of records in the ring*/
+extern int btrace_crash_count( void );
+
+/*record index, 0 is the oldest, or NULL*/
+extern const bt_crash_record_t* btrace_crash_get( int index );
+
+/*prints all records oldest first, returns number printed*/
+extern int btrace_crash_emit( TracePrintFnPtr print_fn );
+
+/*empties the ring*/
+extern void btrace_crash_clear( void );
+
+#ifndef BTRACE_HOST_BUILD
+/* ExceptionFnPtr for btrace_set_exception_fn, records the trace of the
+ * interrupted code with the LR seen by the exception handler of cpu.*/
+extern void btrace_crash_exception( int cpu, const bt_stackframe_t* frame );
+#endif
+
+#ifdef __cplusplus
+} /*extern C */
+#endif
+
+#endif /*_BTRACE_CRASH_H_*/
@@ -0,0 +1,97 @@
+/*
+ * The MIT License
+ *
+ * Copyright (c) 2013 Rakesh D Nair
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+*/
+
+#ifndef _BTRACE_DEDUP_H_
+#define _BTRACE_DEDUP_H_
+
+/*
+ * Aggregation of repeated backtraces.
+ *
+ * Instead of printing every trace, the PCs of each trace are hashed into a
+ * fixed capacity open addressed table that keeps one copy of every unique
+ * stack and the number of times it was seen. btrace_dedup_flush() prints
+ * the unique stacks with their counts, so the amount of output depends on
+ * the number of distinct stacks rather than on the number of events.
+ *
+ * Typical use in a hot error path,
+ *
+ *    SAVE_LOCAL_STACK_FRAME;
+ *    btrace_dedup_callstack(maxFrames);
+ *
+ * and btrace_dedup_flush(print_fn) from a periodic task. Traces started
+ * some other way can use btrace_dedup_callback as the TraceCallbackFnPtr
+ * followed by btrace_dedup_commit().
+ * Only one trace may be collected at a time. A trace committed from an
+ * interrupt that preempts btrace_dedup_flush is dropped (counted in
+ * busy), a flush must not itself interrupt a trace or commit, and on SMP
+ * all calls must be serialised by the caller.
+ */
+
+#include "arm_btrace.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*number of unique stacks that can be held, must be a power of 2*/
+#ifndef BTRACE_DEDUP_SLOTS
+#define BTRACE_DEDUP_SLOTS 32
+#endif
+
+/*frames of each stack used for the signature and kept for printing*/
+#ifndef BTRACE_DEDUP_MAX_DEPTH
+#define BTRACE_DEDUP_MAX_DEPTH 16
+#endif
+
+typedef struct DedupStats {
+	bt_uint32_t events;   /* traces committed                          */
+	bt_uint32_t unique;   /* distinct stacks held in the table         */
+	bt_uint32_t overflow; /* traces dropped because the table was full */
+	bt_uint32_t busy;     /* traces dropped during a flush             */
+} bt_dedup_stats_t;
+
+/*TraceCallbackFnPtr collecting the PCs of one trace*/
+extern int btrace_dedup_callback( int frameIndex, bt_stackframe_t* pFrame, bt_uint32_t* sp_high );
+
+/*adds the trace collected by btrace_dedup_callback to the table,
+  returns the number of times this stack has been seen or 0 if dropped*/
+extern bt_uint32_t btrace_dedup_commit( void );
+
+/*btrace_callstack from the global frame followed by btrace_dedup_commit*/
+extern bt_uint32_t btrace_dedup_callstack( int maxFrames );
+
+/*prints each unique stack with its count and empties the table,
+  returns number of stacks printed. If print_fn returns STOP_BTRACE the
+  stack being printed and those not reached stay in the table and are
+  printed by the next flush*/
+extern int btrace_dedup_flush( TracePrintFnPtr print_fn );
+
+extern void btrace_dedup_get_stats( bt_dedup_stats_t* stats );
+
+#ifdef __cplusplus
+} /*extern C */
+#endif
+
+#endif /*_BTRACE_DEDUP_H_*/
@@ -0,0 +1,93 @@
+/*
+ * The MIT License
+ *
+ * Copyright (c) 2013 Rakesh D Nair
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+*/
+
+#ifndef _BTRACE_LOG_H_
+#define _BTRACE_LOG_H_
+
+/*
+ * Asynchronous sink for trace output.
+ *
+ * btrace_log_write is a TracePrintFnPtr that copies each line into a ring
+ * of BTRACE_LOG_SLOTS fixed size slots and returns, so a trace taken in
+ * interrupt or exception context costs a string copy per frame instead of
+ * the time to transmit it. A background task calls btrace_log_drain to
+ * pass the lines on to the real (slow) print function.
+ *
+ *   btrace_log_init(BT_LOG_DROP_NEWEST);
+ *   btrace_set_print_fn(btrace_log_write, 16);
+ *   ...
+ *   btrace_log_drain(uart_puts, 8);   from a low priority task
+ *
+ * The ring has a single producer and a single consumer and uses no lock.
+ * A write that interrupts another write (a nested trace) is dropped and
+ * counted. On SMP only one core may write at a time.
+ */
+
+#include "arm_btrace.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*number of lines the ring can hold, must be a power of 2*/
+#ifndef BTRACE_LOG_SLOTS
+#define BTRACE_LOG_SLOTS 32
+#endif
+
+/*longest line stored including the terminating 0, longer lines are cut*/
+#ifndef BTRACE_LOG_LINE_SIZE
+#define BTRACE_LOG_LINE_SIZE BTRACE_PRINT_BUFFER_SIZE
+#endif
+
+/*what btrace_log_write does when the ring is full*/
+#define BT_LOG_DROP_NEWEST      0 /* drop the line and stop the trace      */
+#define BT_LOG_OVERWRITE_OLDEST 1 /* replace the oldest line not yet read  */
+
+typedef struct LogStats {
+	bt_uint32_t written;     /* lines stored                                   */
+	bt_uint32_t dropped;     /* lines lost because the ring was full           */
+	bt_uint32_t overwritten; /* lines replaced before they were drained        */
+	bt_uint32_t nested;      /* lines lost because a write was interrupted     */
+	bt_uint32_t truncated;   /* lines cut to BTRACE_LOG_LINE_SIZE              */
+	bt_uint32_t drained;     /* lines passed to the print function             */
+	bt_uint32_t max_used;    /* most slots in use at any time                  */
+} bt_log_stats_t;
+
+/*empties the ring, clears statistics and sets the full ring policy*/
+extern void btrace_log_init( int policy );
+
+/*TracePrintFnPtr, returns STOP_BTRACE if the line was dropped*/
+extern int btrace_log_write( char* message );
+
+/*passes up to maxLines lines to print_fn, returns number of lines passed*/
+extern int btrace_log_drain( TracePrintFnPtr print_fn, int maxLines );
+
+extern void btrace_log_get_stats( bt_log_stats_t* stats );
+
+#ifdef __cplusplus
+} /*extern C */
+#endif
+
+#endif /*_BTRACE_LOG_H_*/
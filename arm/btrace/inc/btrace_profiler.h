@@ -0,0 +1,113 @@
+/*
+ * The MIT License
+ *
+ * Copyright (c) 2013 Rakesh D Nair
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+*/
+
+#ifndef _BTRACE_PROFILER_H_
+#define _BTRACE_PROFILER_H_
+
+/*
+ * Sampling profiler built on btrace_callstack.
+ *
+ * A periodic timer interrupt hands the interrupted context to
+ * btrace_profiler_sample(), either directly or by returning through
+ * profilerReturnHook (see asm_utils.c) which captures FP, SP, LR and PC in
+ * the interrupted mode the same way exceptionHandlerReturnHook does and
+ * then resumes the interrupted code. Each sample unwinds at most
+ * BTRACE_PROFILER_MAX_DEPTH frames into a single producer / single consumer
+ * ring. A background task calls btrace_profiler_drain() to emit the samples
+ * as collapsed stacks ("pc;pc;pc count", outermost frame first) which can be
+ * symbolized on the host and fed to flame graph tools.
+ */
+
+#include "arm_btrace.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*number of samples the ring can hold, must be a power of 2*/
+#ifndef BTRACE_PROFILER_SLOTS
+#define BTRACE_PROFILER_SLOTS 64
+#endif
+
+/*frames recorded per sample*/
+#ifndef BTRACE_PROFILER_MAX_DEPTH
+#define BTRACE_PROFILER_MAX_DEPTH 8
+#endif
+
+/*distinct stacks btrace_profiler_drain merges before printing them*/
+#ifndef BTRACE_PROFILER_MERGE
+#define BTRACE_PROFILER_MERGE 16
+#endif
+
+/*free running cycle counter used to measure the cost of each sample*/
+typedef bt_uint32_t (*BtCycleCountFnPtr)(void);
+
+/*read the ARMv7-A/R PMU cycle counter (PMCCNTR), the PMU must be enabled*/
+#define  ARM_PMCCNTR_READ(_val) __asm__ __volatile__ (" MRC   p15, 0, %0, c9, c13, 0": "=r" (_val))
+
+typedef struct ProfilerStats {
+	bt_uint32_t samples;      /* samples stored in the ring                 */
+	bt_uint32_t dropped;      /* samples lost because the ring was full     */
+	bt_uint32_t nested;       /* samples skipped while another was running  */
+	bt_uint32_t drained;      /* samples emitted by btrace_profiler_drain   */
+	bt_uint32_t last_cycles;  /* cost of the last sample                    */
+	bt_uint32_t max_cycles;   /* cost of the most expensive sample          */
+	bt_uint32_t total_cycles; /* cost of all samples, wraps                 */
+} bt_profiler_stats_t;
+
+/*clears the ring and statistics, cycle_fn may be NULL. sampling is stopped*/
+extern void btrace_profiler_init( BtCycleCountFnPtr cycle_fn );
+extern void btrace_profiler_start( void );
+extern void btrace_profiler_stop( void );
+
+/*called from the timer interrupt (or profilerReturnHook) with the
+  interrupted context, the frame is not modified*/
+extern void btrace_profiler_sample( const bt_stackframe_t* frame );
+
+/* takes up to maxSamples samples from the ring and emits them as collapsed
+ * stacks, one line with a count per distinct stack (up to
+ * BTRACE_PROFILER_MERGE are merged at a time). Returns number of samples
+ * taken. Stacks not printed because print_fn returned STOP_BTRACE are
+ * printed first by the next call.*/
+extern int btrace_profiler_drain( TracePrintFnPtr print_fn, int maxSamples );
+
+extern void btrace_profiler_get_stats( bt_profiler_stats_t* stats );
+
+/* Trampoline for the timer interrupt handler. Instead of returning to the
+ * interrupted code, the handler stores its return address in
+ * Profiler_Return_PC and returns to profilerReturnHook, which takes the
+ * sample on the interrupted stack and resumes at Profiler_Return_PC with
+ * all registers and condition flags preserved.*/
+#ifndef BTRACE_HOST_BUILD
+extern bt_uint32_t* Profiler_Return_PC;
+extern void profilerReturnHook(void) __attribute__ ((naked)) __attribute__ ((used));
+extern void (*profilerReturnHookPtr)(void) __attribute__ ((used));
+#endif
+
+#ifdef __cplusplus
+} /*extern C */
+#endif
+
+#endif /*_BTRACE_PROFILER_H_*/
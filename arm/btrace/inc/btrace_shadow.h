@@ -0,0 +1,121 @@
+/*
+ * The MIT License
+ *
+ * Copyright (c) 2013 Rakesh D Nair
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+*/
+
+#ifndef _BTRACE_SHADOW_H_
+#define _BTRACE_SHADOW_H_
+
+/*
+ * Shadow call stack.
+ *
+ * Code built with -finstrument-functions calls __cyg_profile_func_enter
+ * and __cyg_profile_func_exit around every function. The hooks here keep
+ * the return addresses of the active calls in a small array, so a trace
+ * is a copy of that array instead of an unwind: the cost does not grow
+ * with the size of the functions and no code or stack is read. In return
+ * every instrumented call pays for the two hooks, see btrace_bench -s.
+ *
+ * Each task owns a bt_shadow_stack_t and the context switch hook of the
+ * RTOS makes it current. Until then all calls go to a default stack (one
+ * per core with BTRACE_NUM_CPUS > 1).
+ *
+ * With BTRACE_NUM_CPUS > 1 the hooks find their core in TPIDRURO, which
+ * user mode code can read, unlike MPIDR. Every core must call
+ * btrace_shadow_cpu_init from a privileged mode before it runs
+ * instrumented code, and TPIDRURO cannot then be used for anything else
+ * (e.g. a TLS pointer). If all instrumented code runs privileged, build
+ * with BTRACE_SHADOW_MPIDR=1 to read MPIDR instead.
+ *
+ *   build the application (not libbtrace) with -finstrument-functions
+ *   btrace_shadow_cpu_init();                       on each core at boot
+ *   btrace_shadow_init(&task->shadow);              at task creation
+ *   btrace_shadow_switch(&next->shadow);            on context switch
+ *   btrace_shadow_callstack(0, 16);                 in the allocation hook
+ *
+ * A stack holds BTRACE_SHADOW_DEPTH calls. Calls nested deeper are still
+ * counted, so exits stay balanced, but are not recorded; each one adds to
+ * overflow and a trace taken at that depth misses the innermost frames.
+ * Only calls between instrumented functions are seen: frames of library
+ * or assembly code do not show up. The hooks store return addresses; a
+ * trace turns them into call sites with btrace_call_site, which reads the
+ * halfword before each thumb return address.
+ */
+
+#include "arm_btrace.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*calls recorded per stack*/
+#ifndef BTRACE_SHADOW_DEPTH
+#define BTRACE_SHADOW_DEPTH 32
+#endif
+
+/*1: the hooks read MPIDR, instrumented code must run privileged*/
+#ifndef BTRACE_SHADOW_MPIDR
+#define BTRACE_SHADOW_MPIDR 0
+#endif
+
+typedef struct ShadowStack {
+	bt_uint32_t depth;       /* active instrumented calls               */
+	bt_uint32_t max_depth;   /* deepest nesting seen                    */
+	bt_uint32_t overflow;    /* calls not recorded, deeper than the stack */
+	bt_uint32_t sites[BTRACE_SHADOW_DEPTH]; /* return addresses, outermost first */
+} bt_shadow_stack_t;
+
+/* stores the index of this core in TPIDRURO for the hooks, call from a
+ * privileged mode. Does nothing on one core or with BTRACE_SHADOW_MPIDR.*/
+extern void btrace_shadow_cpu_init( void );
+
+extern void btrace_shadow_init( bt_shadow_stack_t* stack );
+
+/* makes stack current on this core, NULL selects the default stack.
+ * Returns the previous one.*/
+extern bt_shadow_stack_t* btrace_shadow_switch( bt_shadow_stack_t* stack );
+
+/* copies the PCs of the calls active in the caller into pcs, innermost
+ * first. pcs[0] is the call to btrace_shadow_capture itself, the rest come
+ * from the shadow stack. Returns number of PCs copied.*/
+extern int btrace_shadow_capture( bt_uint32_t* pcs, int maxFrames ) __attribute__ ((noinline));
+
+/* same frames, frame 0 being the call to btrace_shadow_unwind, passed to
+ * the sink of ctx (callback_fn, records or print_fn) as btrace_unwind
+ * would. Only pc is set in each frame and callbacks get a NULL sp_high.
+ * ctx->frame and ctx->engine are not used. Sets ctx->stop_reason, returns
+ * number of frames.*/
+extern int btrace_shadow_unwind( bt_unwind_ctx_t* ctx ) __attribute__ ((noinline));
+
+/*btrace_callstack from the shadow stack, to callback_fn or the print function*/
+extern int btrace_shadow_callstack( TraceCallbackFnPtr callback_fn, int maxFrames ) __attribute__ ((noinline));
+
+/*instrumentation hooks*/
+extern void __cyg_profile_func_enter( void* fn, void* callSite ) __attribute__ ((no_instrument_function));
+extern void __cyg_profile_func_exit( void* fn, void* callSite ) __attribute__ ((no_instrument_function));
+
+#ifdef __cplusplus
+} /*extern C */
+#endif
+
+#endif /*_BTRACE_SHADOW_H_*/
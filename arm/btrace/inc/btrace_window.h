@@ -0,0 +1,121 @@
+/*
+ * The MIT License
+ *
+ * Copyright (c) 2013 Rakesh D Nair
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+*/
+
+#ifndef _BTRACE_WINDOW_H_
+#define _BTRACE_WINDOW_H_
+
+/*
+ * Compact dump of the stack used by each frame.
+ *
+ * Instead of printing every word between SP_LO and SP_HI, the encoder
+ * writes the words of each frame into a caller supplied buffer in a byte
+ * code that is usually a fraction of their size: runs of zero or repeated
+ * words become one token, pointers into the stack are stored as offsets
+ * from the frame's SP, return addresses as offsets from the start of text,
+ * and small positive or negative values in as few bytes as they need.
+ * Nothing is allocated, and a frame that does not fit is left out whole.
+ * tools/btrace_window decodes the buffer back into the exact words, either
+ * as a listing or as a snapshot for tools/btrace_unwind.
+ *
+ *   bt_window_encoder_t enc;
+ *   btrace_window_init(&enc, buffer, sizeof(buffer), text_start, text_end);
+ *   btrace_init_context(&ctx);
+ *   SAVE_STACK_FRAME(&ctx.frame);
+ *   ctx.max_frames = 16;
+ *   ctx.callback_fn = btrace_window_callback;
+ *   ctx.user = &enc;
+ *   btrace_unwind(&ctx);
+ *   size = btrace_window_finish(&enc);
+ *
+ * Stream layout, all multi byte fields little endian:
+ *   magic, text_start, text_end                      3 x 32 bit
+ *   per frame: BT_WINDOW_FRAME, index (varint), pc, sp, lr, fp (32 bit),
+ *              number of words (varint), then tokens covering the words
+ *              from sp upwards
+ *   BT_WINDOW_END
+ * A token byte holds the op in bits 5-7 and an argument in bits 0-4.
+ * Runs take the count from the argument, or from a varint that follows
+ * if the argument is 0. Single word ops take a value from bits 0-3 of
+ * the argument, and if bit 4 is set, plus a varint that follows shifted
+ * left by 4. Varints are unsigned LEB128.
+ */
+
+#include "arm_btrace.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BT_WINDOW_MAGIC      0x31575442 /* "BTW1" */
+
+#define BT_WINDOW_OP_ZERO     0 /* run of zero words                         */
+#define BT_WINDOW_OP_REPEAT   1 /* run of copies of the previous word        */
+#define BT_WINDOW_OP_SMALL    2 /* value                                     */
+#define BT_WINDOW_OP_INVERTED 3 /* ~value, small negative numbers            */
+#define BT_WINDOW_OP_TEXT     4 /* text_start + value                        */
+#define BT_WINDOW_OP_STACK    5 /* sp of the frame + value                   */
+#define BT_WINDOW_OP_RAW      6 /* 32 bit word follows                       */
+#define BT_WINDOW_OP_CONTROL  7
+
+#define BT_WINDOW_FRAME      ((BT_WINDOW_OP_CONTROL << 5) | 0)
+#define BT_WINDOW_END        ((BT_WINDOW_OP_CONTROL << 5) | 1)
+
+#define BT_WINDOW_VARINT_BIT 0x10
+
+typedef struct WindowEncoder {
+	bt_uint8_t* buffer;
+	int         size;
+	int         used;       /* bytes written so far                     */
+	bt_uint32_t text_start; /* [text_start, text_end) holds code, 0 = none */
+	bt_uint32_t text_end;
+	int         frames;     /* frames encoded                           */
+	int         dropped;    /* frames that did not fit                  */
+} bt_window_encoder_t;
+
+/*starts a stream in buffer, which must hold at least 13 bytes*/
+extern void btrace_window_init( bt_window_encoder_t* enc, bt_uint8_t* buffer, int bufferBytes,
+                                bt_uint32_t textStart, bt_uint32_t textEnd );
+
+/* appends frame and the numWords words at frame->sp (words[0]) upwards,
+ * returns bytes written or < 0 if the frame did not fit*/
+extern int btrace_window_encode( bt_window_encoder_t* enc, int frameIndex,
+                                 const bt_stackframe_t* frame, const bt_uint32_t* words, int numWords );
+
+/* ends the stream, returns its size in bytes or < 0 if the buffer is
+ * shorter than 13 bytes*/
+extern int btrace_window_finish( bt_window_encoder_t* enc );
+
+#ifndef BTRACE_HOST_BUILD
+/* TraceCallbackFnPtr for btrace_unwind with ctx.user pointing to a
+ * bt_window_encoder_t, encodes the words from SP to SP_HI of each frame.
+ * Stops the trace when the buffer is full or ctx.user is NULL.*/
+extern int btrace_window_callback( int frameIndex, bt_stackframe_t* pFrame, bt_uint32_t* sp_high );
+#endif
+
+#ifdef __cplusplus
+} /*extern C */
+#endif
+
+#endif /*_BTRACE_WINDOW_H_*/
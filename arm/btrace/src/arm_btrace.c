@@ -23,6 +23,8 @@
  *
  */
 
+#include <stdio.h>
+#include <string.h>
 #include "arm_defs.h"
 #include "arm_btrace.h"
 
@@ -31,13 +33,99 @@ const bt_uint32_t FP_UPDATED_USING_SP   = 1;
 const bt_uint32_t LR_FOUND_ON_STACK     = 2;
 const bt_uint32_t OLD_FP_FOUND_ON_STACK = 4;
 
-char tempPrintBuffer[128];
+char tempPrintBuffer[BTRACE_PRINT_BUFFER_SIZE];
 static int max_frames=0;
 static TracePrintFnPtr trace_print_fn = 0;
+static bt_frame_record_t* frame_records = 0;
+static int max_frame_records = 0;
+static int num_frame_records = 0;
+#ifndef BTRACE_HOST_BUILD
+static bt_snapshot_t* snapshot_buffer = 0;
+static int snapshot_bytes = 0;
+static bt_uint32_t snapshot_stack_limit = 0;
+#endif
+static ExceptionFnPtr exception_fn = 0;
 static bt_stackframe_t Exception_StackFrame;
 bt_stackframe_t* Exception_StackFrame_Ptr = &Exception_StackFrame;
+#if (BTRACE_NUM_CPUS > 1)
+bt_stackframe_t Exception_CpuStackFrame[BTRACE_NUM_CPUS]; /*filled by exceptionHandlerReturnHook*/
+static bt_unwind_ctx_t cpu_ctx[BTRACE_NUM_CPUS];
+static char cpu_print_buffer[BTRACE_NUM_CPUS][BTRACE_PRINT_BUFFER_SIZE];
+#endif
+static const bt_unwind_entry_t* unwind_table = 0;
+static int unwind_table_entries = 0;
+static bt_frame_cache_stats_t frame_cache_stats;
+static int last_stop_reason = BT_STOP_MAX_FRAMES;
+#if BTRACE_STATS
+static bt_unwind_stats_t unwind_stats;
+#endif
+
+/* Memory access of the unwinder. The helpers below read through the
+ * reader of the bt_unwind_cursor_t* cursor in scope and count failed
+ * reads in it, so every unwind keeps its own reader and error count.*/
+#ifdef BTRACE_MEM_READER
+static bt_mem_reader_t mem_reader;
+
+void btrace_set_mem_reader(const bt_mem_reader_t* reader)
+{
+	mem_reader.read_word = reader ? reader->read_word : 0;
+	mem_reader.ctx = reader ? reader->ctx : 0;
+}
+
+/*failed reads return 0 and are counted so that the frame can be rejected*/
+static bt_uint32_t read_word(bt_unwind_cursor_t* cursor, bt_uint32_t addr)
+{
+	const bt_mem_reader_t* reader = cursor->reader ? cursor->reader : &mem_reader;
+	bt_uint32_t value = 0;
+	#ifndef BTRACE_HOST_BUILD
+	if(!reader->read_word)
+	{   /*no reader installed, live memory of the target*/
+		return *BT_ADDR_TO_PTR(addr);
+	}
+	#endif
+	if(!reader->read_word || (reader->read_word(reader->ctx, addr, &value) < 0))
+	{
+		++cursor->read_errors;
+		value = 0;
+	}
+	return value;
+}
+
+#define BT_READ_WORD(_addr)   read_word(cursor, _addr)
+#define MEM_READ_FAILED()     (cursor->read_errors != 0)
+#define MEM_READ_RESET()      (cursor->read_errors = 0)
+#else
+/*live memory, cursor is only named to keep the helpers alike*/
+#define BT_READ_WORD(_addr)   ((void)cursor, *BT_ADDR_TO_PTR(_addr))
+#define MEM_READ_FAILED()     0
+#define MEM_READ_RESET()
+#endif
+
+#if BTRACE_FRAME_CACHE_SIZE
+#if (BTRACE_FRAME_CACHE_SIZE & (BTRACE_FRAME_CACHE_SIZE - 1))
+#error BTRACE_FRAME_CACHE_SIZE must be a power of 2
+#endif
+/* fn_start holds the PC of the frame, fn_words holds FRAME_CACHE_CHECK of the
+ * other fields and 0 marks an unused entry. Contexts on other cores may fill
+ * an entry while it is being read, a torn entry fails the check.*/
+static bt_unwind_entry_t frame_cache[BTRACE_FRAME_CACHE_SIZE];
+#define FRAME_CACHE_INDEX(_pc) ((((_pc) >> 2) ^ ((_pc) >> 12)) & (BTRACE_FRAME_CACHE_SIZE - 1))
+#define FRAME_CACHE_CHECK(_e) ((bt_uint16_t)(0x8000 | (((_e)->fn_start ^ ((_e)->fn_start >> 16) ^ \
+                                                     (_e)->sp_delta ^ ((_e)->lr_slot << 4) ^ \
+                                                     ((_e)->fp_slot << 8) ^ ((_e)->flags << 12)) & 0x7FFF)))
+
+/*slot of a word saved at addr below callerSp, 0 if it does not fit in an entry*/
+static bt_uint8_t frame_cache_slot(bt_uint32_t callerSp, bt_uint32_t addr)
+{
+	bt_uint32_t slot = (callerSp - addr) >> 2;
+	return ((slot > 0) && (slot <= 0xFF)) ? (bt_uint8_t)slot : 0;
+}
+#endif
 
 extern void exceptionTraceCallstack(void) __attribute__ ((noinline));
+#if (BTRACE_NUM_CPUS > 1)
+extern int exceptionTraceCallstackCpu(int cpu) __attribute__ ((noinline));
+#endif
 
 bt_stackframe_t* get_frame_ptr() { return Exception_StackFrame_Ptr; }
 
@@ -49,20 +137,77 @@ TracePrintFnPtr btrace_set_print_fn(TracePrintFnPtr print_fn,int maxFrames)
 	return oldPrintFn;
 }
 
-/*count the number of registers in register list in the opcode*/
-int num_registers(bt_uint32_t opcode)
+TracePrintFnPtr btrace_get_print_fn(void)
+{
+	return trace_print_fn;
+}
+
+void btrace_set_record_buffer(bt_frame_record_t* records, int maxRecords)
 {
-	int nbits,count=0;
-	for(nbits = 0; nbits < 16; ++nbits)
+	frame_records = records;
+	max_frame_records = records ? maxRecords : 0;
+	num_frame_records = 0;
+}
+
+int btrace_get_record_count(void)
+{
+	return num_frame_records;
+}
+
+int btrace_get_cpu_record_count(int cpu)
+{
+	#if (BTRACE_NUM_CPUS > 1)
+	return ((cpu >= 0) && (cpu < BTRACE_NUM_CPUS)) ? cpu_ctx[cpu].num_records : 0;
+	#else
+	return cpu ? 0 : num_frame_records;
+	#endif
+}
+
+int btrace_set_unwind_table(const bt_unwind_entry_t* table, int numEntries)
+{
+	if(!table || (numEntries < 0))
 	{
-		if((opcode >> nbits) & 1)
-		{
-			++count;
-		}
+		numEntries = 0;
+	}
+	unwind_table = table;
+	unwind_table_entries = numEntries;
+	return numEntries;
+}
+
+int btrace_frame_cache_stats(bt_frame_cache_stats_t* stats)
+{
+	if(stats)
+	{
+		*stats = frame_cache_stats;
+	}
+	return BTRACE_FRAME_CACHE_SIZE;
+}
+
+void btrace_frame_cache_flush(void)
+{
+	#if BTRACE_FRAME_CACHE_SIZE
+	int index;
+	for(index = 0; index < BTRACE_FRAME_CACHE_SIZE; ++index)
+	{
+		frame_cache[index].fn_words = 0;
 	}
-	return count;
+	#endif
+	frame_cache_stats.hits = 0;
+	frame_cache_stats.misses = 0;
+}
+
+/*count the number of registers in register list in the opcode*/
+int num_registers(bt_uint32_t opcode)
+{
+	return __builtin_popcount(opcode & 0xFFFF);
 }
 
+/* Instruction classes of interest to process_instruction, one lookup per
+ * opcode instead of the IS_xxx chain (see OPCODE_CLASS_256 in arm_defs.h).*/
+static const bt_uint8_t opcode_class_table[256] = { OPCODE_CLASS_256 };
+
+#define GET_OPCODE_CLASS(_opcode) opcode_class_table[OPCODE_CLASS_INDEX(_opcode)]
+
 /*
  * ------------------------------------------------------------------------------
  * Stack walking without relying on the presence of frame pointer.
@@ -88,15 +233,19 @@ int num_registers(bt_uint32_t opcode)
  * */
 
 
-/* Return values,
+/* The addresses LR and FP were read from go to lr_addr_ptr and fp_addr_ptr.
+ * Return values,
  * > 0  indicates SP modified.
  * = 0 means no change to SP, and
- * < 0 indicate error.
+ * < 0 is -BT_STOP_xxx, the reason it cannot be unwound.
  * */
-static int process_instruction( bt_uint32_t opcode,
+static int process_instruction( bt_unwind_cursor_t* cursor,
+								bt_uint32_t opcode,
 								bt_uint32_t* sp_ptr,
 								bt_uint32_t* fp_on_stack_ptr,
 								bt_uint32_t* lr_on_stack_ptr,
+								bt_uint32_t* lr_addr_ptr,
+								bt_uint32_t* fp_addr_ptr,
 								bt_uint32_t* trace_flags_ptr)
 {
 	#ifdef DEBUG_ON_QEMU
@@ -104,16 +253,18 @@ static int process_instruction( bt_uint32_t opcode,
 	#endif
 
 	int retCode = 0;
-	if(IS_SUB(opcode) || IS_ADD(opcode))
+	bt_uint32_t opcode_class = GET_OPCODE_CLASS(opcode);
+
+	if(opcode_class & (OPCODE_CLASS_SUB | OPCODE_CLASS_ADD))
 	{
 		/*if the destination register is SP */
 		if(IS_MOV_DST_REG(opcode,SP_ID))
 		{
 			if(IS_IMMEDIATE(opcode))
 			{   /*add what was subtracted*/
-				if(IS_SUB(opcode))
+				if(opcode_class & OPCODE_CLASS_SUB)
 				{   /*add if opcode is sub*/
-					*sp_ptr += (GET_IMMEDIATE_OPERAND(opcode) << (0xF & (16 - GET_OPERAND_SHIFT(opcode))) );
+					*sp_ptr += GET_ROTATED_IMMEDIATE(opcode);
 					retCode = __LINE__;
 				}
 				else
@@ -122,18 +273,18 @@ static int process_instruction( bt_uint32_t opcode,
 					  "full descending" stack. however, if in future, code is
 					  added to walk forward to the end of the function this
 					  may come in handy*/
-					*sp_ptr -= (GET_IMMEDIATE_OPERAND(opcode) << (0xF & (16 - GET_OPERAND_SHIFT(opcode))) );
+					*sp_ptr -= GET_ROTATED_IMMEDIATE(opcode);
 					retCode = __LINE__;
 				}
 			}
 			else
 			{
-				retCode = -__LINE__; // cannot unwind
+				retCode = -BT_STOP_SP_FROM_REG; // cannot unwind
 			}
 		}
 		else if(IS_MOV_DST_REG(opcode,FP_ID))
 		{   /* FP is destination register */
-			if( IS_ADD(opcode) && /*this is an add operation*/
+			if( (opcode_class & OPCODE_CLASS_ADD) && /*this is an add operation*/
 				IS_OPERAND_REG(opcode,SP_ID) && /*with SP is one of the operands*/
 		        IS_IMMEDIATE(opcode) ) /*and an immediate offset*/
 			{   /* add	fp, sp, #offset*/
@@ -141,7 +292,7 @@ static int process_instruction( bt_uint32_t opcode,
 			}
 		}
 	}
-	else if(IS_SINGLE_DATA(opcode))
+	else if(opcode_class & OPCODE_CLASS_SINGLE)
 	{	/*push and pop of single register is also handled here*/
 		/*LDR and STR always writeback when post indexed*/
 		if(IS_LDST_DST_REG(opcode,SP_ID))
@@ -150,7 +301,7 @@ static int process_instruction( bt_uint32_t opcode,
 			{   /*we are only interested if write back bit is set*/
 				if(IS_INCREMENT(opcode))
 				{
-					#if 0 /*-O3 bug fix: ignore pops. when configured for full optimization (-O3)
+					#if BTRACE_TRACK_POPS /*-O3 bug fix: ignore pops. when configured for full optimization (-O3)
 					gcc generates pops in between function code in addition to function epilogue!*/
 
 					/*we do not expect to see SP increments when walking back a
@@ -167,12 +318,14 @@ static int process_instruction( bt_uint32_t opcode,
 					*sp_ptr += sizeof(bt_uint32_t);/*single word transfer*/
 					if(IS_LDST_REG2(opcode,LR_ID))
 					{
-					   *lr_on_stack_ptr = sp_ptr[-1];
+					   *lr_addr_ptr = *sp_ptr - sizeof(bt_uint32_t);
+					   *lr_on_stack_ptr = BT_READ_WORD(*lr_addr_ptr);
 					   *trace_flags_ptr |= LR_FOUND_ON_STACK;
 					}
 					if(IS_LDST_REG2(opcode,FP_ID))
 					{  /*if lr was pushed then it is pushed before FP*/
-					   *fp_on_stack_ptr = sp_ptr[-1];
+					   *fp_addr_ptr = *sp_ptr - sizeof(bt_uint32_t);
+					   *fp_on_stack_ptr = BT_READ_WORD(*fp_addr_ptr);
 					   *trace_flags_ptr |= OLD_FP_FOUND_ON_STACK;
 					}
 					retCode = __LINE__;
@@ -180,7 +333,7 @@ static int process_instruction( bt_uint32_t opcode,
 			}
 		}
 	}
-	else if(IS_BLOCK_DATA(opcode))
+	else if(opcode_class & OPCODE_CLASS_BLOCK)
 	{/*push and pop of multiple registers is also handled here*/
 		if(IS_LDST_DST_REG(opcode,SP_ID))
 		{
@@ -189,7 +342,7 @@ static int process_instruction( bt_uint32_t opcode,
 				int num_reg = num_registers(opcode);
 				if(IS_INCREMENT(opcode))
 				{
-					#if 0 /*-O3 bug fix: ignore pops. when configured for full optimization (-O3)
+					#if BTRACE_TRACK_POPS /*-O3 bug fix: ignore pops. when configured for full optimization (-O3)
 					gcc generates pops in between function code in addition to function epilogue!*/
 					/*we do not expect to see SP increments when walking back a
 					  "full descending" stack. however, if in future, code is
@@ -204,14 +357,16 @@ static int process_instruction( bt_uint32_t opcode,
 					*sp_ptr += (num_reg << 2);// 4 bytes per register.
 					if(opcode & OPCODE_LR_BIT)
 					{
-						*lr_on_stack_ptr = ((bt_uint32_t*)(*sp_ptr))[-1];
+						*lr_addr_ptr = *sp_ptr - sizeof(bt_uint32_t);
+						*lr_on_stack_ptr = BT_READ_WORD(*lr_addr_ptr);
 						*trace_flags_ptr |= LR_FOUND_ON_STACK;
 					}
 					if(opcode & OPCODE_FP_BIT)
 					{ /*if lr was pushed then it is pushed before FP*/
-						*fp_on_stack_ptr = (opcode & OPCODE_LR_BIT)? \
-								           ((bt_uint32_t*)(*sp_ptr))[-2] :\
-								           ((bt_uint32_t*)(*sp_ptr))[-1] ;
+						*fp_addr_ptr = (opcode & OPCODE_LR_BIT)? \
+								       (*sp_ptr - 2 * sizeof(bt_uint32_t)) :\
+								       (*sp_ptr - sizeof(bt_uint32_t)) ;
+						*fp_on_stack_ptr = BT_READ_WORD(*fp_addr_ptr);
 						*trace_flags_ptr |= OLD_FP_FOUND_ON_STACK;
 
 					}
@@ -220,7 +375,7 @@ static int process_instruction( bt_uint32_t opcode,
 			}
 		}
 	}
-	else if(IS_LDC_STC(opcode))
+	else if(BTRACE_HAS_VFP && (opcode_class & OPCODE_CLASS_LDC_STC))
 	{   /* TODO: handling of load store coprocessor registers on stack
 	       using vldmia,vpush etc. remains to be tested.*/
 
@@ -231,7 +386,7 @@ static int process_instruction( bt_uint32_t opcode,
 			{
 				if(IS_INCREMENT(opcode))
 				{
-					#if 0 /*-O3 bug fix: ignore pops. when configured for full optimization (-O3)
+					#if BTRACE_TRACK_POPS /*-O3 bug fix: ignore pops. when configured for full optimization (-O3)
 					gcc generates pops in between function code in addition to function epilogue!*/
 
 					/*we do not expect to see SP increments when walking back a
@@ -259,91 +414,758 @@ static int process_instruction( bt_uint32_t opcode,
     return retCode;
 }
 
-#ifndef NO_ETEXT_IN_LINKER_SCRIPT
+#if BTRACE_CHECK_ETEXT
 /*end of .text exported from ld script */
 extern unsigned long _etext;
 #endif
 
 /*assumes that all functions begin with a push statement*/
-static int walk_to_fn_start(bt_uint32_t** fn_start_pc_ptr,
+static int walk_to_fn_start(bt_unwind_cursor_t* cursor,
+							bt_uint32_t* fn_start_pc_ptr,
 							bt_uint32_t* fn_start_sp_ptr,
 							bt_uint32_t* fp_on_stack_ptr,
 							bt_uint32_t* lr_on_stack_ptr,
+							bt_uint32_t* lr_addr_ptr,
+							bt_uint32_t* fp_addr_ptr,
 							bt_uint32_t* trace_flags_ptr)
 {
 	int status = 0;
+	bt_uint32_t opcode = BT_READ_WORD(*fn_start_pc_ptr);
+
 	/*while not push decrement pc and revert SP changes*/
-	while (!IS_PUSH(**fn_start_pc_ptr))
+	while (!IS_PUSH(opcode))
 	{/*push single or push multiple*/
-		status = process_instruction( **fn_start_pc_ptr,
+		status = process_instruction( cursor,
+				                      opcode,
 				                      fn_start_sp_ptr,
 				                      fp_on_stack_ptr,
 				                      lr_on_stack_ptr,
+				                      lr_addr_ptr,
+				                      fp_addr_ptr,
 				                      trace_flags_ptr);
 		/*todo: add sanity check here, if we see pop on the way to start of functions then some thing is fishy */
-		/*if(status < 0) */
-		*fn_start_pc_ptr -= 1;
+		if(status < 0)
+		{   /*e.g. SP adjusted by a register, the frame size is unknown*/
+			break;
+		}
+		*fn_start_pc_ptr -= sizeof(bt_uint32_t);
 
-	    #ifndef NO_ETEXT_IN_LINKER_SCRIPT
+	    #if BTRACE_CHECK_ETEXT
 
-		if(*fn_start_pc_ptr >= (bt_uint32_t*)&_etext)
+		if(*fn_start_pc_ptr >= (bt_uint32_t)&_etext)
 		{   /*STOP !! _etext is expected to be exported by linker script
 		     This check is just to protect against this function looping forever in
 		     non code sections searching for a push.
 		     If you get _etext unresolved error then define NO_ETEXT_IN_LINKER_SCRIPT
 		     when compiling this file*/
-			status = -__LINE__;
+			status = -BT_STOP_ETEXT;
 		    break;
 		}
 
-		#endif /*NO_ETEXT_IN_LINKER_SCRIPT*/
+		#endif /*BTRACE_CHECK_ETEXT*/
+
+		opcode = BT_READ_WORD(*fn_start_pc_ptr);
+		if(MEM_READ_FAILED())
+		{   /*walked out of the memory available to the reader*/
+			status = -BT_STOP_MEM_READ;
+			break;
+		}
 	}
 	if(status >= 0)
 	{
 		/*process the push */
-		status = process_instruction( **fn_start_pc_ptr,
+		status = process_instruction( cursor,
+									  opcode,
 									  fn_start_sp_ptr,
 									  fp_on_stack_ptr,
 									  lr_on_stack_ptr,
+									  lr_addr_ptr,
+									  fp_addr_ptr,
 									  trace_flags_ptr);
 	}
-	/*if(status < 0) */
-return status;
+	return status;
+}
+
+/*binary search the unwind table for the function containing pc*/
+static const bt_unwind_entry_t* find_unwind_entry(bt_uint32_t pc)
+{
+	int low = 0;
+	int high = unwind_table_entries - 1;
+
+	while(low <= high)
+	{
+		int mid = (low + high) >> 1;
+		const bt_unwind_entry_t* entry = &unwind_table[mid];
+
+		if(pc < entry->fn_start)
+		{
+			high = mid - 1;
+		}
+		else if(pc >= (entry->fn_start + (entry->fn_words << 2)))
+		{
+			low = mid + 1;
+		}
+		else
+		{
+			return entry;
+		}
+	}
+	return 0;
+}
+
+/* Same outputs as walk_to_fn_start but computed from a table entry.
+ * Return value = 0 means the entry cannot be used for this pc
+ * and the caller must scan for the start of the function.*/
+static int apply_unwind_entry(bt_unwind_cursor_t* cursor,
+							  const bt_unwind_entry_t* entry,
+							  bt_uint32_t pc,
+							  bt_uint32_t* fn_start_sp_ptr,
+							  bt_uint32_t* fp_on_stack_ptr,
+							  bt_uint32_t* lr_on_stack_ptr,
+							  bt_uint32_t* trace_flags_ptr)
+{
+	if(pc < (entry->fn_start + (entry->prologue_words << 2)))
+	{   /*prologue has not completed yet*/
+		return 0;
+	}
+
+	*fn_start_sp_ptr += entry->sp_delta;
+	if(entry->lr_slot)
+	{
+		*lr_on_stack_ptr = BT_READ_WORD(*fn_start_sp_ptr - (entry->lr_slot << 2));
+		*trace_flags_ptr |= LR_FOUND_ON_STACK;
+	}
+	if(entry->fp_slot)
+	{
+		*fp_on_stack_ptr = BT_READ_WORD(*fn_start_sp_ptr - (entry->fp_slot << 2));
+		*trace_flags_ptr |= OLD_FP_FOUND_ON_STACK;
+	}
+	if(entry->flags & BT_UNWIND_FP_FROM_SP)
+	{
+		*trace_flags_ptr |= FP_UPDATED_USING_SP;
+	}
+	return __LINE__;
+}
+
+/*copies cached result of a previous scan from pc to entry, returns 0 if none*/
+static int find_cached_frame(bt_uint32_t pc, bt_unwind_entry_t* entry)
+{
+	#if BTRACE_FRAME_CACHE_SIZE
+	const volatile bt_unwind_entry_t* cached = &frame_cache[FRAME_CACHE_INDEX(pc)];
+	bt_uint16_t check = cached->fn_words;
+	BT_MEMORY_BARRIER();
+	entry->fn_start = cached->fn_start;
+	entry->sp_delta = cached->sp_delta;
+	entry->prologue_words = 0;
+	entry->lr_slot = cached->lr_slot;
+	entry->fp_slot = cached->fp_slot;
+	entry->flags = cached->flags;
+	entry->fn_words = check;
+	BT_MEMORY_BARRIER();
+	if(check && (entry->fn_start == pc) &&
+	   (check == FRAME_CACHE_CHECK(entry)) && (cached->fn_words == check))
+	{
+		++frame_cache_stats.hits;
+		return __LINE__;
+	}
+	#endif
+	++frame_cache_stats.misses;
+	return 0;
+}
+
+/* Remember the outcome of walk_to_fn_start from pc, with LR and FP in
+ * the slots below callerSp the scan read them from.*/
+static void cache_frame(bt_uint32_t pc, bt_uint32_t sp_delta, bt_uint32_t callerSp,
+                        bt_uint32_t lrAddr, bt_uint32_t fpAddr, bt_uint32_t trace_flags)
+{
+	#if BTRACE_FRAME_CACHE_SIZE
+	volatile bt_unwind_entry_t* entry = &frame_cache[FRAME_CACHE_INDEX(pc)];
+	bt_unwind_entry_t fill;
+	if(sp_delta > 0xFFFF)
+	{
+		return;
+	}
+	fill.fn_start = pc;
+	fill.sp_delta = (bt_uint16_t)sp_delta;
+	fill.prologue_words = 0;
+	fill.lr_slot = (trace_flags & LR_FOUND_ON_STACK) ? frame_cache_slot(callerSp, lrAddr) : 0;
+	fill.fp_slot = (trace_flags & OLD_FP_FOUND_ON_STACK) ? frame_cache_slot(callerSp, fpAddr) : 0;
+	if(((trace_flags & LR_FOUND_ON_STACK) && !fill.lr_slot) ||
+	   ((trace_flags & OLD_FP_FOUND_ON_STACK) && !fill.fp_slot))
+	{   /*saved above the caller SP or too far below it*/
+		return;
+	}
+	fill.flags = (trace_flags & FP_UPDATED_USING_SP) ? BT_UNWIND_FP_FROM_SP : 0;
+	fill.fn_words = FRAME_CACHE_CHECK(&fill);
+
+	/*invalidate, fill, then publish so readers never accept a partial entry*/
+	entry->fn_words = 0;
+	BT_MEMORY_BARRIER();
+	entry->fn_start = fill.fn_start;
+	entry->sp_delta = fill.sp_delta;
+	entry->prologue_words = 0;
+	entry->lr_slot = fill.lr_slot;
+	entry->fp_slot = fill.fp_slot;
+	entry->flags = fill.flags;
+	BT_MEMORY_BARRIER();
+	entry->fn_words = fill.fn_words;
+	#endif
+}
+
+/* Finds SP on entry and the saved LR and FP of the function containing
+ * frame_ptr->pc using the unwind table, the frame cache or by scanning
+ * back for the prologue, in that order.*/
+static int scan_frame(bt_unwind_cursor_t* cursor,
+					  const bt_stackframe_t* frame_ptr,
+					  bt_uint32_t* fn_start_pc_ptr,
+					  bt_uint32_t* fn_start_sp_ptr,
+					  bt_uint32_t* fp_on_stack_ptr,
+					  bt_uint32_t* lr_on_stack_ptr,
+					  bt_uint32_t* trace_flags_ptr,
+					  bt_uint32_t* opcodes_ptr)
+{
+	int status = 0;
+	bt_uint32_t lr_addr = 0, fp_addr = 0;
+	bt_unwind_entry_t cached_entry;
+	const bt_unwind_entry_t* unwind_entry = find_unwind_entry(frame_ptr->pc);
+
+	if(unwind_entry)
+	{
+		status = apply_unwind_entry( cursor,
+									 unwind_entry,
+									 frame_ptr->pc,
+									 fn_start_sp_ptr,
+									 fp_on_stack_ptr,
+									 lr_on_stack_ptr,
+									 trace_flags_ptr);
+		*fn_start_pc_ptr = unwind_entry->fn_start;
+	}
+
+	if(!unwind_entry || (0 == status))
+	{   /*pc not covered by the unwind table, scan for the push
+		  unless a previous scan from this pc was cached*/
+		*fn_start_pc_ptr = frame_ptr->pc;
+		if(find_cached_frame(frame_ptr->pc, &cached_entry))
+		{
+			status = apply_unwind_entry( cursor,
+										 &cached_entry,
+										 frame_ptr->pc,
+										 fn_start_sp_ptr,
+										 fp_on_stack_ptr,
+										 lr_on_stack_ptr,
+										 trace_flags_ptr);
+		}
+		else
+		{
+			status = walk_to_fn_start( cursor,
+									   fn_start_pc_ptr,
+									   fn_start_sp_ptr,
+									   fp_on_stack_ptr,
+									   lr_on_stack_ptr,
+									   &lr_addr,
+									   &fp_addr,
+									   trace_flags_ptr);
+			/*walk_to_fn_start read every word from pc back to the push*/
+			*opcodes_ptr = ((frame_ptr->pc - *fn_start_pc_ptr) >> 2) + 1;
+			if(status > 0)
+			{
+				cache_frame(frame_ptr->pc, *fn_start_sp_ptr - frame_ptr->sp, *fn_start_sp_ptr,
+				            lr_addr, fp_addr, *trace_flags_ptr);
+			}
+		}
+	}
+	return status;
+}
+
+/* ARM EHABI unwinding.
+ * .ARM.exidx holds one pair of words per function, sorted by address:
+ * a prel31 offset to the function and either EXIDX_CANTUNWIND, up to
+ * three inline unwind opcodes, or a prel31 offset to the .ARM.extab entry
+ * holding the opcodes. The opcodes describe how to undo the prologue at
+ * any call site in the function body.*/
+#define EXIDX_CANTUNWIND    0x00000001
+#define EXIDX_INLINE        0x80000000
+#define EXIDX_PREL31(_addr) ((_addr) + (bt_uint32_t)(((int)(BT_READ_WORD(_addr) << 1)) >> 1))
+
+/*unwind opcodes that end the sequence*/
+#define EHABI_OP_FINISH     0xB0
+
+#ifndef BTRACE_HOST_BUILD
+/*provided by the standard ARM linker scripts, 0 if there is no index*/
+extern const bt_uint32_t __exidx_start[] __attribute__((weak));
+extern const bt_uint32_t __exidx_end[] __attribute__((weak));
+#endif
+
+static bt_uint32_t exidx_start = 0;
+static bt_uint32_t exidx_entries = 0;
+static int default_engine = BT_ENGINE_SCAN;
+
+int btrace_set_exidx(bt_uint32_t start, bt_uint32_t end)
+{
+	exidx_start = start;
+	exidx_entries = (end > start) ? ((end - start) >> 3) : 0;
+	return (int)exidx_entries;
+}
+
+int btrace_set_engine(int engine)
+{
+	int old_engine = default_engine;
+	default_engine = engine;
+	return old_engine;
+}
+
+int btrace_get_engine(void)
+{
+	return default_engine;
+}
+
+/*returns address of the index entry for the function containing pc, or 0*/
+static bt_uint32_t find_exidx_entry(bt_unwind_cursor_t* cursor, bt_uint32_t pc)
+{
+	bt_uint32_t found = 0;
+	int low = 0;
+	int high;
+
+	#ifndef BTRACE_HOST_BUILD
+	if(!exidx_entries && __exidx_start)
+	{
+		btrace_set_exidx((bt_uint32_t)(unsigned long)__exidx_start, (bt_uint32_t)(unsigned long)__exidx_end);
+	}
+	#endif
+
+	high = (int)exidx_entries - 1;
+	while(low <= high)
+	{
+		int mid = (low + high) >> 1;
+		bt_uint32_t entry = exidx_start + (mid << 3);
+
+		if(pc < EXIDX_PREL31(entry))
+		{
+			high = mid - 1;
+		}
+		else
+		{
+			found = entry;
+			low = mid + 1;
+		}
+	}
+	return found;
+}
+
+/*byte stream of unwind opcodes packed most significant byte first*/
+typedef struct EhabiOps {
+	bt_uint32_t word;       /* word being consumed                */
+	int         byte;       /* next byte of word, 3 = top, -1 = used up */
+	bt_uint32_t next;       /* address of the following word     */
+	int         words_left;
+	bt_unwind_cursor_t* cursor; /* reads go through its reader   */
+} ehabi_ops_t;
+
+static int next_ehabi_op(ehabi_ops_t* ops)
+{
+	bt_unwind_cursor_t* cursor = ops->cursor;
+
+	if(ops->byte < 0)
+	{
+		if(ops->words_left <= 0)
+		{
+			return EHABI_OP_FINISH;
+		}
+		ops->word = BT_READ_WORD(ops->next);
+		ops->next += 4;
+		--ops->words_left;
+		ops->byte = 3;
+	}
+	return (ops->word >> ((ops->byte--) << 3)) & 0xFF;
+}
+
+/*pops registers in mask (bit n = rn) from vsp*/
+static void ehabi_pop(bt_unwind_cursor_t* cursor, bt_uint32_t mask, bt_uint32_t* vsp_ptr, bt_uint32_t* regs, bt_uint32_t* valid_ptr)
+{
+	bt_uint32_t vsp = *vsp_ptr;
+	int regid;
+
+	for(regid = R00_ID; regid <= PC_ID; ++regid)
+	{
+		if(mask & (1 << regid))
+		{
+			regs[regid] = BT_READ_WORD(vsp);
+			vsp += 4;
+		}
+	}
+	*valid_ptr |= mask;
+	/*a popped SP replaces vsp*/
+	*vsp_ptr = (mask & OPCODE_SP_BIT) ? regs[SP_ID] : vsp;
+}
+
+/* Same outputs as walk_to_fn_start, computed from the EHABI index.
+ * Returns 0 if there is no entry for pc or the function cannot be
+ * unwound, < 0 if the opcodes cannot be interpreted.*/
+static int exidx_frame(bt_unwind_cursor_t* cursor,
+					   const bt_stackframe_t* frame_ptr,
+					   bt_uint32_t* fn_start_pc_ptr,
+					   bt_uint32_t* fn_start_sp_ptr,
+					   bt_uint32_t* fp_on_stack_ptr,
+					   bt_uint32_t* lr_on_stack_ptr,
+					   bt_uint32_t* trace_flags_ptr)
+{
+	bt_uint32_t regs[16];
+	bt_uint32_t valid = 0;
+	bt_uint32_t popped = 0;
+	bt_uint32_t vsp = frame_ptr->sp;
+	bt_uint32_t entry = find_exidx_entry(cursor, frame_ptr->pc & ~1);
+	bt_uint32_t value;
+	ehabi_ops_t ops;
+	int op;
+
+	if(!entry)
+	{
+		return 0;
+	}
+	*fn_start_pc_ptr = EXIDX_PREL31(entry);
+	value = BT_READ_WORD(entry + 4);
+	if(value == EXIDX_CANTUNWIND)
+	{
+		return 0;
+	}
+
+	ops.next = 0;
+	ops.words_left = 0;
+	ops.cursor = cursor;
+	if(value & EXIDX_INLINE)
+	{   /*personality 0 with up to 3 opcodes in the index itself*/
+		ops.word = value;
+		ops.byte = 2;
+	}
+	else
+	{
+		bt_uint32_t extab = EXIDX_PREL31(entry + 4);
+		ops.word = BT_READ_WORD(extab);
+		if(ops.word & EXIDX_INLINE)
+		{   /*compact model, personality index in bits 24-27*/
+			switch((ops.word >> 24) & 0xF)
+			{
+				case 0:
+					ops.byte = 2;
+					break;
+				case 1:
+				case 2:
+					ops.words_left = (ops.word >> 16) & 0xFF;
+					ops.byte = 1;
+					break;
+				default:
+					return -BT_STOP_BAD_EXIDX;
+			}
+			ops.next = extab + 4;
+		}
+		else
+		{   /*generic model, opcodes follow the personality routine*/
+			ops.word = BT_READ_WORD(extab + 4);
+			ops.words_left = ops.word >> 24;
+			ops.byte = 2;
+			ops.next = extab + 8;
+		}
+	}
+
+	regs[FP_ID] = frame_ptr->fp;
+	regs[SP_ID] = frame_ptr->sp;
+	regs[LR_ID] = frame_ptr->lr;
+	valid = OPCODE_FP_BIT | OPCODE_SP_BIT | OPCODE_LR_BIT;
+
+	while((op = next_ehabi_op(&ops)) != EHABI_OP_FINISH)
+	{
+		bt_uint32_t mask;
+
+		if((op & 0xC0) == 0x00)
+		{   /* vsp = vsp + (xxxxxx << 2) + 4 */
+			vsp += ((op & 0x3F) << 2) + 4;
+		}
+		else if((op & 0xC0) == 0x40)
+		{   /* vsp = vsp - (xxxxxx << 2) - 4 */
+			vsp -= ((op & 0x3F) << 2) + 4;
+		}
+		else if((op & 0xF0) == 0x80)
+		{   /* pop r4-r15 under mask, 0x8000 is refuse to unwind */
+			mask = (((op & 0xF) << 8) | next_ehabi_op(&ops)) << 4;
+			if(!mask)
+			{
+				return 0;
+			}
+			ehabi_pop(cursor, mask, &vsp, regs, &valid);
+			popped |= mask;
+		}
+		else if((op & 0xF0) == 0x90)
+		{   /* vsp = r[nnnn] */
+			int regid = op & 0xF;
+			if((regid == SP_ID) || (regid == PC_ID) || !(valid & (1 << regid)))
+			{
+				return -BT_STOP_BAD_EXIDX;
+			}
+			vsp = regs[regid];
+		}
+		else if((op & 0xF0) == 0xA0)
+		{   /* pop r4-r[4+nnn], and r14 if bit 3 is set */
+			mask = ((2 << (op & 7)) - 1) << 4;
+			if(op & 8)
+			{
+				mask |= OPCODE_LR_BIT;
+			}
+			ehabi_pop(cursor, mask, &vsp, regs, &valid);
+			popped |= mask;
+		}
+		else if(op == 0xB1)
+		{   /* pop r0-r3 under mask */
+			mask = next_ehabi_op(&ops);
+			if(!mask || (mask & 0xF0))
+			{
+				return -BT_STOP_BAD_EXIDX;
+			}
+			ehabi_pop(cursor, mask, &vsp, regs, &valid);
+		}
+		else if(op == 0xB2)
+		{   /* vsp = vsp + 0x204 + (uleb128 << 2) */
+			bt_uint32_t offset = 0;
+			int shift = 0;
+			int byte;
+			do
+			{
+				byte = next_ehabi_op(&ops);
+				offset |= (bt_uint32_t)(byte & 0x7F) << shift;
+				shift += 7;
+			} while((byte & 0x80) && (shift < 32));
+			vsp += 0x204 + (offset << 2);
+		}
+		else if(op == 0xB3)
+		{   /* pop d[ssss]-d[ssss+cccc] saved by FSTMFDX */
+			vsp += (((next_ehabi_op(&ops) & 0xF) + 1) << 3) + 4;
+		}
+		else if((op & 0xF8) == 0xB8)
+		{   /* pop d8-d[8+nnn] saved by FSTMFDX */
+			vsp += (((op & 7) + 1) << 3) + 4;
+		}
+		else if(((op & 0xF8) == 0xC0) && (op != 0xC6) && (op != 0xC7))
+		{   /* pop wR10-wR[10+nnn] */
+			vsp += ((op & 7) + 1) << 3;
+		}
+		else if((op == 0xC6) || (op == 0xC8) || (op == 0xC9))
+		{   /* pop wR[ssss]-wR[ssss+cccc], d[16+ssss].., d[ssss]-d[ssss+cccc] */
+			vsp += ((next_ehabi_op(&ops) & 0xF) + 1) << 3;
+		}
+		else if(op == 0xC7)
+		{   /* pop wCGR registers under mask */
+			mask = next_ehabi_op(&ops);
+			if(!mask || (mask & 0xF0))
+			{
+				return -BT_STOP_BAD_EXIDX;
+			}
+			vsp += num_registers(mask) << 2;
+		}
+		else if((op & 0xF8) == 0xD0)
+		{   /* pop d8-d[8+nnn] saved by VPUSH */
+			vsp += ((op & 7) + 1) << 3;
+		}
+		else
+		{   /*spare or reserved*/
+			return -BT_STOP_BAD_EXIDX;
+		}
+	}
+
+	*fn_start_sp_ptr = vsp;
+	if(popped & (OPCODE_PC_BIT | OPCODE_LR_BIT))
+	{   /*a popped PC is where the function returns to*/
+		*lr_on_stack_ptr = (popped & OPCODE_PC_BIT) ? regs[PC_ID] : regs[LR_ID];
+		*trace_flags_ptr |= LR_FOUND_ON_STACK;
+	}
+	if(popped & OPCODE_FP_BIT)
+	{
+		*fp_on_stack_ptr = regs[FP_ID];
+		*trace_flags_ptr |= OLD_FP_FOUND_ON_STACK;
+	}
+	return __LINE__;
+}
+
+/*saved LR and FP below the address held in FP*/
+#if BTRACE_APCS_FRAMES
+#define FP_LR_OFFSET 4  /* push {fp, ip, lr, pc}; sub fp, ip, #4 */
+#define FP_FP_OFFSET 12
+#else
+#define FP_LR_OFFSET 0  /* push {fp, lr}; add fp, sp, #4 */
+#define FP_FP_OFFSET 4
+#endif
+
+/* Same outputs as walk_to_fn_start, read from the frame FP points to.
+ * Returns 0 if the frame does not validate and must be scanned.*/
+static int fp_frame(bt_unwind_cursor_t* cursor,
+					const bt_stackframe_t* frame_ptr,
+					bt_uint32_t* fn_start_sp_ptr,
+					bt_uint32_t* fp_on_stack_ptr,
+					bt_uint32_t* lr_on_stack_ptr,
+					bt_uint32_t* trace_flags_ptr)
+{
+	bt_uint32_t fp = frame_ptr->fp;
+	bt_uint32_t saved_lr;
+	bt_uint32_t saved_fp;
+
+	/*the frame of this function lies above its SP*/
+	if((fp & 3) || (fp < frame_ptr->sp) || (fp - frame_ptr->sp >= BTRACE_FP_MAX_FRAME))
+	{
+		return 0;
+	}
+	saved_lr = BT_READ_WORD(fp - FP_LR_OFFSET);
+	saved_fp = BT_READ_WORD(fp - FP_FP_OFFSET);
+	if(MEM_READ_FAILED() || (saved_lr & 3) || (saved_lr < sizeof(bt_uint32_t)) ||
+	   (saved_fp && (saved_fp <= fp)))
+	{
+		return 0;
+	}
+
+	#if BTRACE_CHECK_ETEXT
+	if(saved_lr >= (bt_uint32_t)&_etext)
+	{
+		return 0;
+	}
+	#endif
+
+	if(!IS_CALL_SITE(BT_READ_WORD(saved_lr - sizeof(bt_uint32_t))) || MEM_READ_FAILED())
+	{   /*a return address follows the call*/
+		return 0;
+	}
+
+	*fn_start_sp_ptr = fp + sizeof(bt_uint32_t);
+	*lr_on_stack_ptr = saved_lr;
+	*fp_on_stack_ptr = saved_fp;
+	*trace_flags_ptr |= LR_FOUND_ON_STACK | OLD_FP_FOUND_ON_STACK;
+	return __LINE__;
 }
 
 extern bt_stackframe_t* Exception_Frame_Ptr;
 
-static int process_frame(int frameIndex, bt_stackframe_t* frame_ptr, TraceCallbackFnPtr trace_callback_fn )
+#if BTRACE_STATS
+/*histogram bucket of a frame that read opcodes words*/
+static int stats_bucket(bt_uint32_t opcodes)
+{
+	int bucket = 0;
+	while(opcodes && (bucket < BTRACE_STATS_BUCKETS - 1))
+	{
+		opcodes >>= 1;
+		++bucket;
+	}
+	return bucket;
+}
+#endif
+
+/* Finds where the function of cursor->frame was called from and keeps it
+ * in the cursor for step_to_caller. Returns >= 0 if the frame was
+ * analysed, or -BT_STOP_xxx on failure.*/
+static int analyse_frame(bt_unwind_cursor_t* cursor)
 {
 	 int status = -1;
-	 int trace_func_ret = 0;
+	 bt_stackframe_t* frame_ptr = &cursor->frame;
 
 	 #ifdef DEBUG_ON_QEMU
 	 char message[200];
 	 #endif
 
 	 /*pc read is always PC+8 on arm, so */
-	 bt_uint32_t* fn_start_pc_ptr = (bt_uint32_t *)(frame_ptr->pc);
+	 bt_uint32_t fn_start_pc = frame_ptr->pc;
 	 bt_uint32_t fn_start_sp = frame_ptr->sp;
 	 bt_uint32_t fp_on_stack = 0;
 	 bt_uint32_t lr_on_stack = 0;
 	 bt_uint32_t trace_flags = 0;
+	 bt_uint32_t opcodes = 0;
+
+	 MEM_READ_RESET();
+
+	 if(cursor->engine == BT_ENGINE_FP_SCAN)
+	 {   /*the first frame may be stopped in a prologue or a leaf function
+		   that has not set FP, so it is always scanned*/
+		 status = (cursor->index > 0) ? fp_frame( cursor,
+											      frame_ptr,
+											      &fn_start_sp,
+											      &fp_on_stack,
+											      &lr_on_stack,
+											      &trace_flags) : 0;
+		 #if BTRACE_STATS
+		 if(status > 0)
+		 {
+			 ++unwind_stats.fp_frames;
+		 }
+		 #endif
+		 if(status <= 0)
+		 {
+			 MEM_READ_RESET();
+			 status = scan_frame( cursor,
+					              frame_ptr,
+					              &fn_start_pc,
+					              &fn_start_sp,
+					              &fp_on_stack,
+					              &lr_on_stack,
+					              &trace_flags,
+					              &opcodes);
+		 }
+	 }
+	 else if(cursor->engine == BT_ENGINE_SCAN)
+	 {
+		 status = scan_frame( cursor,
+				              frame_ptr,
+				              &fn_start_pc,
+				              &fn_start_sp,
+				              &fp_on_stack,
+				              &lr_on_stack,
+				              &trace_flags,
+				              &opcodes);
+	 }
+	 else
+	 {
+		 status = exidx_frame( cursor,
+				               frame_ptr,
+				               &fn_start_pc,
+				               &fn_start_sp,
+				               &fp_on_stack,
+				               &lr_on_stack,
+				               &trace_flags);
+		 if((status <= 0) && (cursor->engine == BT_ENGINE_EXIDX_SCAN))
+		 {   /*no usable index entry, fall back to the scanner*/
+			 fn_start_pc = frame_ptr->pc;
+			 fn_start_sp = frame_ptr->sp;
+			 fp_on_stack = 0;
+			 lr_on_stack = 0;
+			 trace_flags = 0;
+			 MEM_READ_RESET();
+			 status = scan_frame( cursor,
+					              frame_ptr,
+					              &fn_start_pc,
+					              &fn_start_sp,
+					              &fp_on_stack,
+					              &lr_on_stack,
+					              &trace_flags,
+					              &opcodes);
+		 }
+		 else if(0 == status)
+		 {
+			 status = -BT_STOP_NO_EXIDX;
+		 }
+	 }
+
+	 if(MEM_READ_FAILED())
+	 {   /*stack or code of this frame is not available to the reader*/
+		 status = -BT_STOP_MEM_READ;
+	 }
 
-	 status = walk_to_fn_start( &fn_start_pc_ptr,
-			                    &fn_start_sp,
-			                    &fp_on_stack,
-			                    &lr_on_stack,
-			                    &trace_flags);
+	 #if BTRACE_STATS
+	 unwind_stats.opcodes += opcodes;
+	 ++unwind_stats.opcode_histogram[stats_bucket(opcodes)];
+	 #endif
 
 	 #ifdef DEBUG_ON_QEMU
 	 sprintf(message,"start_pc= %x, start_sp = %u, prev fp = %u, prev lr = %u, flags = %u \r\n",
-			          fn_start_pc_ptr, fn_start_sp, fp_on_stack, lr_on_stack, trace_flags);
+			          fn_start_pc, fn_start_sp, fp_on_stack, lr_on_stack, trace_flags);
 	 _write(2,message,strlen(message));
 	 #endif
 
 	 if(status >= 0)
 	 {
-		 if((trace_flags & FP_UPDATED_USING_SP) && frame_ptr->fp)
+		 if(BTRACE_FP_FRAMES && (trace_flags & FP_UPDATED_USING_SP) && frame_ptr->fp)
 		 {   /* A sanity check.If this function updated FP, then FP
 		        must point to SP pointing to first
 		        thing that was pushed on the stack by this function.
@@ -364,87 +1186,544 @@ static int process_frame(int frameIndex, bt_stackframe_t* frame_ptr, TraceCallba
 
 				/*fn_start_sp*/
 				fn_start_sp = (frame_ptr->fp + sizeof(bt_uint32_t));
+				#if BTRACE_STATS
+				++unwind_stats.fp_corrections;
+				#endif
 			 }
 		 }
+	 }
+
+	 cursor->caller_sp = fn_start_sp;
+	 cursor->fp_on_stack = fp_on_stack;
+	 cursor->lr_on_stack = lr_on_stack;
+	 cursor->flags = trace_flags;
+	 return status;
+}
+
+/* Moves the cursor to the call site in the caller of the analysed frame.
+ * Returns > 0, or END_OF_STACK if the caller is not known.*/
+static int step_to_caller(bt_unwind_cursor_t* cursor)
+{
+	 bt_stackframe_t* frame_ptr = &cursor->frame;
+
+	 /*update the frame pointer to that at call site for this function*/
+	 frame_ptr->sp = cursor->caller_sp;
+
+	 if(cursor->flags & OLD_FP_FOUND_ON_STACK)
+	 {	 /*leave frame_ptr->fp unmodified is this function did not update it*/
+		 frame_ptr->fp = cursor->fp_on_stack;
+	 }
+
+	 if(cursor->flags & LR_FOUND_ON_STACK)
+	 {   /*leave frame_ptr->lr unmodified is this function did not push it*/
+		 /*however if this function did push LR onto the stack then we must
+		   use that value as LR may have been changed by a branch from this function */
+		 frame_ptr->lr = cursor->lr_on_stack;
+
+		 if(0 == cursor->lr_on_stack)
+		 {	 /* if lr was pushed onto stack but it is zero,this is probably the
+		        thread entry function, so stop walking. */
+			 return END_OF_STACK;
+		 }
+	 }
+	 /*update stack frame for next iteration.*/
+	 frame_ptr->pc = (frame_ptr->lr - sizeof(bt_uint32_t));
+	 return 1;
+}
+
+void btrace_cursor_init(bt_unwind_cursor_t* cursor, const bt_stackframe_t* frame, int engine)
+{
+	 memset(cursor, 0, sizeof(*cursor));
+	 cursor->frame = *frame;
+	 cursor->engine = engine;
+	 cursor->index = -1;
+	 cursor->stop_reason = BT_CURSOR_RUNNING;
+}
 
-		 if(trace_callback_fn)
+int btrace_cursor_next(bt_unwind_cursor_t* cursor)
+{
+	 int status;
+
+	 if(cursor->stop_reason != BT_CURSOR_RUNNING)
+	 {
+		 return (cursor->stop_reason == BT_STOP_END_OF_STACK) ? 0 : -cursor->stop_reason;
+	 }
+	 if((cursor->index >= 0) && (step_to_caller(cursor) == END_OF_STACK))
+	 {
+		 cursor->stop_reason = BT_STOP_END_OF_STACK;
+		 return 0;
+	 }
+	 ++cursor->index;
+	 status = analyse_frame(cursor);
+	 if(status < 0)
+	 {
+		 cursor->stop_reason = -status;
+		 return status;
+	 }
+	 return 1;
+}
+
+int btrace_cursor_frame(const bt_unwind_cursor_t* cursor, bt_frame_record_t* record)
+{
+	 if(cursor->index < 0)
+	 {
+		 return -1;
+	 }
+	 record->pc = cursor->frame.pc;
+	 record->sp = cursor->frame.sp;
+	 record->lr = cursor->frame.lr;
+	 record->fp = cursor->frame.fp;
+	 record->caller_sp = cursor->caller_sp;
+	 record->index = (bt_uint16_t)cursor->index;
+	 record->flags = (bt_uint16_t)(BT_RECORD_VALID | (cursor->flags & (FP_UPDATED_USING_SP |
+	                                                                  LR_FOUND_ON_STACK |
+	                                                                  OLD_FP_FOUND_ON_STACK)));
+	 return 0;
+}
+
+int btrace_deliver_frame(int frameIndex, bt_unwind_ctx_t* ctx, const bt_unwind_cursor_t* cursor)
+{
+	 int trace_func_ret = 0;
+	 bt_stackframe_t* frame_ptr = &ctx->frame;
+	 bt_uint32_t fn_start_sp = cursor->caller_sp;
+
+	 /*callbacks reach the context through the frame*/
+	 *frame_ptr = cursor->frame;
+
+	 if(ctx->callback_fn)
+	 {
+		 /* invoke call back with frame and top of stack frame,
+		  * SP High passed to the trace function is first address used
+		  * by this function.hence the -4 */
+		 trace_func_ret = ctx->callback_fn( frameIndex, frame_ptr, fn_start_sp ?
+											BT_ADDR_TO_PTR(fn_start_sp - sizeof(bt_uint32_t)) : 0);
+	 }
+	 else if(ctx->records)
+	 {
+		 if(frameIndex < ctx->max_records)
 		 {
-			 /* invoke call back with frame and top of stack frame,
-			  * SP High passed to the trace function is first address used
-			  * by this function.hence the -4 */
-			 trace_func_ret = trace_callback_fn( frameIndex, frame_ptr,
-												 (bt_uint32_t*)(fn_start_sp - sizeof(bt_uint32_t)));
+			 bt_frame_record_t* record = &ctx->records[frameIndex];
+			 btrace_cursor_frame(cursor, record);
+			 ctx->num_records = frameIndex + 1;
+			 if(ctx->num_records < ctx->max_records)
+			 {   /*terminate records left over from a longer trace*/
+				 ctx->records[ctx->num_records].flags = 0;
+			 }
 		 }
-		 else if(trace_print_fn)
+		 else
+		 {
+			 trace_func_ret = STOP_BTRACE;
+		 }
+	 }
+	 else if(ctx->print_fn && ctx->print_buffer)
+	 {
+		 if(fn_start_sp)
 		 {
-			 sprintf(tempPrintBuffer,"#%02d: PC= %x, SP= %x, LR= %x, FP= %x, callerSP= %x\n", frameIndex,
+			 sprintf(ctx->print_buffer,"#%02d: PC= %x, SP= %x, LR= %x, FP= %x, callerSP= %x\n", frameIndex,
 					 frame_ptr->pc, frame_ptr->sp, frame_ptr->lr, frame_ptr->fp, fn_start_sp);
-			 trace_func_ret = trace_print_fn(tempPrintBuffer);
-
-			 /*for( tempSp = (bt_uint32_t*)(fn_start_sp - sizeof(bt_uint32_t));
-			      ((tempSp >= (bt_uint32_t*)(frame_ptr->sp)) && (trace_func_ret >= 0));
-			      tempSp -= sizeof(bt_uint32_t))
-			 {
-				 sprintf(tempPrintBuffer,"\t@%x: %x \n",tempSp,*tempSp);
-				 trace_func_ret = trace_print_fn(tempPrintBuffer);
-			 }*/
 		 }
-
-		 if(trace_func_ret == STOP_BTRACE)
-		 {	/*call back function requested a stop here*/
-			 return status;
+		 else
+		 {
+			 sprintf(ctx->print_buffer,"#%02d: PC= %x\n", frameIndex, frame_ptr->pc);
 		 }
+		 trace_func_ret = ctx->print_fn(ctx->print_buffer);
 
-		 /*update the frame pointer to that at call site for this function*/
-		 frame_ptr->sp = fn_start_sp;
+		 /*for( tempSp = (bt_uint32_t*)(fn_start_sp - sizeof(bt_uint32_t));
+		      ((tempSp >= (bt_uint32_t*)(frame_ptr->sp)) && (trace_func_ret >= 0));
+		      tempSp -= sizeof(bt_uint32_t))
+		 {
+			 sprintf(tempPrintBuffer,"\t@%x: %x \n",tempSp,*tempSp);
+			 trace_func_ret = trace_print_fn(tempPrintBuffer);
+		 }*/
+	 }
 
-		 if(trace_flags & OLD_FP_FOUND_ON_STACK)
-		 {	 /*leave frame_ptr->fp unmodified is this function did not update it*/
-			 frame_ptr->fp = fp_on_stack;
-		 }
+	 return trace_func_ret;
+}
 
-		 if(trace_flags & LR_FOUND_ON_STACK)
-		 {   /*leave frame_ptr->lr unmodified is this function did not push it*/
-			 /*however if this function did push LR onto the stack then we must
-			   use that value as LR may have been changed by a branch from this function */
-			 frame_ptr->lr = lr_on_stack;
+/*BLX <Rm>, the only 16 bit thumb call*/
+#define IS_THUMB_BLX_REG(_half)  (((_half) & 0xFF87) == 0x4780)
 
-			 if(0 == lr_on_stack)
-			 {	 /* if lr was pushed onto stack but it is zero,this is probably the
-			        thread entry function, so stop walking. */
-				 return END_OF_STACK;
-			 }
-		 }
-		 /*update stack frame for next iteration.*/
-		 frame_ptr->pc = (frame_ptr->lr - sizeof(bt_uint32_t));
+bt_uint32_t btrace_call_site(const bt_mem_reader_t* reader, bt_uint32_t returnAddr)
+{
+	 bt_unwind_cursor_t cursor_data;
+	 bt_unwind_cursor_t* cursor = &cursor_data;
+	 bt_uint32_t addr, word;
+
+	 if(!(returnAddr & 1))
+	 {
+		 return returnAddr - sizeof(bt_uint32_t);
+	 }
+	 /*the halfword before the return address, from the word holding it*/
+	 addr = (returnAddr & ~1) - sizeof(bt_uint16_t);
+	 cursor->reader = reader;
+	 cursor->read_errors = 0;
+	 word = BT_READ_WORD(addr & ~3);
+	 if(!MEM_READ_FAILED() && IS_THUMB_BLX_REG((addr & 2) ? (word >> 16) : (word & 0xFFFF)))
+	 {
+		 return addr;
 	 }
-return status;
+	 return (returnAddr & ~1) - sizeof(bt_uint32_t);
 }
 
-int btrace_callstack(TraceCallbackFnPtr callback_fn, int maxFrames)
+void btrace_init_context(bt_unwind_ctx_t* ctx)
 {
+	memset(ctx, 0, sizeof(*ctx));
+}
+
+int btrace_unwind(bt_unwind_ctx_t* ctx)
+{
+	 bt_unwind_cursor_t cursor;
 	 int frameCount = 0;
+
+	 if(!ctx->records)
+	 {
+		 ctx->max_records = 0;
+	 }
+	 ctx->num_records = 0;
+	 if(!ctx->callback_fn && (ctx->max_records > 0))
+	 {   /*records of a previous trace are no longer valid*/
+		 ctx->records[0].flags = 0;
+	 }
+
 	 /* iterate through each stack frame, till we hit an error or
-	  * maxFrames is reached */
-	 while(frameCount < maxFrames)
+	  * max_frames is reached */
+	 btrace_cursor_init(&cursor, &ctx->frame, ctx->engine);
+	 cursor.reader = ctx->reader;
+	 ctx->stop_reason = BT_STOP_MAX_FRAMES;
+	 while(frameCount < ctx->max_frames)
 	 {
-		 if(0 < process_frame(frameCount,get_frame_ptr(),callback_fn))
+		 if(btrace_cursor_next(&cursor) <= 0)
 		 {
-			++frameCount;
+			 ctx->stop_reason = cursor.stop_reason;
+			 break;
 		 }
-		 else
-		 {
+		 ++frameCount;
+		 if(btrace_deliver_frame(cursor.index, ctx, &cursor) == STOP_BTRACE)
+		 {   /*the frame was delivered before the sink asked to stop*/
+			 ctx->stop_reason = BT_STOP_CALLBACK;
 			 break;
 		 }
 	 }
+	 if((ctx->stop_reason == BT_STOP_MAX_FRAMES) && (cursor.index >= 0) &&
+	    (step_to_caller(&cursor) == END_OF_STACK))
+	 {   /*leave the frame at the caller, where another unwind would resume*/
+		 ctx->stop_reason = BT_STOP_END_OF_STACK;
+	 }
+	 ctx->frame = cursor.frame;
+
+	 #if BTRACE_STATS
+	 ++unwind_stats.traces;
+	 unwind_stats.frames += frameCount;
+	 if(ctx->stop_reason < BT_STOP_NUM_REASONS)
+	 {
+		 ++unwind_stats.stop_reasons[ctx->stop_reason];
+	 }
+	 #endif
+	 return frameCount;
+}
+
+/*runs btrace_unwind on a context made of the global sinks*/
+int btrace_callstack_frame(bt_stackframe_t* frame_ptr, TraceCallbackFnPtr callback_fn, int maxFrames)
+{
+	 bt_unwind_ctx_t ctx;
+	 int frameCount;
+
+	 btrace_init_context(&ctx);
+	 ctx.frame = *frame_ptr;
+	 ctx.max_frames = maxFrames;
+	 ctx.callback_fn = callback_fn;
+	 ctx.records = frame_records;
+	 ctx.max_records = max_frame_records;
+	 ctx.print_fn = trace_print_fn;
+	 ctx.print_buffer = tempPrintBuffer;
+	 ctx.engine = default_engine;
+
+	 frameCount = btrace_unwind(&ctx);
+
+	 *frame_ptr = ctx.frame;
+	 last_stop_reason = ctx.stop_reason;
+	 if(!callback_fn && frame_records)
+	 {
+		 num_frame_records = ctx.num_records;
+	 }
 	 return frameCount;
 }
 
+int btrace_callstack(TraceCallbackFnPtr callback_fn, int maxFrames)
+{
+	return btrace_callstack_frame(get_frame_ptr(), callback_fn, maxFrames);
+}
+
+int btrace_last_stop_reason(void)
+{
+	return last_stop_reason;
+}
+
+int btrace_cpu_stop_reason(int cpu)
+{
+	#if (BTRACE_NUM_CPUS > 1)
+	return ((cpu >= 0) && (cpu < BTRACE_NUM_CPUS)) ? cpu_ctx[cpu].stop_reason : BT_STOP_MAX_FRAMES;
+	#else
+	return cpu ? BT_STOP_MAX_FRAMES : last_stop_reason;
+	#endif
+}
+
+const char* btrace_stop_reason_name(int reason)
+{
+	static const char* const names[BT_STOP_NUM_REASONS] = {
+		"max frames", "stopped by sink", "end of stack", "SP from register",
+		"passed _etext", "memory not readable", "no exidx entry", "bad exidx opcodes"
+	};
+	return ((reason >= 0) && (reason < BT_STOP_NUM_REASONS)) ? names[reason] : "unknown";
+}
+
+int btrace_unwind_stats(bt_unwind_stats_t* stats)
+{
+	#if BTRACE_STATS
+	if(stats)
+	{
+		*stats = unwind_stats;
+	}
+	#else
+	if(stats)
+	{
+		memset(stats, 0, sizeof(*stats));
+	}
+	#endif
+	return BTRACE_STATS;
+}
+
+void btrace_unwind_stats_reset(void)
+{
+	#if BTRACE_STATS
+	memset(&unwind_stats, 0, sizeof(unwind_stats));
+	#endif
+}
+
+
+#ifndef BTRACE_HOST_BUILD
+void btrace_set_snapshot_buffer(bt_snapshot_t* buffer, int bufferBytes, bt_uint32_t stackLimit)
+{
+	snapshot_buffer = 0;
+	BT_MEMORY_BARRIER();
+	snapshot_bytes = bufferBytes;
+	snapshot_stack_limit = stackLimit;
+	BT_MEMORY_BARRIER();
+	snapshot_buffer = (bufferBytes >= (int)sizeof(bt_snapshot_t)) ? buffer : 0;
+}
+
+int btrace_snapshot_frame(bt_snapshot_t* snapshot, int bufferBytes, const bt_stackframe_t* frame, bt_uint32_t stackLimit)
+{
+	bt_uint32_t* words = (bt_uint32_t*)(snapshot + 1);
+	const bt_uint32_t* stack = BT_ADDR_TO_PTR(frame->sp & ~3);
+	bt_uint32_t num_words, i;
+
+	if(bufferBytes < (int)sizeof(bt_snapshot_t))
+	{
+		return -1;
+	}
+	/*invalid until completely written*/
+	snapshot->magic = 0;
+	BT_MEMORY_BARRIER();
+
+	num_words = (bufferBytes - sizeof(bt_snapshot_t)) >> 2;
+	if(stackLimit)
+	{
+		bt_uint32_t window = (stackLimit > frame->sp) ? ((stackLimit - (frame->sp & ~3)) >> 2) : 0;
+		if(window < num_words)
+		{
+			num_words = window;
+		}
+	}
+	for(i = 0; i < num_words; ++i)
+	{
+		words[i] = stack[i];
+	}
+	snapshot->frame = *frame;
+	snapshot->stack_base = frame->sp & ~3;
+	snapshot->num_words = num_words;
+	BT_MEMORY_BARRIER();
+	snapshot->magic = BT_SNAPSHOT_MAGIC;
+	return (int)num_words;
+}
+#endif
+
+#ifdef BTRACE_MEM_READER
+/* Reader of btrace_unwind_snapshot, lives on its stack: stack words come
+ * from the snapshot, everything else from next.*/
+typedef struct SnapshotReader {
+	const bt_snapshot_t*   snapshot;
+	const bt_mem_reader_t* next;
+} snapshot_reader_t;
+
+static int read_snapshot_word(void* ctx, bt_uint32_t addr, bt_uint32_t* value)
+{
+	const snapshot_reader_t* snapshot_reader = (const snapshot_reader_t*)ctx;
+	const bt_snapshot_t* snapshot = snapshot_reader->snapshot;
+	const bt_uint32_t* words = (const bt_uint32_t*)(snapshot + 1);
+	bt_uint32_t offset = addr - snapshot->stack_base;
+
+	if((addr >= snapshot->stack_base) && ((offset >> 2) < snapshot->num_words))
+	{
+		*value = words[offset >> 2];
+		return 0;
+	}
+	if(snapshot_reader->next->read_word)
+	{
+		return snapshot_reader->next->read_word(snapshot_reader->next->ctx, addr, value);
+	}
+	#ifndef BTRACE_HOST_BUILD
+	*value = *BT_ADDR_TO_PTR(addr);
+	return 0;
+	#else
+	return -1;
+	#endif
+}
+
+int btrace_unwind_snapshot(const bt_snapshot_t* snapshot, bt_unwind_ctx_t* ctx)
+{
+	snapshot_reader_t snapshot_reader;
+	bt_mem_reader_t reader;
+	const bt_mem_reader_t* ctx_reader = ctx->reader;
+	int frameCount;
+
+	if(snapshot->magic != BT_SNAPSHOT_MAGIC)
+	{
+		return -1;
+	}
+	/*chain to the reader of ctx, the global one is left alone*/
+	snapshot_reader.snapshot = snapshot;
+	snapshot_reader.next = ctx_reader ? ctx_reader : &mem_reader;
+	reader.read_word = read_snapshot_word;
+	reader.ctx = &snapshot_reader;
+
+	ctx->frame = snapshot->frame;
+	ctx->reader = &reader;
+	frameCount = btrace_unwind(ctx);
+	ctx->reader = ctx_reader;
+	return frameCount;
+}
+#endif
+
+ExceptionFnPtr btrace_set_exception_fn(ExceptionFnPtr exceptionFn)
+{
+	ExceptionFnPtr old_fn = exception_fn;
+	exception_fn = exceptionFn;
+	return old_fn;
+}
 
 /*call btrace_callstack passing in Exception_Frame_Ptr*/
 void exceptionTraceCallstack(void)
 {
+	if(exception_fn)
+	{
+		exception_fn(0, get_frame_ptr());
+		return;
+	}
+	#ifndef BTRACE_HOST_BUILD
+	if(snapshot_buffer)
+	{   /*capture mode, leave the unwinding for later*/
+		btrace_snapshot_frame(snapshot_buffer, snapshot_bytes, get_frame_ptr(), snapshot_stack_limit);
+		return;
+	}
+	#endif
 	btrace_callstack(0,max_frames);
 }
 
+int btrace_capture_mode(bt_uint32_t spsr, bt_uint32_t cpsr)
+{
+	int mode = spsr & CPSR_MODE_MASK;
+
+	if(mode == CPSR_USR_MODE)
+	{   /*system mode shares the user registers and, unlike user mode, can switch back*/
+		mode = CPSR_SYS_MODE;
+	}
+	/*the SP and LR of the handler's own mode are already its own*/
+	return (mode == (int)(cpsr & CPSR_MODE_MASK)) ? -1 : mode;
+}
+
+#ifndef BTRACE_HOST_BUILD
+int btrace_trace_interrupted(bt_uint32_t pc)
+{
+	bt_stackframe_t frame;
+	int cpu = 0;
+	int mode = btrace_capture_interrupted(&frame, pc);
+
+	if(mode < 0)
+	{
+		return mode;
+	}
+	#if (BTRACE_NUM_CPUS > 1)
+	{   /*privileged here, unlike exceptionHandlerReturnHook*/
+		bt_uint32_t mpidr;
+		ARM_MPIDR_READ(mpidr);
+		cpu = BTRACE_CPU_INDEX(mpidr);
+	}
+	Exception_LR[cpu] = BT_ADDR_TO_PTR(pc);
+	#else
+	Exception_LR = BT_ADDR_TO_PTR(pc);
+	#endif
+
+	if(exception_fn)
+	{
+		exception_fn(cpu, &frame);
+	}
+	else if(snapshot_buffer)
+	{   /*same slice of the buffer as the hook uses for this core*/
+		int bytes = (snapshot_bytes / BTRACE_NUM_CPUS) & ~3;
+		btrace_snapshot_frame((bt_snapshot_t*)((bt_uint8_t*)snapshot_buffer + cpu * bytes),
+		                      bytes, &frame, snapshot_stack_limit);
+	}
+	else
+	{
+		btrace_callstack_frame(&frame, 0, max_frames);
+	}
+	return mode;
+}
+#endif
+
+#if (BTRACE_NUM_CPUS > 1)
+/* Called by exceptionHandlerReturnHook on the hook stack of core cpu.
+ * Cores trace in parallel, so each gets its own context, print buffer
+ * and slice of the record buffer. The context and print buffer are kept
+ * off the hook stack, and the context holds the outcome of the core's
+ * last trace. Returns cpu for the hook to restore the core's SP and
+ * return address.*/
+int exceptionTraceCallstackCpu(int cpu)
+{
+	bt_unwind_ctx_t* ctx = &cpu_ctx[cpu];
+	int slice = max_frame_records / BTRACE_NUM_CPUS;
+
+	if(exception_fn)
+	{
+		exception_fn(cpu, &Exception_CpuStackFrame[cpu]);
+		return cpu;
+	}
+	#ifndef BTRACE_HOST_BUILD
+	if(snapshot_buffer)
+	{   /*capture mode, each core writes its own slice of the buffer*/
+		int bytes = (snapshot_bytes / BTRACE_NUM_CPUS) & ~3;
+		btrace_snapshot_frame((bt_snapshot_t*)((bt_uint8_t*)snapshot_buffer + cpu * bytes),
+		                      bytes, &Exception_CpuStackFrame[cpu], snapshot_stack_limit);
+		return cpu;
+	}
+	#endif
+
+	btrace_init_context(ctx);
+	ctx->frame = Exception_CpuStackFrame[cpu];
+	ctx->max_frames = max_frames;
+	if(frame_records && slice)
+	{
+		ctx->records = &frame_records[cpu * slice];
+		ctx->max_records = slice;
+	}
+	ctx->print_fn = trace_print_fn;
+	ctx->print_buffer = cpu_print_buffer[cpu];
+	ctx->engine = default_engine;
+	btrace_unwind(ctx);
+	last_stop_reason = ctx->stop_reason;
+	return cpu;
+}
+#endif
+
 
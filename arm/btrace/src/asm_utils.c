@@ -23,7 +23,9 @@
  *
  */
 
+#include "arm_defs.h"
 #include "arm_btrace.h"
+#include "btrace_profiler.h"
 
 extern bt_stackframe_t* Exception_StackFrame_Ptr;
 extern void exceptionTraceCallstack(void) __attribute__ ((noinline));
@@ -53,6 +55,96 @@ extern void exceptionTraceCallstack(void) __attribute__ ((noinline));
  * http://www.ethernut.de/en/documents/arm-inline-asm.html
  * */
 
+#define BT_STR(_x)  #_x
+#define BT_XSTR(_x) BT_STR(_x)
+
+#if (BTRACE_NUM_CPUS > 1)
+
+/*one hook stack, captured frame and set of slots per core*/
+#define EXCEPTION_HOOK_STACK_BYTES ALIGN_8BYTES(BTRACE_HOOK_STACK_SIZE)
+__attribute__((used)) __attribute__((aligned(8))) bt_uint8_t Exception_Hook_Stack[BTRACE_NUM_CPUS][EXCEPTION_HOOK_STACK_BYTES];
+__attribute__((used)) bt_uint32_t* Exception_LR[BTRACE_NUM_CPUS];      /*LR seen by the exception handler*/
+__attribute__((used)) bt_uint32_t* Exception_Hook_LR[BTRACE_NUM_CPUS]; /*address to jump to after trace hook, default value is reset vector*/
+__attribute__((used)) bt_uint32_t* Exception_SP[BTRACE_NUM_CPUS];      /*ptr to original SP value at exception site*/
+extern bt_stackframe_t Exception_CpuStackFrame[BTRACE_NUM_CPUS];
+extern int exceptionTraceCallstackCpu(int cpu) __attribute__ ((noinline));
+
+void exceptionHandlerReturnHook(void)/*this is a naked function*/
+{
+	/* The hook starts with one BTRACE_HOOK_ENTRY_BYTES entry per core,
+	 * each sets r0 to its core index and branches to the common code.
+	 * The handler returns to the entry of the core it runs on (see
+	 * BTRACE_HOOK_ENTRY), so the hook never reads MPIDR: the interrupted
+	 * mode may be USR where MPIDR cannot be read.
+	 * <0> Jump to Label_HookFunctionStart which is start of code.
+	 * Before that we have a few labels that hold the
+	 * address of global variables and functions. The
+	 * labels in assembly can be considered as kind of
+	 * short range pointers (12 bit offset relative to PC)
+	 * to global variables that are usually 32 bit pointers
+	 * themselves.
+	 * <1> Use IP(r12) to initialize a bt_stackframe_t object
+	 * with current FP,SP,LR and exception LR to it.
+	 * This assumes bt_stacktrace_t has the layout
+	 * {FP,SP,LR,PC}; with FP at lowest address and PC
+	 * at highest address.
+	 * Note that PC in this frame is set to LR saved
+	 * at Exception_LR_Ptr by the abort handler.
+	 * <2> Jump to exceptionTraceCallstackCpu which
+	 * traces the frame of this core.
+	 * <3> On return restore the old stack and then
+	 * jump to address stored in Label_Exception_Hook_LR
+	 * by the abort handler.
+	 * r0 = core index selects the core's entries of each array; r0-r3 are
+	 * clobbered by the trace anyway. exceptionTraceCallstackCpu returns the
+	 * index so it need not be kept in a callee saved register the
+	 * exception site may still need.*/
+	__asm__ __volatile__ (
+			".set bt_hook_cpu, 0                   \n\t"\
+			".rept " BT_XSTR(BTRACE_NUM_CPUS) "    \n\t" /*entry of core bt_hook_cpu*/   \
+			"mov r0, #bt_hook_cpu                  \n\t"\
+			"b Label_HookFunctionStart             \n\t"\
+			".set bt_hook_cpu, bt_hook_cpu + 1     \n\t"\
+			".endr                                 \n\t"\
+			"Label_Exception_Hook_Stack:           \n\t"\
+			".long Exception_Hook_Stack            \n\t"\
+			"Label_Exception_CpuStackFrame:        \n\t"\
+			".long Exception_CpuStackFrame         \n\t"\
+			"Label_Exception_LR_Ptr:               \n\t"\
+			".long Exception_LR                    \n\t"\
+			"Label_Exception_SP_Ptr:               \n\t"\
+			".long Exception_SP                    \n\t"\
+			"Label_Exception_Hook_LR_Ptr:          \n\t"\
+			".long Exception_Hook_LR               \n\t"\
+			"Label_Exception_Hook_Stack_Bytes:     \n\t"\
+			".long " BT_XSTR(EXCEPTION_HOOK_STACK_BYTES) "\n\t"\
+			"Label_HookFunctionStart:              \n\t" /*start of code, r0 = core index*/ \
+			"ldr ip, Label_Exception_SP_Ptr        \n\t"\
+			"str sp, [ip, r0, lsl #2]              \n\t" /*Exception_SP[cpu]=SP*/          \
+			"ldr ip, Label_Exception_CpuStackFrame \n\t"\
+			"add ip, ip, r0, lsl #4                \n\t" /*IP=&Exception_CpuStackFrame[cpu]*/ \
+			"str fp, [ip]                          \n\t" /*frame.FP=FP*/                   \
+			"str sp, [ip,#4]                       \n\t" /*frame.SP=SP*/                   \
+			"str lr, [ip,#8]                       \n\t" /*frame.LR=LR*/                   \
+			"ldr lr, Label_Exception_LR_Ptr        \n\t"\
+			"ldr lr, [lr, r0, lsl #2]              \n\t"\
+			"str lr, [ip,#12]                      \n\t" /*frame.PC=Exception_LR[cpu]*/    \
+			"ldr r1, Label_Exception_Hook_Stack_Bytes\n\t"\
+			"add r2, r0, #1                        \n\t"\
+			"mul r3, r2, r1                        \n\t"\
+			"ldr r1, Label_Exception_Hook_Stack    \n\t"\
+			"add sp, r1, r3                        \n\t" /*SP = top of this core's hook stack*/ \
+			"bl exceptionTraceCallstackCpu         \n\t" /*r0 = exceptionTraceCallstackCpu(cpu)*/ \
+			"ldr sp, Label_Exception_SP_Ptr        \n\t"\
+			"ldr sp, [sp, r0, lsl #2]              \n\t" /*SP=Exception_SP[cpu]*/          \
+			"ldr ip, Label_Exception_Hook_LR_Ptr   \n\t"\
+			"ldr pc, [ip, r0, lsl #2]              \n\t" /*PC = Exception_Hook_LR[cpu]*/   \
+			"ldr pc, [pc, #-8]"                          /*unexpected!! loop forever PC=PC*/
+	);
+}
+
+#else
+
 __attribute__((used)) bt_uint8_t   Exception_Hook_Stack[ALIGN_4BYTES(BTRACE_HOOK_STACK_SIZE)];
 __attribute__((used)) bt_uint32_t* Exception_Hook_StackTop  = (bt_uint32_t*)&Exception_Hook_Stack[ALIGN_4BYTES(BTRACE_HOOK_STACK_SIZE)];
 __attribute__((used)) bt_uint32_t* Exception_LR          = 0; /*LR seen by the exception handler*/
@@ -114,5 +206,98 @@ void exceptionHandlerReturnHook(void)/*this is a naked function*/
 	);
 }
 
+#endif /*BTRACE_NUM_CPUS*/
+
 /*export a global function pointer for linking from assembly code*/
 void (*exceptionHandlerReturnHookPtr)(void) = exceptionHandlerReturnHook;
+
+/*the asm returns the mode in r0, there is no C return statement*/
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wreturn-type"
+int btrace_capture_interrupted(bt_stackframe_t* frame, bt_uint32_t pc)/*this is a naked function*/
+{
+	/* Option 1 above, for handlers that cannot return through a hook,
+	 * e.g. a watchdog FIQ that finds a task hung in a loop.
+	 * <1> btrace_capture_mode(SPSR, CPSR) picks the mode to read from, the
+	 * interrupted one or system mode for user mode, or -1 to give up. It
+	 * is a C function, r11 is callee saved so FP survives the call.
+	 * <2> Switch to the interrupted mode with IRQ and FIQ masked, copy its
+	 * FP, SP and LR into frame, and switch straight back.
+	 * r0-r3 are not banked so they survive the switch; ip and fp are
+	 * banked in FIQ mode, which is why fp is read in the other mode.
+	 * Returns the mode the registers were read from.*/
+	__asm__ __volatile__ (
+			"push {r0, r1, r4, lr}                 \n\t" /*r4 keeps SP 8 byte aligned*/ \
+			"mrs r0, spsr                          \n\t"\
+			"mrs r1, cpsr                          \n\t"\
+			"bl btrace_capture_mode                \n\t" /*btrace_capture_mode(SPSR, CPSR)*/ \
+			"mov r2, r0                            \n\t" /*r2 = mode to read from*/      \
+			"pop {r0, r1, r4, lr}                  \n\t"\
+			"cmp r2, #0                            \n\t"\
+			"mvnlt r0, #0                          \n\t" /*cannot capture, return -1*/  \
+			"movlt pc, lr                          \n\t"\
+			"mrs r3, cpsr                          \n\t" /*r3 = handler CPSR*/          \
+			"str r1, [r0,#12]                      \n\t" /*frame.PC=pc*/                \
+			"bic ip, r3, #" BT_XSTR(CPSR_MODE_MASK) "\n\t"\
+			"orr ip, ip, r2                        \n\t"\
+			"orr ip, ip, #" BT_XSTR(CPSR_IRQ_BIT) " \n\t"\
+			"orr ip, ip, #" BT_XSTR(CPSR_FIQ_BIT) " \n\t"\
+			"msr cpsr_c, ip                        \n\t" /*enter interrupted mode*/     \
+			"str fp, [r0]                          \n\t" /*frame.FP=FP*/                \
+			"str sp, [r0,#4]                       \n\t" /*frame.SP=SP*/                \
+			"str lr, [r0,#8]                       \n\t" /*frame.LR=LR*/                \
+			"msr cpsr_c, r3                        \n\t" /*back to the handler mode*/   \
+			"mov r0, r2                            \n\t"\
+			"mov pc, lr"
+	);
+}
+#pragma GCC diagnostic pop
+
+__attribute__((used)) bt_uint32_t* Profiler_Return_PC = 0; /*PC interrupted by the profiling timer*/
+
+void profilerReturnHook(void)/*this is a naked function*/
+{
+	/* Entered from the profiling timer interrupt handler in place of the
+	 * interrupted code, so it runs in the interrupted mode on the interrupted
+	 * stack, and must leave every register and the condition flags as it
+	 * found them.
+	 * <1> Reserve a word for the interrupted PC, then save the registers
+	 * btrace_profiler_sample may clobber (r0-r3, ip, lr) along with CPSR and
+	 * r4 which holds SP while the stack is 8 byte aligned for the call.
+	 * <2> Build a bt_stackframe_t {FP,SP,LR,PC} on the stack from FP, SP and
+	 * LR of the interrupted code and (*Profiler_Return_PC).
+	 * <3> Call btrace_profiler_sample(&frame).
+	 * <4> Restore the registers and flags and pop the interrupted PC.
+	 * The handler must not redirect an interrupt that hit this hook.*/
+	__asm__ __volatile__ (
+			"b Label_ProfilerHookStart             \n\t"\
+			"Label_Profiler_Return_PC:             \n\t"\
+			".long Profiler_Return_PC              \n\t"\
+			"Label_ProfilerHookStart:              \n\t" /*start of code*/                \
+			"sub sp, sp, #4                        \n\t" /*slot for interrupted PC*/       \
+			"stmdb sp!, {r0-r3, ip, lr}            \n\t"\
+			"mrs r0, cpsr                          \n\t"\
+			"stmdb sp!, {r0, r4}                   \n\t"\
+			"ldr r1, Label_Profiler_Return_PC      \n\t"\
+			"ldr r1, [r1]                          \n\t"\
+			"str r1, [sp, #32]                     \n\t" /*slot = (*Profiler_Return_PC)*/  \
+			"add r2, sp, #36                       \n\t" /*SP of interrupted code*/        \
+			"mov r4, sp                            \n\t"\
+			"bic sp, sp, #7                        \n\t"\
+			"sub sp, sp, #16                       \n\t" /*bt_stackframe_t frame*/         \
+			"str fp, [sp]                          \n\t" /*frame.FP=FP*/                   \
+			"str r2, [sp, #4]                      \n\t" /*frame.SP=SP*/                   \
+			"str lr, [sp, #8]                      \n\t" /*frame.LR=LR*/                   \
+			"str r1, [sp, #12]                     \n\t" /*frame.PC=(*Profiler_Return_PC)*/\
+			"mov r0, sp                            \n\t"\
+			"bl btrace_profiler_sample             \n\t" /*btrace_profiler_sample(&frame)*/\
+			"mov sp, r4                            \n\t"\
+			"ldmia sp!, {r0, r4}                   \n\t"\
+			"msr cpsr_f, r0                        \n\t" /*restore condition flags*/       \
+			"ldmia sp!, {r0-r3, ip, lr}            \n\t"\
+			"ldmia sp!, {pc}                       \n\t" /*resume interrupted code*/
+	);
+}
+
+/*export a global function pointer for linking from assembly code*/
+void (*profilerReturnHookPtr)(void) = profilerReturnHook;
@@ -0,0 +1,232 @@
+/*
+ * The MIT License
+ *
+ * Copyright (c) 2013 Rakesh D Nair
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "btrace_crash.h"
+
+#if (BTRACE_CRASH_SLOTS & (BTRACE_CRASH_SLOTS - 1))
+#error BTRACE_CRASH_SLOTS must be a power of 2
+#endif
+
+/*FNV-1a*/
+#define CRASH_HASH_SEED   0x811C9DC5
+#define CRASH_HASH_PRIME  0x01000193
+
+#define CRASH_SLOT(_sequence) ((_sequence) & (BTRACE_CRASH_SLOTS - 1))
+
+/*not zeroed at boot, holds the records of earlier runs*/
+#ifndef BTRACE_HOST_BUILD
+static bt_crash_record_t crash_ring[BTRACE_CRASH_SLOTS] __attribute__((section(BTRACE_CRASH_SECTION)));
+#else
+static bt_crash_record_t crash_ring[BTRACE_CRASH_SLOTS];
+#endif
+
+/*sequence of the next record, records [next - SLOTS, next) may be valid*/
+static bt_uint32_t crash_next_sequence = 0;
+
+static char crashPrintBuffer[80];
+
+static bt_uint32_t crash_checksum(const bt_crash_record_t* record)
+{
+	const bt_uint8_t* byte = (const bt_uint8_t*)&record->sequence;
+	const bt_uint8_t* end = (const bt_uint8_t*)(record + 1);
+	bt_uint32_t hash = CRASH_HASH_SEED;
+
+	while(byte < end)
+	{
+		hash = (hash ^ *byte++) * CRASH_HASH_PRIME;
+	}
+	return hash;
+}
+
+static int crash_valid(const bt_crash_record_t* record, bt_uint32_t sequence)
+{
+	return (record->magic == BT_CRASH_MAGIC) &&
+	       (record->sequence == sequence) &&
+	       (record->depth <= BTRACE_CRASH_MAX_DEPTH) &&
+	       (record->checksum == crash_checksum(record));
+}
+
+/*first sequence that can still be in the ring*/
+static bt_uint32_t crash_first_sequence(void)
+{
+	return (crash_next_sequence > BTRACE_CRASH_SLOTS) ? (crash_next_sequence - BTRACE_CRASH_SLOTS) : 0;
+}
+
+int btrace_crash_init(void)
+{
+	bt_uint32_t slot, first;
+	int found = 0;
+
+	crash_next_sequence = 0;
+	for(slot = 0; slot < BTRACE_CRASH_SLOTS; ++slot)
+	{
+		const bt_crash_record_t* record = &crash_ring[slot];
+		if((CRASH_SLOT(record->sequence) == slot) && crash_valid(record, record->sequence) &&
+		   (!found || (record->sequence >= crash_next_sequence)))
+		{
+			crash_next_sequence = record->sequence + 1;
+			found = 1;
+		}
+	}
+
+	/*drop what is torn, corrupt or older than the ring*/
+	first = crash_first_sequence();
+	found = 0;
+	for(slot = 0; slot < BTRACE_CRASH_SLOTS; ++slot)
+	{
+		bt_crash_record_t* record = &crash_ring[slot];
+		if((CRASH_SLOT(record->sequence) == slot) && (record->sequence >= first) &&
+		   (record->sequence < crash_next_sequence) && crash_valid(record, record->sequence))
+		{
+			++found;
+		}
+		else
+		{
+			memset(record, 0, sizeof(*record));
+		}
+	}
+	return found;
+}
+
+/*TraceCallbackFnPtr collecting the PCs into the record in ctx->user*/
+static int crash_callback(int frameIndex, bt_stackframe_t* pFrame, bt_uint32_t* sp_high)
+{
+	bt_unwind_ctx_t* ctx = (bt_unwind_ctx_t*)pFrame;
+	bt_crash_record_t* record = (bt_crash_record_t*)ctx->user;
+
+	if(!record || (frameIndex >= BTRACE_CRASH_MAX_DEPTH))
+	{
+		return STOP_BTRACE;
+	}
+	record->pcs[frameIndex] = pFrame->pc;
+	record->depth = frameIndex + 1;
+	return 0;
+}
+
+int btrace_crash_record(const bt_stackframe_t* frame, bt_uint32_t faultLr, int cpu)
+{
+	bt_unwind_ctx_t ctx;
+	bt_crash_record_t* record;
+	bt_uint32_t sequence;
+
+	#if (BTRACE_NUM_CPUS > 1)
+	sequence = __sync_fetch_and_add(&crash_next_sequence, 1);
+	#else
+	sequence = crash_next_sequence++;
+	#endif
+	record = &crash_ring[CRASH_SLOT(sequence)];
+
+	/*invalid until completely written*/
+	record->magic = 0;
+	BT_MEMORY_BARRIER();
+	memset(&record->checksum, 0, sizeof(*record) - sizeof(record->magic));
+	record->sequence = sequence;
+	record->cpu = cpu;
+	record->fault_lr = faultLr;
+	record->frame = *frame;
+
+	btrace_init_context(&ctx);
+	ctx.frame = *frame;
+	ctx.max_frames = BTRACE_CRASH_MAX_DEPTH;
+	ctx.callback_fn = crash_callback;
+	ctx.user = record;
+	ctx.engine = btrace_get_engine();
+	btrace_unwind(&ctx);
+
+	record->stop_reason = ctx.stop_reason;
+	record->checksum = crash_checksum(record);
+	BT_MEMORY_BARRIER();
+	record->magic = BT_CRASH_MAGIC;
+	BTRACE_CRASH_FLUSH(record, sizeof(*record));
+	return (int)record->depth;
+}
+
+const bt_crash_record_t* btrace_crash_get(int index)
+{
+	bt_uint32_t sequence;
+
+	for(sequence = crash_first_sequence(); sequence < crash_next_sequence; ++sequence)
+	{
+		const bt_crash_record_t* record = &crash_ring[CRASH_SLOT(sequence)];
+		if(crash_valid(record, sequence) && (index-- == 0))
+		{
+			return record;
+		}
+	}
+	return 0;
+}
+
+int btrace_crash_count(void)
+{
+	int count = 0;
+
+	while(btrace_crash_get(count))
+	{
+		++count;
+	}
+	return count;
+}
+
+int btrace_crash_emit(TracePrintFnPtr print_fn)
+{
+	const bt_crash_record_t* record;
+	int printed = 0;
+
+	while((record = btrace_crash_get(printed)) != 0)
+	{
+		bt_uint32_t frame;
+
+		snprintf(crashPrintBuffer, sizeof crashPrintBuffer,
+		         "crash %d: cpu= %u, fault LR= %x, SP= %x, stop: %s\n", printed, record->cpu,
+		         record->fault_lr, record->frame.sp, btrace_stop_reason_name(record->stop_reason));
+		print_fn(crashPrintBuffer);
+		for(frame = 0; frame < record->depth; ++frame)
+		{
+			snprintf(crashPrintBuffer, sizeof crashPrintBuffer, "#%02u: PC= %x\n", frame, record->pcs[frame]);
+			print_fn(crashPrintBuffer);
+		}
+		++printed;
+	}
+	return printed;
+}
+
+void btrace_crash_clear(void)
+{
+	/*the sequence carries on so that records stay in order*/
+	memset(crash_ring, 0, sizeof(crash_ring));
+}
+
+#ifndef BTRACE_HOST_BUILD
+void btrace_crash_exception(int cpu, const bt_stackframe_t* frame)
+{
+	#if (BTRACE_NUM_CPUS > 1)
+	btrace_crash_record(frame, (bt_uint32_t)(unsigned long)Exception_LR[cpu], cpu);
+	#else
+	btrace_crash_record(frame, (bt_uint32_t)(unsigned long)Exception_LR, cpu);
+	#endif
+}
+#endif
@@ -0,0 +1,236 @@
+/*
+ * The MIT License
+ *
+ * Copyright (c) 2013 Rakesh D Nair
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#include <stdio.h>
+#include "btrace_dedup.h"
+
+#if (BTRACE_DEDUP_SLOTS & (BTRACE_DEDUP_SLOTS - 1))
+#error BTRACE_DEDUP_SLOTS must be a power of 2
+#endif
+
+/*FNV-1a*/
+#define DEDUP_HASH_SEED   0x811C9DC5
+#define DEDUP_HASH_PRIME  0x01000193
+
+typedef struct DedupEntry {
+	bt_uint32_t hash;
+	bt_uint32_t count;  /* 0 = unused */
+	bt_uint32_t depth;
+	bt_uint32_t pcs[BTRACE_DEDUP_MAX_DEPTH];
+} dedup_entry_t;
+
+static dedup_entry_t dedup_table[BTRACE_DEDUP_SLOTS];
+static bt_dedup_stats_t dedup_stats;
+
+/*trace being collected*/
+static bt_uint32_t pending_pcs[BTRACE_DEDUP_MAX_DEPTH];
+static bt_uint32_t pending_depth = 0;
+
+/*set while btrace_dedup_flush walks the table, commits are dropped*/
+static volatile int dedup_flushing = 0;
+
+static char dedupPrintBuffer[48];
+
+int btrace_dedup_callback(int frameIndex, bt_stackframe_t* pFrame, bt_uint32_t* sp_high)
+{
+	if(frameIndex == 0)
+	{
+		pending_depth = 0;
+	}
+	if((frameIndex < 0) || (frameIndex >= BTRACE_DEDUP_MAX_DEPTH))
+	{
+		return STOP_BTRACE;
+	}
+	pending_pcs[frameIndex] = pFrame->pc;
+	pending_depth = frameIndex + 1;
+	return (pending_depth < BTRACE_DEDUP_MAX_DEPTH) ? 0 : STOP_BTRACE;
+}
+
+static bt_uint32_t hash_stack(const bt_uint32_t* pcs, bt_uint32_t depth)
+{
+	bt_uint32_t hash = DEDUP_HASH_SEED;
+	bt_uint32_t frame;
+	for(frame = 0; frame < depth; ++frame)
+	{
+		bt_uint32_t pc = pcs[frame];
+		int byte;
+		for(byte = 0; byte < 4; ++byte)
+		{
+			hash = (hash ^ (pc & 0xFF)) * DEDUP_HASH_PRIME;
+			pc >>= 8;
+		}
+	}
+	return hash;
+}
+
+static int same_stack(const dedup_entry_t* entry, bt_uint32_t hash)
+{
+	bt_uint32_t frame;
+	if((entry->hash != hash) || (entry->depth != pending_depth))
+	{
+		return 0;
+	}
+	for(frame = 0; frame < pending_depth; ++frame)
+	{
+		if(entry->pcs[frame] != pending_pcs[frame])
+		{
+			return 0;
+		}
+	}
+	return 1;
+}
+
+bt_uint32_t btrace_dedup_commit(void)
+{
+	bt_uint32_t hash = hash_stack(pending_pcs, pending_depth);
+	bt_uint32_t probe;
+
+	++dedup_stats.events;
+	if(dedup_flushing)
+	{   /*interrupted a flush, the table is being emptied*/
+		++dedup_stats.busy;
+		pending_depth = 0;
+		return 0;
+	}
+	/*linear probing*/
+	for(probe = 0; probe < BTRACE_DEDUP_SLOTS; ++probe)
+	{
+		dedup_entry_t* entry = &dedup_table[(hash + probe) & (BTRACE_DEDUP_SLOTS - 1)];
+
+		if(!entry->count)
+		{
+			bt_uint32_t frame;
+			for(frame = 0; frame < pending_depth; ++frame)
+			{
+				entry->pcs[frame] = pending_pcs[frame];
+			}
+			entry->depth = pending_depth;
+			entry->hash = hash;
+			entry->count = 1;
+			++dedup_stats.unique;
+			pending_depth = 0;
+			return 1;
+		}
+		if(same_stack(entry, hash))
+		{
+			pending_depth = 0;
+			return ++entry->count;
+		}
+	}
+	++dedup_stats.overflow;
+	pending_depth = 0;
+	return 0;
+}
+
+bt_uint32_t btrace_dedup_callstack(int maxFrames)
+{
+	pending_depth = 0;
+	btrace_callstack(btrace_dedup_callback, maxFrames);
+	return btrace_dedup_commit();
+}
+
+/* Empties slot and moves later entries of its probe sequence back, so
+ * that every stack left in the table is still found from its hash.*/
+static void remove_entry(bt_uint32_t slot)
+{
+	bt_uint32_t hole = slot;
+	bt_uint32_t next = slot;
+
+	for(;;)
+	{
+		dedup_entry_t* entry;
+		bt_uint32_t home;
+
+		next = (next + 1) & (BTRACE_DEDUP_SLOTS - 1);
+		entry = &dedup_table[next];
+		if(!entry->count)
+		{
+			break;
+		}
+		home = entry->hash & (BTRACE_DEDUP_SLOTS - 1);
+		if(((next - home) & (BTRACE_DEDUP_SLOTS - 1)) >= ((next - hole) & (BTRACE_DEDUP_SLOTS - 1)))
+		{   /*the hole lies between the entry's home slot and the entry*/
+			dedup_table[hole] = *entry;
+			hole = next;
+		}
+	}
+	dedup_table[hole].count = 0;
+}
+
+/*prints one stack, returns 0 if print_fn stopped*/
+static int print_entry(TracePrintFnPtr print_fn, const dedup_entry_t* entry, int index)
+{
+	bt_uint32_t frame;
+
+	sprintf(dedupPrintBuffer, "[stack %d] count= %u\n", index, entry->count);
+	if(print_fn(dedupPrintBuffer) == STOP_BTRACE)
+	{
+		return 0;
+	}
+	for(frame = 0; frame < entry->depth; ++frame)
+	{
+		sprintf(dedupPrintBuffer, "#%02u: PC= %x\n", frame, entry->pcs[frame]);
+		if(print_fn(dedupPrintBuffer) == STOP_BTRACE)
+		{
+			return 0;
+		}
+	}
+	return 1;
+}
+
+int btrace_dedup_flush(TracePrintFnPtr print_fn)
+{
+	bt_uint32_t slot = 0;
+	int printed = 0;
+
+	dedup_flushing = 1;
+	BT_MEMORY_BARRIER();
+	while(slot < BTRACE_DEDUP_SLOTS)
+	{
+		dedup_entry_t* entry = &dedup_table[slot];
+
+		if(!entry->count)
+		{
+			++slot;
+			continue;
+		}
+		if(print_fn && !print_entry(print_fn, entry, printed))
+		{   /*keep this stack and the rest for the next flush*/
+			break;
+		}
+		/*an entry moved into slot is looked at next*/
+		remove_entry(slot);
+		--dedup_stats.unique;
+		++printed;
+	}
+	BT_MEMORY_BARRIER();
+	dedup_flushing = 0;
+	return printed;
+}
+
+void btrace_dedup_get_stats(bt_dedup_stats_t* stats)
+{
+	*stats = dedup_stats;
+}
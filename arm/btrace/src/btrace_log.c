@@ -0,0 +1,172 @@
+/*
+ * The MIT License
+ *
+ * Copyright (c) 2013 Rakesh D Nair
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#include "btrace_log.h"
+
+#if (BTRACE_LOG_SLOTS & (BTRACE_LOG_SLOTS - 1))
+#error BTRACE_LOG_SLOTS must be a power of 2
+#endif
+
+#define LOG_SLOT(_index) log_ring[(_index) & (BTRACE_LOG_SLOTS - 1)]
+#define LOG_SEQ(_index)  log_seq[(_index) & (BTRACE_LOG_SLOTS - 1)]
+
+/* The producer only writes log_head and the consumer only writes log_tail,
+ * both are free running counters. When overwriting, the producer writes into
+ * a full ring without waiting, so head - tail can exceed BTRACE_LOG_SLOTS and
+ * the slot the consumer is copying may be reused. The consumer skips the
+ * lines that were replaced. Each slot holds the counter of its line, and
+ * index + 1 while the line is written, so the consumer knows the copy is
+ * intact if the slot held its line before and after copying.*/
+static char log_ring[BTRACE_LOG_SLOTS][BTRACE_LOG_LINE_SIZE];
+static volatile bt_uint32_t log_seq[BTRACE_LOG_SLOTS];
+static volatile bt_uint32_t log_head = 0;
+static volatile bt_uint32_t log_tail = 0;
+
+static volatile int log_busy = 0;
+static int log_policy = BT_LOG_DROP_NEWEST;
+static bt_log_stats_t log_stats;
+
+static char logPrintBuffer[BTRACE_LOG_LINE_SIZE];
+
+void btrace_log_init(int policy)
+{
+	log_policy = policy;
+	log_head = 0;
+	log_tail = 0;
+	log_stats.written = 0;
+	log_stats.dropped = 0;
+	log_stats.overwritten = 0;
+	log_stats.nested = 0;
+	log_stats.truncated = 0;
+	log_stats.drained = 0;
+	log_stats.max_used = 0;
+}
+
+int btrace_log_write(char* message)
+{
+	bt_uint32_t head = log_head;
+	bt_uint32_t used = head - log_tail;
+	char* slot;
+	int length;
+
+	if(log_busy)
+	{   /*interrupted another write*/
+		++log_stats.nested;
+		return 0;
+	}
+	log_busy = 1;
+
+	if(used >= BTRACE_LOG_SLOTS)
+	{
+		if(log_policy == BT_LOG_DROP_NEWEST)
+		{
+			++log_stats.dropped;
+			log_busy = 0;
+			return STOP_BTRACE;
+		}
+		used = BTRACE_LOG_SLOTS - 1;
+	}
+
+	/*invalidate the slot for a consumer copying the line it held*/
+	LOG_SEQ(head) = head + 1;
+	BT_MEMORY_BARRIER();
+	slot = LOG_SLOT(head);
+	for(length = 0; message[length] && (length < BTRACE_LOG_LINE_SIZE - 1); ++length)
+	{
+		slot[length] = message[length];
+	}
+	slot[length] = 0;
+	if(message[length])
+	{
+		++log_stats.truncated;
+	}
+
+	/*publish the line only after it is complete*/
+	BT_MEMORY_BARRIER();
+	LOG_SEQ(head) = head;
+	log_head = head + 1;
+
+	++log_stats.written;
+	if(used + 1 > log_stats.max_used)
+	{
+		log_stats.max_used = used + 1;
+	}
+	log_busy = 0;
+	return 0;
+}
+
+int btrace_log_drain(TracePrintFnPtr print_fn, int maxLines)
+{
+	int count = 0;
+
+	while(count < maxLines)
+	{
+		bt_uint32_t head = log_head;
+		bt_uint32_t tail = log_tail;
+		bt_uint32_t seq;
+		int length;
+
+		if(tail == head)
+		{
+			break;
+		}
+		if(head - tail > BTRACE_LOG_SLOTS)
+		{   /*the producer went round and replaced the oldest lines*/
+			log_stats.overwritten += head - tail - BTRACE_LOG_SLOTS;
+			tail = head - BTRACE_LOG_SLOTS;
+		}
+
+		BT_MEMORY_BARRIER();
+		seq = LOG_SEQ(tail);
+		BT_MEMORY_BARRIER();
+		for(length = 0; length < BTRACE_LOG_LINE_SIZE; ++length)
+		{
+			logPrintBuffer[length] = LOG_SLOT(tail)[length];
+		}
+		logPrintBuffer[BTRACE_LOG_LINE_SIZE - 1] = 0;
+		BT_MEMORY_BARRIER();
+
+		/*release the slot before printing so that writing can go on*/
+		log_tail = tail + 1;
+		if((seq != tail) || (LOG_SEQ(tail) != tail))
+		{   /*slot was reused before or while it was copied*/
+			++log_stats.overwritten;
+			continue;
+		}
+
+		++log_stats.drained;
+		++count;
+		if(print_fn && (print_fn(logPrintBuffer) == STOP_BTRACE))
+		{
+			break;
+		}
+	}
+	return count;
+}
+
+void btrace_log_get_stats(bt_log_stats_t* stats)
+{
+	*stats = log_stats;
+}
@@ -0,0 +1,246 @@
+/*
+ * The MIT License
+ *
+ * Copyright (c) 2013 Rakesh D Nair
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "btrace_profiler.h"
+
+#if (BTRACE_PROFILER_SLOTS & (BTRACE_PROFILER_SLOTS - 1))
+#error BTRACE_PROFILER_SLOTS must be a power of 2
+#endif
+
+typedef struct ProfilerSample {
+	bt_uint32_t depth;
+	bt_uint32_t pcs[BTRACE_PROFILER_MAX_DEPTH]; /* innermost frame first */
+} profiler_sample_t;
+
+/* Single producer (the timer interrupt) and single consumer (the drain
+ * task). The producer only writes ring_head and the consumer only writes
+ * ring_tail, so no lock is needed. Both are free running counters.*/
+static profiler_sample_t sample_ring[BTRACE_PROFILER_SLOTS];
+static volatile bt_uint32_t ring_head = 0;
+static volatile bt_uint32_t ring_tail = 0;
+
+static volatile int profiler_enabled = 0;
+static volatile int profiler_busy = 0;
+static BtCycleCountFnPtr cycle_count_fn = 0;
+static bt_profiler_stats_t profiler_stats;
+
+/* Samples taken from the ring by btrace_profiler_drain, identical stacks
+ * merged into one entry with a count. Entries [0, merge_printed) have been
+ * printed, the rest are printed first by the next drain if print_fn
+ * stopped it.*/
+typedef struct MergedSample {
+	profiler_sample_t sample;
+	bt_uint32_t       count;
+} merged_sample_t;
+
+static merged_sample_t merge_table[BTRACE_PROFILER_MERGE];
+static int merge_count = 0;
+static int merge_printed = 0;
+
+static char profilerPrintBuffer[16 + 11 * BTRACE_PROFILER_MAX_DEPTH];
+
+void btrace_profiler_init(BtCycleCountFnPtr cycle_fn)
+{
+	profiler_enabled = 0;
+	cycle_count_fn = cycle_fn;
+	ring_head = 0;
+	ring_tail = 0;
+	merge_count = 0;
+	merge_printed = 0;
+	profiler_stats.samples = 0;
+	profiler_stats.dropped = 0;
+	profiler_stats.nested = 0;
+	profiler_stats.drained = 0;
+	profiler_stats.last_cycles = 0;
+	profiler_stats.max_cycles = 0;
+	profiler_stats.total_cycles = 0;
+}
+
+void btrace_profiler_start(void)
+{
+	profiler_enabled = 1;
+}
+
+void btrace_profiler_stop(void)
+{
+	profiler_enabled = 0;
+}
+
+/*TraceCallbackFnPtr that records the PC of each frame in the sample in ctx->user*/
+static int record_frame(int frameIndex, bt_stackframe_t* pFrame, bt_uint32_t* sp_high)
+{
+	bt_unwind_ctx_t* ctx = (bt_unwind_ctx_t*)pFrame;
+	profiler_sample_t* sample = (profiler_sample_t*)ctx->user;
+
+	sample->pcs[frameIndex] = pFrame->pc;
+	sample->depth = frameIndex + 1;
+	return (frameIndex + 1 < BTRACE_PROFILER_MAX_DEPTH) ? 0 : STOP_BTRACE;
+}
+
+void btrace_profiler_sample(const bt_stackframe_t* frame)
+{
+	bt_unwind_ctx_t ctx;
+	bt_uint32_t start_cycles = 0;
+
+	if(!profiler_enabled)
+	{
+		return;
+	}
+	if(profiler_busy)
+	{   /*the sampling interrupt fired while a sample was being taken*/
+		++profiler_stats.nested;
+		return;
+	}
+	profiler_busy = 1;
+
+	if(cycle_count_fn)
+	{
+		start_cycles = cycle_count_fn();
+	}
+
+	if((ring_head - ring_tail) >= BTRACE_PROFILER_SLOTS)
+	{
+		++profiler_stats.dropped;
+	}
+	else
+	{
+		profiler_sample_t* sample = &sample_ring[ring_head & (BTRACE_PROFILER_SLOTS - 1)];
+		sample->depth = 0;
+
+		/*a context of its own leaves a trace in progress untouched*/
+		btrace_init_context(&ctx);
+		ctx.frame = *frame;
+		ctx.max_frames = BTRACE_PROFILER_MAX_DEPTH;
+		ctx.callback_fn = record_frame;
+		ctx.user = sample;
+		ctx.engine = btrace_get_engine();
+		btrace_unwind(&ctx);
+		if(!sample->depth)
+		{   /*could not unwind at all, keep the PC*/
+			sample->pcs[0] = frame->pc;
+			sample->depth = 1;
+		}
+		/*publish the sample only after it is complete*/
+		BT_MEMORY_BARRIER();
+		ring_head = ring_head + 1;
+		++profiler_stats.samples;
+	}
+
+	if(cycle_count_fn)
+	{
+		bt_uint32_t cycles = cycle_count_fn() - start_cycles;
+		profiler_stats.last_cycles = cycles;
+		profiler_stats.total_cycles += cycles;
+		if(cycles > profiler_stats.max_cycles)
+		{
+			profiler_stats.max_cycles = cycles;
+		}
+	}
+	profiler_busy = 0;
+}
+
+/*counts sample in the merge table, returns 0 if the table is full*/
+static int merge_sample(const profiler_sample_t* sample)
+{
+	int i;
+
+	for(i = 0; i < merge_count; ++i)
+	{
+		if((merge_table[i].sample.depth == sample->depth) &&
+		   !memcmp(merge_table[i].sample.pcs, sample->pcs, sample->depth * sizeof(bt_uint32_t)))
+		{
+			++merge_table[i].count;
+			return 1;
+		}
+	}
+	if(merge_count == BTRACE_PROFILER_MERGE)
+	{
+		return 0;
+	}
+	merge_table[merge_count].sample = *sample;
+	merge_table[merge_count].count = 1;
+	++merge_count;
+	return 1;
+}
+
+/*prints the merged stacks not printed yet, returns 0 if print_fn stopped*/
+static int print_merged(TracePrintFnPtr print_fn)
+{
+	while(merge_printed < merge_count)
+	{
+		const merged_sample_t* merged = &merge_table[merge_printed++];
+		char* out = profilerPrintBuffer;
+		int frame;
+
+		for(frame = merged->sample.depth - 1; frame >= 0; --frame)
+		{
+			out += sprintf(out, (frame > 0) ? "%x;" : "%x", merged->sample.pcs[frame]);
+		}
+		sprintf(out, " %u\n", merged->count);
+
+		if(print_fn && (print_fn(profilerPrintBuffer) == STOP_BTRACE))
+		{
+			return 0;
+		}
+	}
+	merge_count = 0;
+	merge_printed = 0;
+	return 1;
+}
+
+int btrace_profiler_drain(TracePrintFnPtr print_fn, int maxSamples)
+{
+	int count = 0;
+
+	do
+	{
+		if(!print_merged(print_fn))
+		{
+			break;
+		}
+		while((count < maxSamples) && (ring_tail != ring_head))
+		{
+			BT_MEMORY_BARRIER();
+			if(!merge_sample(&sample_ring[ring_tail & (BTRACE_PROFILER_SLOTS - 1)]))
+			{
+				break;
+			}
+			/*release the slot before printing so that sampling can go on*/
+			BT_MEMORY_BARRIER();
+			ring_tail = ring_tail + 1;
+			++profiler_stats.drained;
+			++count;
+		}
+	} while(merge_count);
+
+	return count;
+}
+
+void btrace_profiler_get_stats(bt_profiler_stats_t* stats)
+{
+	*stats = profiler_stats;
+}
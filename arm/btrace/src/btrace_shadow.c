@@ -0,0 +1,212 @@
+/*
+ * The MIT License
+ *
+ * Copyright (c) 2013 Rakesh D Nair
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#include <string.h>
+
+#include "btrace_shadow.h"
+
+/* The hooks run on every instrumented call, so they do no more than an
+ * index check and a store. This file must not be built with
+ * -finstrument-functions, the no_instrument_function attributes below
+ * only cover the hooks.*/
+
+#if (BTRACE_SHADOW_DEPTH < 1)
+#error "BTRACE_SHADOW_DEPTH must be at least 1"
+#endif
+
+#if (BTRACE_NUM_CPUS > 1) && !defined(BTRACE_HOST_BUILD)
+#define SHADOW_CPUS BTRACE_NUM_CPUS
+#else
+#define SHADOW_CPUS 1
+#endif
+
+static bt_shadow_stack_t shadow_default[SHADOW_CPUS];
+static bt_shadow_stack_t* shadow_current[SHADOW_CPUS];
+static char shadowPrintBuffer[BTRACE_PRINT_BUFFER_SIZE];
+
+static inline int shadow_cpu(void) __attribute__ ((no_instrument_function, always_inline));
+static inline int shadow_cpu(void)
+{
+#if (SHADOW_CPUS > 1) && BTRACE_SHADOW_MPIDR
+	bt_uint32_t mpidr;
+	ARM_MPIDR_READ(mpidr);
+	return BTRACE_CPU_INDEX(mpidr);
+#elif (SHADOW_CPUS > 1)
+	bt_uint32_t cpu;
+	ARM_TPIDRURO_READ(cpu); /*set by btrace_shadow_cpu_init, MPIDR is not readable in user mode*/
+	return (cpu < SHADOW_CPUS) ? (int)cpu : 0;
+#else
+	return 0;
+#endif
+}
+
+static inline bt_shadow_stack_t* shadow_stack(int cpu) __attribute__ ((no_instrument_function, always_inline));
+static inline bt_shadow_stack_t* shadow_stack(int cpu)
+{
+	bt_shadow_stack_t* stack = shadow_current[cpu];
+	return stack ? stack : &shadow_default[cpu];
+}
+
+void __cyg_profile_func_enter(void* fn, void* callSite)
+{
+	bt_shadow_stack_t* stack = shadow_stack(shadow_cpu());
+	bt_uint32_t depth = stack->depth;
+
+	/* claim the slot before filling it, an interrupt taken in between
+	 * pushes above it and has popped again by the time we store*/
+	stack->depth = depth + 1;
+	__asm__ __volatile__ ("" ::: "memory");
+	if(depth < BTRACE_SHADOW_DEPTH)
+	{
+		stack->sites[depth] = (bt_uint32_t)(unsigned long)callSite;
+	}
+	else
+	{
+		++stack->overflow;
+	}
+	if(depth >= stack->max_depth)
+	{
+		stack->max_depth = depth + 1;
+	}
+}
+
+void __cyg_profile_func_exit(void* fn, void* callSite)
+{
+	bt_shadow_stack_t* stack = shadow_stack(shadow_cpu());
+
+	if(stack->depth)
+	{
+		--stack->depth;
+	}
+}
+
+void btrace_shadow_cpu_init(void)
+{
+#if (SHADOW_CPUS > 1) && !BTRACE_SHADOW_MPIDR
+	bt_uint32_t mpidr;
+	bt_uint32_t cpu;
+	ARM_MPIDR_READ(mpidr);
+	cpu = BTRACE_CPU_INDEX(mpidr);
+	ARM_TPIDRURO_WRITE(cpu);
+#endif
+}
+
+void btrace_shadow_init(bt_shadow_stack_t* stack)
+{
+	memset(stack, 0, sizeof(*stack));
+}
+
+bt_shadow_stack_t* btrace_shadow_switch(bt_shadow_stack_t* stack)
+{
+	int cpu = shadow_cpu();
+	bt_shadow_stack_t* oldStack = shadow_stack(cpu);
+	shadow_current[cpu] = stack;
+	return oldStack;
+}
+
+/* pcs[0] is the call returning to returnAddr, then the recorded calls
+ * innermost first*/
+static int shadow_copy(const bt_mem_reader_t* reader, bt_uint32_t returnAddr, bt_uint32_t* pcs, int maxFrames)
+{
+	const bt_shadow_stack_t* stack = shadow_stack(shadow_cpu());
+	int depth, frameCount = 0;
+
+	if(maxFrames <= 0)
+	{
+		return 0;
+	}
+	pcs[frameCount++] = btrace_call_site(reader, returnAddr);
+
+	depth = (stack->depth < BTRACE_SHADOW_DEPTH) ? (int)stack->depth : BTRACE_SHADOW_DEPTH;
+	while((depth > 0) && (frameCount < maxFrames))
+	{   /*return addresses point past the call, the unwinder reports the call*/
+		pcs[frameCount++] = btrace_call_site(reader, stack->sites[--depth]);
+	}
+	return frameCount;
+}
+
+static int shadow_unwind(bt_unwind_ctx_t* ctx, bt_uint32_t returnAddr)
+{
+	bt_uint32_t pcs[BTRACE_SHADOW_DEPTH + 1];
+	bt_unwind_cursor_t cursor;
+	int numPcs, frameIndex;
+
+	/*one more than asked for, to tell MAX_FRAMES from END_OF_STACK*/
+	numPcs = shadow_copy(ctx->reader, returnAddr, pcs, (ctx->max_frames <= BTRACE_SHADOW_DEPTH) ?
+	                                                   (ctx->max_frames + 1) : (BTRACE_SHADOW_DEPTH + 1));
+
+	if(!ctx->records)
+	{
+		ctx->max_records = 0;
+	}
+	ctx->num_records = 0;
+	if(!ctx->callback_fn && (ctx->max_records > 0))
+	{   /*records of a previous trace are no longer valid*/
+		ctx->records[0].flags = 0;
+	}
+
+	/*no stack is walked, each frame is just a PC with caller_sp left at 0*/
+	memset(&cursor, 0, sizeof(cursor));
+	cursor.stop_reason = BT_STOP_END_OF_STACK;
+	ctx->stop_reason = BT_STOP_END_OF_STACK;
+	for(frameIndex = 0; frameIndex < numPcs; ++frameIndex)
+	{
+		if(frameIndex >= ctx->max_frames)
+		{
+			ctx->stop_reason = BT_STOP_MAX_FRAMES;
+			break;
+		}
+		cursor.index = frameIndex;
+		cursor.frame.pc = pcs[frameIndex];
+		if(btrace_deliver_frame(frameIndex, ctx, &cursor) == STOP_BTRACE)
+		{   /*counted as btrace_unwind does, the frame was offered to the sink*/
+			ctx->stop_reason = BT_STOP_CALLBACK;
+			return frameIndex + 1;
+		}
+	}
+	return frameIndex;
+}
+
+int btrace_shadow_capture(bt_uint32_t* pcs, int maxFrames)
+{
+	return shadow_copy(0, (bt_uint32_t)(unsigned long)__builtin_return_address(0), pcs, maxFrames);
+}
+
+int btrace_shadow_unwind(bt_unwind_ctx_t* ctx)
+{
+	return shadow_unwind(ctx, (bt_uint32_t)(unsigned long)__builtin_return_address(0));
+}
+
+int btrace_shadow_callstack(TraceCallbackFnPtr callback_fn, int maxFrames)
+{
+	bt_unwind_ctx_t ctx;
+
+	btrace_init_context(&ctx);
+	ctx.max_frames = maxFrames;
+	ctx.callback_fn = callback_fn;
+	ctx.print_fn = btrace_get_print_fn();
+	ctx.print_buffer = shadowPrintBuffer;
+	return shadow_unwind(&ctx, (bt_uint32_t)(unsigned long)__builtin_return_address(0));
+}
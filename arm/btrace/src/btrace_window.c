@@ -0,0 +1,230 @@
+/*
+ * The MIT License
+ *
+ * Copyright (c) 2013 Rakesh D Nair
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#include "btrace_window.h"
+
+/*longest run or value that one token can carry without a varint*/
+#define WINDOW_MAX_SHORT_RUN   31
+#define WINDOW_MAX_SHORT_VALUE 15
+#define WINDOW_RAW_BYTES       5
+/*magic, text start and text end*/
+#define WINDOW_HEADER_BYTES    12
+
+static void put_byte(bt_window_encoder_t* enc, bt_uint32_t value)
+{
+	/*the last byte of the buffer is kept for BT_WINDOW_END*/
+	if(enc->used < enc->size - 1)
+	{
+		enc->buffer[enc->used] = (bt_uint8_t)value;
+	}
+	++enc->used;
+}
+
+static void put_word(bt_window_encoder_t* enc, bt_uint32_t value)
+{
+	put_byte(enc, value);
+	put_byte(enc, value >> 8);
+	put_byte(enc, value >> 16);
+	put_byte(enc, value >> 24);
+}
+
+static void put_varint(bt_window_encoder_t* enc, bt_uint32_t value)
+{
+	while(value > 0x7F)
+	{
+		put_byte(enc, (value & 0x7F) | 0x80);
+		value >>= 7;
+	}
+	put_byte(enc, value);
+}
+
+/*bytes taken by a single word op carrying value*/
+static int value_bytes(bt_uint32_t value)
+{
+	int bytes = 1;
+
+	value >>= 4;
+	while(value)
+	{
+		++bytes;
+		value >>= 7;
+	}
+	return bytes;
+}
+
+static void put_run(bt_window_encoder_t* enc, int op, int count)
+{
+	if(count <= WINDOW_MAX_SHORT_RUN)
+	{
+		put_byte(enc, (op << 5) | count);
+	}
+	else
+	{
+		put_byte(enc, op << 5);
+		put_varint(enc, count);
+	}
+}
+
+static void put_value(bt_window_encoder_t* enc, int op, bt_uint32_t value)
+{
+	if(value <= WINDOW_MAX_SHORT_VALUE)
+	{
+		put_byte(enc, (op << 5) | value);
+	}
+	else
+	{
+		put_byte(enc, (op << 5) | BT_WINDOW_VARINT_BIT | (value & 0xF));
+		put_varint(enc, value >> 4);
+	}
+}
+
+/*picks the shortest of the single word ops for word*/
+static void put_single(bt_window_encoder_t* enc, bt_uint32_t word, bt_uint32_t sp)
+{
+	int op = BT_WINDOW_OP_SMALL;
+	bt_uint32_t value = word;
+	int bytes = value_bytes(word);
+
+	if(value_bytes(~word) < bytes)
+	{
+		op = BT_WINDOW_OP_INVERTED;
+		value = ~word;
+		bytes = value_bytes(value);
+	}
+	if((word >= enc->text_start) && (word < enc->text_end) && (value_bytes(word - enc->text_start) < bytes))
+	{
+		op = BT_WINDOW_OP_TEXT;
+		value = word - enc->text_start;
+		bytes = value_bytes(value);
+	}
+	if((word >= sp) && (value_bytes(word - sp) < bytes))
+	{
+		op = BT_WINDOW_OP_STACK;
+		value = word - sp;
+		bytes = value_bytes(value);
+	}
+
+	if(bytes >= WINDOW_RAW_BYTES)
+	{
+		put_byte(enc, BT_WINDOW_OP_RAW << 5);
+		put_word(enc, word);
+	}
+	else
+	{
+		put_value(enc, op, value);
+	}
+}
+
+void btrace_window_init(bt_window_encoder_t* enc, bt_uint8_t* buffer, int bufferBytes,
+                        bt_uint32_t textStart, bt_uint32_t textEnd)
+{
+	enc->buffer = buffer;
+	enc->size = bufferBytes;
+	enc->used = 0;
+	enc->text_start = textStart;
+	enc->text_end = textEnd;
+	enc->frames = 0;
+	enc->dropped = 0;
+	put_word(enc, BT_WINDOW_MAGIC);
+	put_word(enc, textStart);
+	put_word(enc, textEnd);
+}
+
+int btrace_window_encode(bt_window_encoder_t* enc, int frameIndex,
+                         const bt_stackframe_t* frame, const bt_uint32_t* words, int numWords)
+{
+	int start = enc->used;
+	bt_uint32_t previous = 0;
+	int i = 0;
+
+	put_byte(enc, BT_WINDOW_FRAME);
+	put_varint(enc, frameIndex);
+	put_word(enc, frame->pc);
+	put_word(enc, frame->sp);
+	put_word(enc, frame->lr);
+	put_word(enc, frame->fp);
+	put_varint(enc, numWords);
+
+	/*stop as soon as the buffer is full, the frame is dropped anyway*/
+	while((i < numWords) && (enc->used < enc->size))
+	{
+		bt_uint32_t word = words[i];
+		int run = 1;
+
+		if((word == 0) || (word == previous))
+		{
+			while((i + run < numWords) && (words[i + run] == word))
+			{
+				++run;
+			}
+			put_run(enc, word ? BT_WINDOW_OP_REPEAT : BT_WINDOW_OP_ZERO, run);
+		}
+		else
+		{
+			put_single(enc, word, frame->sp);
+		}
+		previous = word;
+		i += run;
+	}
+
+	if(enc->used > enc->size - 1)
+	{   /*did not fit, leave the stream as it was before this frame*/
+		enc->used = start;
+		++enc->dropped;
+		return -1;
+	}
+	++enc->frames;
+	return enc->used - start;
+}
+
+int btrace_window_finish(bt_window_encoder_t* enc)
+{
+	if(enc->size < WINDOW_HEADER_BYTES + 1)
+	{   /*the header did not fit, there is no room for BT_WINDOW_END*/
+		return -1;
+	}
+	enc->buffer[enc->used++] = BT_WINDOW_END;
+	return enc->used;
+}
+
+#ifndef BTRACE_HOST_BUILD
+int btrace_window_callback(int frameIndex, bt_stackframe_t* pFrame, bt_uint32_t* sp_high)
+{
+	bt_unwind_ctx_t* ctx = (bt_unwind_ctx_t*)pFrame;
+	bt_uint32_t high = (bt_uint32_t)(unsigned long)sp_high;
+	int numWords = (high >= pFrame->sp) ? (int)(((high - pFrame->sp) >> 2) + 1) : 0;
+
+	if(!ctx->user)
+	{
+		return STOP_BTRACE;
+	}
+	if(btrace_window_encode((bt_window_encoder_t*)ctx->user, frameIndex, pFrame,
+	                        BT_ADDR_TO_PTR(pFrame->sp), numWords) < 0)
+	{
+		return STOP_BTRACE;
+	}
+	return 0;
+}
+#endif
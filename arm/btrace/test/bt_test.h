@@ -0,0 +1,68 @@
+/*
+ * The MIT License
+ *
+ * Copyright (c) 2013 Rakesh D Nair
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+*/
+
+#ifndef _BT_TEST_H_
+#define _BT_TEST_H_
+
+/*
+ * Checks for the host side regression tests. A failed check prints the
+ * file, line and expression and the test carries on, BT_TEST_EXIT reports
+ * the totals and gives the exit status for make.
+ */
+
+#include <stdio.h>
+
+static int bt_test_checks = 0;
+static int bt_test_failures = 0;
+
+#define BT_CHECK(_cond) \
+	do { \
+		++bt_test_checks; \
+		if(!(_cond)) \
+		{ \
+			++bt_test_failures; \
+			fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #_cond); \
+		} \
+	} while(0)
+
+/*compares two unsigned 32 bit values and prints both on failure*/
+#define BT_CHECK_EQ(_actual, _expected) \
+	do { \
+		unsigned int __a = (unsigned int)(_actual), __e = (unsigned int)(_expected); \
+		++bt_test_checks; \
+		if(__a != __e) \
+		{ \
+			++bt_test_failures; \
+			fprintf(stderr, "%s:%d: %s is 0x%x, expected 0x%x\n", __FILE__, __LINE__, #_actual, __a, __e); \
+		} \
+	} while(0)
+
+#define BT_TEST_EXIT(_name) \
+	do { \
+		printf("%s: %d checks, %d failed\n", _name, bt_test_checks, bt_test_failures); \
+		return bt_test_failures ? 1 : 0; \
+	} while(0)
+
+#endif /*_BT_TEST_H_*/
@@ -0,0 +1,91 @@
+@ Test image for the snapshot regression tests (see test/makefile).
+@
+@ A task entry calls process, process calls filter and filter calls fault,
+@ which faults on a NULL read. Every function sets up FP the way gcc does
+@ with -fno-omit-frame-pointer and carries EHABI unwind directives, so
+@ chain.elf can be unwound by scanning, from .ARM.exidx, through the frame
+@ pointers and from a btrace_mktable table. process reserves its frame
+@ with a rotated immediate (sub sp, sp, #0x400).
+@
+@   llvm-mc -triple=armv7a-none-eabi -filetype=obj -o chain.o chain.s
+@   ld.lld -N -Ttext=0x8000 -e task_entry -o chain.elf chain.o
+@
+@ The snapshots were laid out by hand from these prologues, with the task
+@ stack ending at 0x20008000 and task_entry entered with LR and FP 0:
+@
+@   deep.snap     abort on the load in fault, four frames deep
+@   process.snap  interrupt in process, after its frame is reserved
+@   short.snap    deep.snap cut after filter's frame, the caller of
+@                 process is not readable
+
+	.syntax unified
+	.arm
+	.text
+
+	.globl	task_entry
+	.type	task_entry, %function
+task_entry:
+	.fnstart
+	.save	{fp, lr}
+	push	{fp, lr}
+	.setfp	fp, sp, #4
+	add	fp, sp, #4
+	.pad	#8
+	sub	sp, sp, #8
+1:
+	mov	r0, #1
+	bl	process
+	b	1b
+	.fnend
+	.size	task_entry, .-task_entry
+
+	.globl	process
+	.type	process, %function
+process:
+	.fnstart
+	.save	{r4, r5, fp, lr}
+	push	{r4, r5, fp, lr}
+	.setfp	fp, sp, #12
+	add	fp, sp, #12
+	.pad	#1024
+	sub	sp, sp, #1024
+	mov	r4, r0
+	mov	r5, sp
+	mov	r0, r5
+	bl	filter
+	add	r0, r0, r4
+	add	sp, sp, #1024
+	pop	{r4, r5, fp, pc}
+	.fnend
+	.size	process, .-process
+
+	.globl	filter
+	.type	filter, %function
+filter:
+	.fnstart
+	.save	{fp, lr}
+	push	{fp, lr}
+	.setfp	fp, sp, #4
+	add	fp, sp, #4
+	.pad	#16
+	sub	sp, sp, #16
+	str	r0, [sp]
+	mov	r0, #0
+	bl	fault
+	add	sp, sp, #16
+	pop	{fp, pc}
+	.fnend
+	.size	filter, .-filter
+
+	.globl	fault
+	.type	fault, %function
+fault:
+	.fnstart
+	.save	{fp, lr}
+	push	{fp, lr}
+	.setfp	fp, sp, #4
+	add	fp, sp, #4
+	ldr	r0, [r0]
+	pop	{fp, pc}
+	.fnend
+	.size	fault, .-fault
@@ -0,0 +1,157 @@
+/*
+ * The MIT License
+ *
+ * Copyright (c) 2013 Rakesh D Nair
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+/*
+ * Frame cache, run against an unwinder built with BTRACE_FRAME_CACHE_SIZE:
+ * the first trace scans every frame, the second one finds them all in
+ * the cache with the same result, including a frame whose LR is not at
+ * the top of the push, and btrace_frame_cache_flush makes the next trace
+ * scan again after the code has changed.
+ */
+
+#include <string.h>
+
+#include "bt_test.h"
+#include "test_image.h"
+
+#define FN_MAIN   (TEST_CODE_BASE + 0x10)
+#define FN_ODD    (TEST_CODE_BASE + 0x100)
+#define FN_LEAF   (TEST_CODE_BASE + 0x200)
+
+#define ARM_STMDBNE_LR    0x192D4000 /* stmdbne sp!, {lr} */
+#define R7_PATTERN        0x0000BAD0
+
+static test_image_t image;
+
+/* main: push {r4, lr}; bl odd
+ * odd:  push {r4-r7}; stmdbne sp!, {lr}; bl leaf
+ * leaf: push {r4, lr}; nop <- traced from here
+ * LR of odd is 5 words below the SP of main, under r4-r7.*/
+static void build_image(void)
+{
+	test_image_init(&image);
+	test_code(&image, FN_MAIN, ARM_PUSH(0x4010));
+	test_code(&image, FN_MAIN + 4, ARM_BL(FN_MAIN + 4, FN_ODD));
+	test_code(&image, FN_ODD, ARM_PUSH(0x00F0));
+	test_code(&image, FN_ODD + 4, ARM_STMDBNE_LR);
+	test_code(&image, FN_ODD + 8, ARM_BL(FN_ODD + 8, FN_LEAF));
+	test_code(&image, FN_LEAF, ARM_PUSH(0x4010));
+	test_stack(&image, TEST_STACK_TOP - 4, 0);
+	test_stack(&image, TEST_STACK_TOP - 12, R7_PATTERN);
+	test_stack(&image, TEST_STACK_TOP - 28, FN_MAIN + 8);
+	test_stack(&image, TEST_STACK_TOP - 32, FN_ODD + 12);
+}
+
+static bt_uint32_t pcs[8];
+static bt_uint32_t spHigh[8];
+static int frames;
+
+static int collect_frame(int frameIndex, bt_stackframe_t* pFrame, bt_uint32_t* sp_high)
+{
+	if(frameIndex < 8)
+	{
+		pcs[frameIndex] = pFrame->pc;
+		spHigh[frameIndex] = (bt_uint32_t)(unsigned long)sp_high;
+	}
+	frames = frameIndex + 1;
+	return 0;
+}
+
+/*traces from leaf with SP at sp, returns number of frames*/
+static int unwind(bt_uint32_t sp)
+{
+	bt_stackframe_t* frame = get_frame_ptr();
+
+	memset(pcs, 0, sizeof(pcs));
+	frames = 0;
+	frame->pc = FN_LEAF + 4;
+	frame->sp = sp;
+	frame->lr = FN_ODD + 12;
+	frame->fp = 0;
+	btrace_callstack(collect_frame, 8);
+	return frames;
+}
+
+static void check_chain(int frames)
+{
+	BT_CHECK_EQ(frames, 3);
+	BT_CHECK_EQ(pcs[0], FN_LEAF + 4);
+	BT_CHECK_EQ(pcs[1], FN_ODD + 8);
+	BT_CHECK_EQ(pcs[2], FN_MAIN + 4);
+	/*first word used by odd is just below the SP of main*/
+	BT_CHECK_EQ(spHigh[1], TEST_STACK_TOP - 12);
+}
+
+static void test_hits(void)
+{
+	bt_frame_cache_stats_t stats;
+
+	BT_CHECK_EQ(btrace_frame_cache_stats(&stats), BTRACE_FRAME_CACHE_SIZE);
+	btrace_frame_cache_flush();
+
+	check_chain(unwind(TEST_STACK_TOP - 36));
+	btrace_frame_cache_stats(&stats);
+	BT_CHECK_EQ(stats.hits, 0);
+	BT_CHECK_EQ(stats.misses, 3);
+
+	/*from the cache, odd must still find its LR under r4-r7*/
+	check_chain(unwind(TEST_STACK_TOP - 36));
+	btrace_frame_cache_stats(&stats);
+	BT_CHECK_EQ(stats.hits, 3);
+	BT_CHECK_EQ(stats.misses, 3);
+}
+
+static void test_flush(void)
+{
+	bt_frame_cache_stats_t stats;
+
+	/*leaf reloaded as push {r4-r6, lr}, 8 more bytes on the stack*/
+	test_code(&image, FN_LEAF, ARM_PUSH(0x4070));
+	btrace_frame_cache_flush();
+	btrace_frame_cache_stats(&stats);
+	BT_CHECK_EQ(stats.hits, 0);
+	BT_CHECK_EQ(stats.misses, 0);
+
+	check_chain(unwind(TEST_STACK_TOP - 44));
+	btrace_frame_cache_stats(&stats);
+	BT_CHECK_EQ(stats.hits, 0);
+	BT_CHECK_EQ(stats.misses, 3);
+
+	check_chain(unwind(TEST_STACK_TOP - 44));
+	btrace_frame_cache_stats(&stats);
+	BT_CHECK_EQ(stats.hits, 3);
+}
+
+int main(void)
+{
+	build_image();
+	btrace_set_mem_reader(&image.reader);
+
+	test_hits();
+	test_flush();
+
+	btrace_set_mem_reader(0);
+	BT_TEST_EXIT("test_cache");
+}
@@ -0,0 +1,72 @@
+/*
+ * The MIT License
+ *
+ * Copyright (c) 2013 Rakesh D Nair
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+/*
+ * Mode selection of btrace_capture_interrupted: the registers of the
+ * interrupted code are read in the mode from SPSR, user mode through
+ * system mode, and not at all from the handler's own mode.
+ */
+
+#include "bt_test.h"
+#include "arm_defs.h"
+#include "arm_btrace.h"
+
+/*SPSR of code interrupted in mode with IRQ masked and the Z flag set*/
+#define SPSR(_mode)  (0x40000000 | CPSR_IRQ_BIT | (_mode))
+/*CPSR of a handler in mode with IRQ and FIQ masked*/
+#define CPSR(_mode)  (CPSR_IRQ_BIT | CPSR_FIQ_BIT | (_mode))
+
+static void test_other_mode(void)
+{
+	BT_CHECK_EQ(btrace_capture_mode(SPSR(CPSR_SVC_MODE), CPSR(CPSR_FIQ_MODE)), CPSR_SVC_MODE);
+	BT_CHECK_EQ(btrace_capture_mode(SPSR(CPSR_IRQ_MODE), CPSR(CPSR_FIQ_MODE)), CPSR_IRQ_MODE);
+	BT_CHECK_EQ(btrace_capture_mode(SPSR(CPSR_SYS_MODE), CPSR(CPSR_IRQ_MODE)), CPSR_SYS_MODE);
+	BT_CHECK_EQ(btrace_capture_mode(SPSR(CPSR_ABT_MODE), CPSR(CPSR_UND_MODE)), CPSR_ABT_MODE);
+}
+
+static void test_user_mode(void)
+{
+	/*user registers are read from system mode*/
+	BT_CHECK_EQ(btrace_capture_mode(SPSR(CPSR_USR_MODE), CPSR(CPSR_FIQ_MODE)), CPSR_SYS_MODE);
+	BT_CHECK_EQ(btrace_capture_mode(SPSR(CPSR_USR_MODE), CPSR(CPSR_IRQ_MODE)), CPSR_SYS_MODE);
+	BT_CHECK_EQ(btrace_capture_mode(CPSR_USR_MODE, CPSR_SVC_MODE), CPSR_SYS_MODE);
+}
+
+static void test_own_mode(void)
+{
+	/*a nested FIQ or IRQ, its SP and LR are the handler's*/
+	BT_CHECK_EQ(btrace_capture_mode(SPSR(CPSR_FIQ_MODE), CPSR(CPSR_FIQ_MODE)), -1);
+	BT_CHECK_EQ(btrace_capture_mode(SPSR(CPSR_IRQ_MODE), CPSR(CPSR_IRQ_MODE)), -1);
+	/*user mode interrupted while the handler runs in system mode*/
+	BT_CHECK_EQ(btrace_capture_mode(SPSR(CPSR_USR_MODE), CPSR(CPSR_SYS_MODE)), -1);
+}
+
+int main(void)
+{
+	test_other_mode();
+	test_user_mode();
+	test_own_mode();
+	BT_TEST_EXIT("test_capture");
+}
@@ -0,0 +1,293 @@
+/*
+ * The MIT License
+ *
+ * Copyright (c) 2013 Rakesh D Nair
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+/*
+ * Reentrant unwinding: contexts and cursors read through their own
+ * bt_mem_reader_t and keep their own read errors, so unwinds of different
+ * stacks and snapshots can be interleaved or run on several threads
+ * without a global reader installed.
+ */
+
+#include <string.h>
+#include <pthread.h>
+
+#include "bt_test.h"
+#include "test_image.h"
+
+#define FN_MAIN   (TEST_CODE_BASE)
+#define FN_WORK   (TEST_CODE_BASE + 0x100)
+#define FN_LEAF   (TEST_CODE_BASE + 0x200)
+
+#define THREADS      4
+#define SNAP_WORDS   6
+#define ITERATIONS   20000
+
+/*test image whose stack cannot be read at or above limit*/
+typedef struct LimitedImage {
+	const test_image_t* image;
+	bt_uint32_t         limit;
+	bt_mem_reader_t     reader;
+} limited_image_t;
+
+/*snapshot header followed by the stack words*/
+typedef struct TestSnapshot {
+	bt_snapshot_t header;
+	bt_uint32_t   words[SNAP_WORDS];
+} test_snapshot_t;
+
+typedef struct Worker {
+	const bt_mem_reader_t* reader;
+	const bt_snapshot_t*   snapshot;  /* unwound with reader if not NULL */
+	int                    expected_frames;
+	int                    failures;
+} worker_t;
+
+static test_image_t image;
+
+static int read_limited_word(void* ctx, bt_uint32_t addr, bt_uint32_t* value)
+{
+	const limited_image_t* limited = (const limited_image_t*)ctx;
+
+	if((addr >= limited->limit) && (addr < TEST_STACK_TOP))
+	{
+		return -1;
+	}
+	return limited->image->reader.read_word(limited->image->reader.ctx, addr, value);
+}
+
+static void limit_image(limited_image_t* limited, bt_uint32_t limit)
+{
+	limited->image = &image;
+	limited->limit = limit;
+	limited->reader.read_word = read_limited_word;
+	limited->reader.ctx = limited;
+}
+
+/* main: push {r4, lr}; bl work
+ * work: push {r4, lr}; bl leaf
+ * leaf: push {r4, lr}; nop <- stopped here*/
+static void build_image(void)
+{
+	test_image_init(&image);
+	test_code(&image, FN_MAIN, ARM_PUSH(0x4010));
+	test_code(&image, FN_MAIN + 4, ARM_BL(FN_MAIN + 4, FN_WORK));
+	test_code(&image, FN_WORK, ARM_PUSH(0x4010));
+	test_code(&image, FN_WORK + 4, ARM_BL(FN_WORK + 4, FN_LEAF));
+	test_code(&image, FN_LEAF, ARM_PUSH(0x4010));
+	test_stack(&image, TEST_STACK_TOP - 4, 0);
+	test_stack(&image, TEST_STACK_TOP - 12, FN_MAIN + 8);
+	test_stack(&image, TEST_STACK_TOP - 20, FN_WORK + 8);
+}
+
+static void leaf_frame(bt_stackframe_t* frame)
+{
+	frame->fp = 0;
+	frame->pc = FN_LEAF + 4;
+	frame->sp = TEST_STACK_TOP - 24;
+	frame->lr = FN_WORK + 8;
+}
+
+/*copies numWords of the leaf frame's stack*/
+static void take_snapshot(test_snapshot_t* snapshot, int numWords)
+{
+	int i;
+
+	leaf_frame(&snapshot->header.frame);
+	snapshot->header.stack_base = snapshot->header.frame.sp;
+	snapshot->header.num_words = numWords;
+	for(i = 0; i < numWords; ++i)
+	{
+		image.reader.read_word(image.reader.ctx, snapshot->header.stack_base + 4 * i,
+		                       &snapshot->words[i]);
+	}
+	snapshot->header.magic = BT_SNAPSHOT_MAGIC;
+}
+
+static void test_interleaved_cursors(void)
+{
+	limited_image_t limited;
+	bt_unwind_cursor_t full, cut;
+	bt_stackframe_t frame;
+
+	/*cut cannot read the LR saved by main*/
+	limit_image(&limited, TEST_STACK_TOP - 8);
+	leaf_frame(&frame);
+	btrace_cursor_init(&full, &frame, BT_ENGINE_SCAN);
+	btrace_cursor_init(&cut, &frame, BT_ENGINE_SCAN);
+	full.reader = &image.reader;
+	cut.reader = &limited.reader;
+
+	BT_CHECK_EQ(btrace_cursor_next(&full), 1);
+	BT_CHECK_EQ(btrace_cursor_next(&cut), 1);
+	BT_CHECK_EQ(btrace_cursor_next(&full), 1);
+	BT_CHECK_EQ(btrace_cursor_next(&cut), 1);
+	BT_CHECK_EQ(cut.frame.pc, FN_WORK + 4);
+	BT_CHECK_EQ(btrace_cursor_next(&cut), -BT_STOP_MEM_READ);
+	/*the failed reads of cut do not end full*/
+	BT_CHECK_EQ(btrace_cursor_next(&full), 1);
+	BT_CHECK_EQ(full.frame.pc, FN_MAIN + 4);
+	BT_CHECK_EQ(full.read_errors, 0);
+	BT_CHECK_EQ(btrace_cursor_next(&full), 0);
+	BT_CHECK_EQ(full.stop_reason, BT_STOP_END_OF_STACK);
+}
+
+static int unwind_with(const bt_mem_reader_t* reader, int* stopReason)
+{
+	bt_unwind_ctx_t ctx;
+	bt_frame_record_t records[8];
+	int frames;
+
+	btrace_init_context(&ctx);
+	leaf_frame(&ctx.frame);
+	ctx.max_frames = 8;
+	ctx.records = records;
+	ctx.max_records = 8;
+	ctx.reader = reader;
+	frames = btrace_unwind(&ctx);
+	*stopReason = ctx.stop_reason;
+	return frames;
+}
+
+static int unwind_snapshot_with(const bt_snapshot_t* snapshot, const bt_mem_reader_t* reader,
+                                int* stopReason)
+{
+	bt_unwind_ctx_t ctx;
+	bt_frame_record_t records[8];
+	int frames;
+
+	btrace_init_context(&ctx);
+	ctx.max_frames = 8;
+	ctx.records = records;
+	ctx.max_records = 8;
+	ctx.reader = reader;
+	frames = btrace_unwind_snapshot(snapshot, &ctx);
+	*stopReason = ctx.stop_reason;
+	if(ctx.reader != reader)
+	{
+		return -1;
+	}
+	return frames;
+}
+
+static void test_context_reader(void)
+{
+	limited_image_t limited;
+	int stop;
+
+	/*no global reader is installed*/
+	limit_image(&limited, TEST_STACK_TOP - 8);
+	BT_CHECK_EQ(unwind_with(&image.reader, &stop), 3);
+	BT_CHECK_EQ(stop, BT_STOP_END_OF_STACK);
+	BT_CHECK_EQ(unwind_with(&limited.reader, &stop), 2);
+	BT_CHECK_EQ(stop, BT_STOP_MEM_READ);
+	BT_CHECK_EQ(unwind_with(0, &stop), 0);
+	BT_CHECK_EQ(stop, BT_STOP_MEM_READ);
+}
+
+static void test_snapshot_reader(void)
+{
+	limited_image_t code;
+	test_snapshot_t deep, cut;
+	int stop;
+
+	/*the stack is only in the snapshots, cut misses the LR saved by main*/
+	limit_image(&code, TEST_STACK_BASE);
+	take_snapshot(&deep, SNAP_WORDS);
+	take_snapshot(&cut, SNAP_WORDS - 2);
+	BT_CHECK_EQ(unwind_snapshot_with(&deep.header, &code.reader, &stop), 3);
+	BT_CHECK_EQ(stop, BT_STOP_END_OF_STACK);
+	BT_CHECK_EQ(unwind_snapshot_with(&cut.header, &code.reader, &stop), 2);
+	BT_CHECK_EQ(stop, BT_STOP_MEM_READ);
+	/*without a reader in ctx the code is not readable either*/
+	BT_CHECK_EQ(unwind_snapshot_with(&deep.header, 0, &stop), 0);
+	BT_CHECK_EQ(stop, BT_STOP_MEM_READ);
+	/*the global reader was not replaced*/
+	BT_CHECK_EQ(unwind_with(0, &stop), 0);
+	deep.header.magic = 0;
+	BT_CHECK_EQ(unwind_snapshot_with(&deep.header, &code.reader, &stop), -1);
+}
+
+static void* worker_main(void* arg)
+{
+	worker_t* worker = (worker_t*)arg;
+	int i, stop;
+
+	for(i = 0; i < ITERATIONS; ++i)
+	{
+		int frames = worker->snapshot ? unwind_snapshot_with(worker->snapshot, worker->reader, &stop)
+		                               : unwind_with(worker->reader, &stop);
+		if(frames != worker->expected_frames)
+		{
+			++worker->failures;
+		}
+	}
+	return 0;
+}
+
+static void test_threads(void)
+{
+	limited_image_t limited, code;
+	test_snapshot_t deep, cut;
+	pthread_t threads[THREADS];
+	worker_t workers[THREADS];
+	int i;
+
+	/*half of the threads read a stack cut above work's frame, the other
+	 *half unwind snapshots*/
+	limit_image(&limited, TEST_STACK_TOP - 8);
+	limit_image(&code, TEST_STACK_BASE);
+	take_snapshot(&deep, SNAP_WORDS);
+	take_snapshot(&cut, SNAP_WORDS - 2);
+	for(i = 0; i < THREADS; ++i)
+	{
+		workers[i].reader = (i & 1) ? &limited.reader : &image.reader;
+		workers[i].snapshot = 0;
+		if(i & 2)
+		{
+			workers[i].reader = &code.reader;
+			workers[i].snapshot = (i & 1) ? &cut.header : &deep.header;
+		}
+		workers[i].expected_frames = (i & 1) ? 2 : 3;
+		workers[i].failures = 0;
+		pthread_create(&threads[i], 0, worker_main, &workers[i]);
+	}
+	for(i = 0; i < THREADS; ++i)
+	{
+		pthread_join(threads[i], 0);
+		BT_CHECK_EQ(workers[i].failures, 0);
+	}
+}
+
+int main(void)
+{
+	build_image();
+	btrace_set_mem_reader(0);
+
+	test_interleaved_cursors();
+	test_context_reader();
+	test_snapshot_reader();
+	test_threads();
+	BT_TEST_EXIT("test_context");
+}
@@ -0,0 +1,183 @@
+/*
+ * The MIT License
+ *
+ * Copyright (c) 2013 Rakesh D Nair
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+/*
+ * Crash ring: a recorded trace reads back unchanged, the ring keeps the
+ * newest BTRACE_CRASH_SLOTS records, btrace_crash_init keeps the order
+ * of the records found after a reset and wipes a corrupted one, and
+ * btrace_crash_clear empties the ring without restarting the sequence.
+ */
+
+#include <string.h>
+
+#include "bt_test.h"
+#include "test_image.h"
+#include "btrace_crash.h"
+
+#define FN_MAIN   (TEST_CODE_BASE)
+#define FN_WORK   (TEST_CODE_BASE + 0x100)
+#define FN_LEAF   (TEST_CODE_BASE + 0x200)
+
+static test_image_t image;
+static char printed[4096];
+
+static int print_crash(char* line)
+{
+	strcat(printed, line);
+	return 0;
+}
+
+/* main: push {r4, lr}; bl work
+ * work: push {r4, lr}; bl leaf
+ * leaf: push {r4, lr}; nop <- faulted here*/
+static void build_image(void)
+{
+	test_image_init(&image);
+	test_code(&image, FN_MAIN, ARM_PUSH(0x4010));
+	test_code(&image, FN_MAIN + 4, ARM_BL(FN_MAIN + 4, FN_WORK));
+	test_code(&image, FN_WORK, ARM_PUSH(0x4010));
+	test_code(&image, FN_WORK + 4, ARM_BL(FN_WORK + 4, FN_LEAF));
+	test_code(&image, FN_LEAF, ARM_PUSH(0x4010));
+	test_stack(&image, TEST_STACK_TOP - 4, 0);
+	test_stack(&image, TEST_STACK_TOP - 12, FN_MAIN + 8);
+	test_stack(&image, TEST_STACK_TOP - 20, FN_WORK + 8);
+}
+
+/*records a fault in leaf with faultLr as the LR of the handler*/
+static int record(bt_uint32_t faultLr)
+{
+	bt_stackframe_t frame;
+
+	frame.fp = 0;
+	frame.pc = FN_LEAF + 4;
+	frame.sp = TEST_STACK_TOP - 24;
+	frame.lr = FN_WORK + 8;
+	return btrace_crash_record(&frame, faultLr, 1);
+}
+
+static void test_record(void)
+{
+	const bt_crash_record_t* crash;
+
+	BT_CHECK_EQ(btrace_crash_init(), 0);
+	BT_CHECK_EQ(record(0x100), 3);
+	BT_CHECK_EQ(btrace_crash_count(), 1);
+
+	crash = btrace_crash_get(0);
+	BT_CHECK(crash != 0);
+	if(crash)
+	{
+		BT_CHECK_EQ(crash->magic, BT_CRASH_MAGIC);
+		BT_CHECK_EQ(crash->sequence, 0);
+		BT_CHECK_EQ(crash->cpu, 1);
+		BT_CHECK_EQ(crash->fault_lr, 0x100);
+		BT_CHECK_EQ(crash->stop_reason, BT_STOP_END_OF_STACK);
+		BT_CHECK_EQ(crash->frame.pc, FN_LEAF + 4);
+		BT_CHECK_EQ(crash->depth, 3);
+		BT_CHECK_EQ(crash->pcs[0], FN_LEAF + 4);
+		BT_CHECK_EQ(crash->pcs[1], FN_WORK + 4);
+		BT_CHECK_EQ(crash->pcs[2], FN_MAIN + 4);
+	}
+	BT_CHECK(btrace_crash_get(1) == 0);
+
+	printed[0] = 0;
+	BT_CHECK_EQ(btrace_crash_emit(print_crash), 1);
+	BT_CHECK(!strcmp(printed, "crash 0: cpu= 1, fault LR= 100, SP= 2000ffe8, stop: end of stack\n"
+	                          "#00: PC= 8204\n#01: PC= 8104\n#02: PC= 8004\n"));
+}
+
+static void test_wrap(void)
+{
+	int index;
+
+	/*sequences 1 .. SLOTS + 1, the ring keeps the newest SLOTS*/
+	for(index = 1; index <= BTRACE_CRASH_SLOTS + 1; ++index)
+	{
+		record(0x100 + index);
+	}
+	BT_CHECK_EQ(btrace_crash_count(), BTRACE_CRASH_SLOTS);
+	for(index = 0; index < BTRACE_CRASH_SLOTS; ++index)
+	{
+		const bt_crash_record_t* crash = btrace_crash_get(index);
+		BT_CHECK(crash && (crash->sequence == (bt_uint32_t)(index + 2)));
+		BT_CHECK(crash && (crash->fault_lr == (bt_uint32_t)(0x102 + index)));
+	}
+}
+
+static void test_init_after_reset(void)
+{
+	bt_crash_record_t* corrupt;
+
+	/*the ring survives, the sequence is found again*/
+	BT_CHECK_EQ(btrace_crash_init(), BTRACE_CRASH_SLOTS);
+	BT_CHECK_EQ(btrace_crash_get(0)->sequence, 2);
+	record(0x200);
+	BT_CHECK_EQ(btrace_crash_get(BTRACE_CRASH_SLOTS - 1)->sequence, BTRACE_CRASH_SLOTS + 2);
+	BT_CHECK_EQ(btrace_crash_get(BTRACE_CRASH_SLOTS - 1)->fault_lr, 0x200);
+
+	/*a record whose checksum does not match is skipped and then wiped*/
+	corrupt = (bt_crash_record_t*)btrace_crash_get(1);
+	corrupt->pcs[0] ^= 0x10;
+	BT_CHECK_EQ(btrace_crash_count(), BTRACE_CRASH_SLOTS - 1);
+	BT_CHECK_EQ(btrace_crash_get(1)->sequence, 5);
+	BT_CHECK_EQ(btrace_crash_init(), BTRACE_CRASH_SLOTS - 1);
+	BT_CHECK_EQ(corrupt->magic, 0);
+
+	/*a record cut short before its magic was written*/
+	corrupt = (bt_crash_record_t*)btrace_crash_get(0);
+	corrupt->magic = 0;
+	BT_CHECK_EQ(btrace_crash_init(), BTRACE_CRASH_SLOTS - 2);
+	BT_CHECK_EQ(btrace_crash_get(0)->sequence, 5);
+}
+
+static void test_clear(void)
+{
+	BT_CHECK(btrace_crash_count() > 0);
+	btrace_crash_clear();
+	BT_CHECK_EQ(btrace_crash_count(), 0);
+	BT_CHECK_EQ(btrace_crash_emit(print_crash), 0);
+
+	/*records after a clear carry on from the last sequence*/
+	record(0x300);
+	BT_CHECK_EQ(btrace_crash_count(), 1);
+	BT_CHECK_EQ(btrace_crash_get(0)->sequence, BTRACE_CRASH_SLOTS + 3);
+	BT_CHECK_EQ(btrace_crash_init(), 1);
+	record(0x301);
+	BT_CHECK_EQ(btrace_crash_get(1)->sequence, BTRACE_CRASH_SLOTS + 4);
+}
+
+int main(void)
+{
+	build_image();
+	btrace_set_mem_reader(&image.reader);
+
+	test_record();
+	test_wrap();
+	test_init_after_reset();
+	test_clear();
+
+	btrace_set_mem_reader(0);
+	BT_TEST_EXIT("test_crash");
+}
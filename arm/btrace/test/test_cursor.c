@@ -0,0 +1,141 @@
+/*
+ * The MIT License
+ *
+ * Copyright (c) 2013 Rakesh D Nair
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+/*
+ * Unwind cursor: stepping one frame at a time, with other work between
+ * the steps, yields the same frames as btrace_unwind, and a cursor that
+ * has stopped keeps returning the same result.
+ */
+
+#include <string.h>
+
+#include "bt_test.h"
+#include "test_image.h"
+
+#define FN_MAIN   (TEST_CODE_BASE)
+#define FN_WORK   (TEST_CODE_BASE + 0x100)
+#define FN_LEAF   (TEST_CODE_BASE + 0x200)
+
+#define MAX_FRAMES  8
+
+static test_image_t image;
+
+/* main: push {r4, lr}; bl work
+ * work: push {r4, lr}; bl leaf
+ * leaf: push {r4, lr}; nop <- stopped here*/
+static void build_image(void)
+{
+	test_image_init(&image);
+	test_code(&image, FN_MAIN, ARM_PUSH(0x4010));
+	test_code(&image, FN_MAIN + 4, ARM_BL(FN_MAIN + 4, FN_WORK));
+	test_code(&image, FN_WORK, ARM_PUSH(0x4010));
+	test_code(&image, FN_WORK + 4, ARM_BL(FN_WORK + 4, FN_LEAF));
+	test_code(&image, FN_LEAF, ARM_PUSH(0x4010));
+	test_stack(&image, TEST_STACK_TOP - 4, 0);
+	test_stack(&image, TEST_STACK_TOP - 12, FN_MAIN + 8);
+	test_stack(&image, TEST_STACK_TOP - 20, FN_WORK + 8);
+}
+
+static void leaf_frame(bt_stackframe_t* frame)
+{
+	frame->fp = 0;
+	frame->pc = FN_LEAF + 4;
+	frame->sp = TEST_STACK_TOP - 24;
+	frame->lr = FN_WORK + 8;
+}
+
+static int unwind_records(int engine, bt_frame_record_t* records)
+{
+	bt_unwind_ctx_t ctx;
+
+	btrace_init_context(&ctx);
+	leaf_frame(&ctx.frame);
+	ctx.max_frames = MAX_FRAMES;
+	ctx.records = records;
+	ctx.max_records = MAX_FRAMES;
+	ctx.reader = &image.reader;
+	ctx.engine = engine;
+	return btrace_unwind(&ctx);
+}
+
+static void test_steps(int engine)
+{
+	bt_frame_record_t expected[MAX_FRAMES];
+	bt_frame_record_t other[MAX_FRAMES];
+	bt_frame_record_t record;
+	bt_unwind_cursor_t cursor;
+	bt_stackframe_t frame;
+	int frames, steps = 0;
+
+	frames = unwind_records(engine, expected);
+	BT_CHECK_EQ(frames, 3);
+
+	leaf_frame(&frame);
+	btrace_cursor_init(&cursor, &frame, engine);
+	cursor.reader = &image.reader;
+	BT_CHECK_EQ(cursor.stop_reason, BT_CURSOR_RUNNING);
+	BT_CHECK_EQ(btrace_cursor_frame(&cursor, &record), -1);
+
+	while((steps < MAX_FRAMES) && (btrace_cursor_next(&cursor) == 1))
+	{
+		BT_CHECK_EQ(btrace_cursor_frame(&cursor, &record), 0);
+		BT_CHECK(!memcmp(&record, &expected[steps], sizeof(record)));
+		++steps;
+		/*as another trace run before the next step would*/
+		btrace_frame_cache_flush();
+		unwind_records(engine, other);
+	}
+	BT_CHECK_EQ(steps, frames);
+	BT_CHECK_EQ(cursor.stop_reason, BT_STOP_END_OF_STACK);
+	BT_CHECK_EQ(btrace_cursor_next(&cursor), 0);
+	BT_CHECK_EQ(cursor.index, frames - 1);
+}
+
+static void test_sticky_failure(void)
+{
+	bt_unwind_cursor_t cursor;
+	bt_stackframe_t frame;
+
+	/*the scan from pc leaves the code*/
+	leaf_frame(&frame);
+	frame.pc = TEST_CODE_BASE - 0x100;
+	btrace_cursor_init(&cursor, &frame, BT_ENGINE_SCAN);
+	cursor.reader = &image.reader;
+	BT_CHECK_EQ(btrace_cursor_next(&cursor), -BT_STOP_MEM_READ);
+	BT_CHECK_EQ(cursor.stop_reason, BT_STOP_MEM_READ);
+	BT_CHECK_EQ(btrace_cursor_next(&cursor), -BT_STOP_MEM_READ);
+	BT_CHECK_EQ(cursor.index, 0);
+}
+
+int main(void)
+{
+	build_image();
+	btrace_set_mem_reader(0);
+
+	test_steps(BT_ENGINE_SCAN);
+	test_steps(BT_ENGINE_FP_SCAN);
+	test_sticky_failure();
+	BT_TEST_EXIT("test_cursor");
+}
@@ -0,0 +1,178 @@
+/*
+ * The MIT License
+ *
+ * Copyright (c) 2013 Rakesh D Nair
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+/*
+ * Backtrace aggregation: repeated stacks are counted once, stacks deeper
+ * than BTRACE_DEDUP_MAX_DEPTH are cut at the limit, and a commit that
+ * lands while btrace_dedup_flush runs is dropped instead of racing it.
+ * A flush stopped by the print function keeps the stacks it did not print.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "bt_test.h"
+#include "btrace_dedup.h"
+
+static char printed[8192];
+static int commit_in_print;
+static bt_uint32_t commit_result;
+static int stop_at_stack;
+
+/*feeds depth frames with PCs base, base + 4, ... to the dedup callback*/
+static int collect(bt_uint32_t base, int depth)
+{
+	bt_stackframe_t frame;
+	int index;
+
+	memset(&frame, 0, sizeof(frame));
+	for(index = 0; index < depth; ++index)
+	{
+		frame.pc = base + 4 * index;
+		if(btrace_dedup_callback(index, &frame, 0) == STOP_BTRACE)
+		{
+			return index + 1;
+		}
+	}
+	return depth;
+}
+
+static int print_flush(char* line)
+{
+	strcat(printed, line);
+	if(commit_in_print)
+	{   /*as an interrupt committing a trace during the flush would*/
+		commit_in_print = 0;
+		collect(0x9000, 2);
+		commit_result = btrace_dedup_commit();
+	}
+	return 0;
+}
+
+/*returns STOP_BTRACE on the header of stack stop_at_stack*/
+static int print_stopped(char* line)
+{
+	if(!strncmp(line, "[stack ", 7) && (atoi(line + 7) == stop_at_stack))
+	{
+		return STOP_BTRACE;
+	}
+	strcat(printed, line);
+	return 0;
+}
+
+static void test_counts(void)
+{
+	collect(0x8000, 3);
+	BT_CHECK_EQ(btrace_dedup_commit(), 1);
+	collect(0x8100, 2);
+	BT_CHECK_EQ(btrace_dedup_commit(), 1);
+	collect(0x8000, 3);
+	BT_CHECK_EQ(btrace_dedup_commit(), 2);
+
+	printed[0] = 0;
+	BT_CHECK_EQ(btrace_dedup_flush(print_flush), 2);
+	BT_CHECK(strstr(printed, "count= 2\n#00: PC= 8000\n#01: PC= 8004\n#02: PC= 8008\n") != 0);
+	BT_CHECK(strstr(printed, "count= 1\n#00: PC= 8100\n#01: PC= 8104\n") != 0);
+	BT_CHECK_EQ(btrace_dedup_flush(print_flush), 0);
+}
+
+static void test_max_depth(void)
+{
+	bt_stackframe_t frame;
+	char last[32];
+
+	/*the callback stops the trace at the limit and never writes past it*/
+	BT_CHECK_EQ(collect(0x8000, BTRACE_DEDUP_MAX_DEPTH + 8), BTRACE_DEDUP_MAX_DEPTH);
+	memset(&frame, 0, sizeof(frame));
+	frame.pc = 0xBAD0;
+	BT_CHECK_EQ(btrace_dedup_callback(BTRACE_DEDUP_MAX_DEPTH, &frame, 0), STOP_BTRACE);
+	BT_CHECK_EQ(btrace_dedup_callback(BTRACE_DEDUP_MAX_DEPTH + 100, &frame, 0), STOP_BTRACE);
+	BT_CHECK_EQ(btrace_dedup_commit(), 1);
+
+	printed[0] = 0;
+	BT_CHECK_EQ(btrace_dedup_flush(print_flush), 1);
+	sprintf(last, "#%02u: PC= %x\n", BTRACE_DEDUP_MAX_DEPTH - 1, 0x8000 + 4 * (BTRACE_DEDUP_MAX_DEPTH - 1));
+	BT_CHECK(strstr(printed, last) != 0);
+	BT_CHECK(strstr(printed, "bad0") == 0);
+}
+
+static void test_commit_during_flush(void)
+{
+	bt_dedup_stats_t before, after;
+
+	collect(0x8000, 3);
+	btrace_dedup_commit();
+	btrace_dedup_get_stats(&before);
+
+	printed[0] = 0;
+	commit_in_print = 1;
+	commit_result = 0xFFFFFFFF;
+	BT_CHECK_EQ(btrace_dedup_flush(print_flush), 1);
+	BT_CHECK_EQ(commit_result, 0);
+	btrace_dedup_get_stats(&after);
+	BT_CHECK_EQ(after.busy - before.busy, 1);
+
+	/*the dropped trace did not reach the table, commits work again*/
+	BT_CHECK_EQ(btrace_dedup_flush(print_flush), 0);
+	collect(0x9000, 2);
+	BT_CHECK_EQ(btrace_dedup_commit(), 1);
+	BT_CHECK_EQ(btrace_dedup_flush(0), 1);
+}
+
+static void test_flush_stopped(void)
+{
+	bt_dedup_stats_t stats;
+
+	/*0xA000 and 0xA020 hash to the same slot, 0xA020 goes in the next one*/
+	collect(0xA000, 1);
+	BT_CHECK_EQ(btrace_dedup_commit(), 1);
+	collect(0xA020, 1);
+	BT_CHECK_EQ(btrace_dedup_commit(), 1);
+
+	printed[0] = 0;
+	stop_at_stack = 1;
+	BT_CHECK_EQ(btrace_dedup_flush(print_stopped), 1);
+	BT_CHECK(!strcmp(printed, "[stack 0] count= 1\n#00: PC= a000\n"));
+	btrace_dedup_get_stats(&stats);
+	BT_CHECK_EQ(stats.unique, 1);
+
+	/*the stack left behind is still found from its hash*/
+	collect(0xA020, 1);
+	BT_CHECK_EQ(btrace_dedup_commit(), 2);
+
+	printed[0] = 0;
+	BT_CHECK_EQ(btrace_dedup_flush(print_flush), 1);
+	BT_CHECK(!strcmp(printed, "[stack 0] count= 2\n#00: PC= a020\n"));
+	BT_CHECK_EQ(btrace_dedup_flush(print_flush), 0);
+}
+
+int main(void)
+{
+	test_counts();
+	test_max_depth();
+	test_commit_during_flush();
+	test_flush_stopped();
+	BT_TEST_EXIT("test_dedup");
+}
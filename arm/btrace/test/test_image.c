@@ -0,0 +1,113 @@
+/*
+ * The MIT License
+ *
+ * Copyright (c) 2013 Rakesh D Nair
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#include <string.h>
+
+#include "test_image.h"
+
+typedef struct TestTrace {
+	bt_uint32_t* pcs;
+	int          max_frames;
+} test_trace_t;
+
+static int read_test_word(void* ctx, bt_uint32_t addr, bt_uint32_t* value)
+{
+	test_image_t* image = (test_image_t*)ctx;
+
+	if((addr >= TEST_CODE_BASE) && (((addr - TEST_CODE_BASE) >> 2) < TEST_CODE_WORDS))
+	{
+		*value = image->code[(addr - TEST_CODE_BASE) >> 2];
+		return 0;
+	}
+	if((addr >= TEST_STACK_BASE) && (((addr - TEST_STACK_BASE) >> 2) < TEST_STACK_WORDS))
+	{
+		*value = image->stack[(addr - TEST_STACK_BASE) >> 2];
+		return 0;
+	}
+	return -1;
+}
+
+static int collect_pc(int frameIndex, bt_stackframe_t* pFrame, bt_uint32_t* sp_high)
+{
+	test_trace_t* trace = (test_trace_t*)((bt_unwind_ctx_t*)pFrame)->user;
+
+	if(frameIndex < trace->max_frames)
+	{
+		trace->pcs[frameIndex] = pFrame->pc;
+	}
+	return 0;
+}
+
+void test_image_init(test_image_t* image)
+{
+	int i;
+
+	for(i = 0; i < TEST_CODE_WORDS; ++i)
+	{
+		image->code[i] = ARM_NOP;
+	}
+	for(i = 0; i < TEST_STACK_WORDS; ++i)
+	{
+		image->stack[i] = 0xDEAD0000 | i;
+	}
+	image->reader.read_word = read_test_word;
+	image->reader.ctx = image;
+}
+
+void test_code(test_image_t* image, bt_uint32_t addr, bt_uint32_t opcode)
+{
+	image->code[(addr - TEST_CODE_BASE) >> 2] = opcode;
+}
+
+void test_stack(test_image_t* image, bt_uint32_t addr, bt_uint32_t value)
+{
+	image->stack[(addr - TEST_STACK_BASE) >> 2] = value;
+}
+
+int test_unwind(test_image_t* image, const bt_stackframe_t* frame, int engine,
+                bt_uint32_t* pcs, int maxFrames, int* stopReason)
+{
+	bt_unwind_ctx_t ctx;
+	test_trace_t trace;
+	int frames;
+
+	trace.pcs = pcs;
+	trace.max_frames = maxFrames;
+	memset(pcs, 0, maxFrames * sizeof(bt_uint32_t));
+
+	btrace_set_mem_reader(&image->reader);
+	btrace_frame_cache_flush();
+	btrace_init_context(&ctx);
+	ctx.frame = *frame;
+	ctx.max_frames = maxFrames;
+	ctx.callback_fn = collect_pc;
+	ctx.user = &trace;
+	ctx.engine = engine;
+	frames = btrace_unwind(&ctx);
+	btrace_set_mem_reader(0);
+
+	*stopReason = ctx.stop_reason;
+	return frames;
+}
@@ -0,0 +1,68 @@
+/*
+ * The MIT License
+ *
+ * Copyright (c) 2013 Rakesh D Nair
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+*/
+
+#ifndef _TEST_IMAGE_H_
+#define _TEST_IMAGE_H_
+
+/*
+ * Synthetic target memory for the unwinder tests: code at TEST_CODE_BASE
+ * and a stack ending at TEST_STACK_TOP, both read through a
+ * bt_mem_reader_t. Anything else reads as not captured.
+ */
+
+#include "arm_btrace.h"
+
+#define TEST_CODE_BASE    0x00008000
+#define TEST_CODE_WORDS   0x1000
+#define TEST_STACK_TOP    0x20010000
+#define TEST_STACK_WORDS  0x1000
+#define TEST_STACK_BASE   (TEST_STACK_TOP - (TEST_STACK_WORDS << 2))
+
+/*a few ARM encodings used to lay out functions*/
+#define ARM_NOP               0xE1A00000                          /* mov r0, r0           */
+#define ARM_BL(_from, _to)    (0xEB000000 | ((((_to) - (_from) - 8) >> 2) & 0x00FFFFFF))
+#define ARM_PUSH(_mask)       (0xE92D0000 | (_mask))              /* push {mask}          */
+#define ARM_SUB_SP(_imm12)    (0xE24DD000 | (_imm12))             /* sub sp, sp, #imm12   */
+#define ARM_ADD_FP_SP(_imm)   (0xE28DB000 | (_imm))               /* add fp, sp, #imm     */
+
+typedef struct TestImage {
+	bt_uint32_t code[TEST_CODE_WORDS];
+	bt_uint32_t stack[TEST_STACK_WORDS];
+	bt_mem_reader_t reader;
+} test_image_t;
+
+/*fills code with NOPs and the stack with a pattern*/
+extern void test_image_init( test_image_t* image );
+
+extern void test_code( test_image_t* image, bt_uint32_t addr, bt_uint32_t opcode );
+
+extern void test_stack( test_image_t* image, bt_uint32_t addr, bt_uint32_t value );
+
+/* unwinds frame with engine into pcs, returns number of frames and sets
+ * *stopReason*/
+extern int test_unwind( test_image_t* image, const bt_stackframe_t* frame, int engine,
+                        bt_uint32_t* pcs, int maxFrames, int* stopReason );
+
+#endif /*_TEST_IMAGE_H_*/
@@ -0,0 +1,188 @@
+/*
+ * The MIT License
+ *
+ * Copyright (c) 2013 Rakesh D Nair
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+/*
+ * Log ring: a ring filled to exactly BTRACE_LOG_SLOTS lines drains every
+ * line, the full ring policies drop or replace lines, and lines drained
+ * while another thread overwrites the ring are never torn.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "bt_test.h"
+#include "btrace_log.h"
+
+#define WRITER_LINES  200000
+
+static char lines[BTRACE_LOG_SLOTS * 2][BTRACE_LOG_LINE_SIZE];
+static int num_lines;
+static volatile int writer_done;
+static int torn;
+
+static int collect(char* line)
+{
+	if(num_lines < BTRACE_LOG_SLOTS * 2)
+	{
+		strcpy(lines[num_lines], line);
+	}
+	++num_lines;
+	return 0;
+}
+
+static void write_lines(int first, int count)
+{
+	char line[BTRACE_LOG_LINE_SIZE];
+	int index;
+
+	for(index = first; index < first + count; ++index)
+	{
+		sprintf(line, "line %d", index);
+		btrace_log_write(line);
+	}
+}
+
+static int expect_lines(int first, int count)
+{
+	char line[BTRACE_LOG_LINE_SIZE];
+	int index;
+
+	if(num_lines != count)
+	{
+		return 0;
+	}
+	for(index = 0; index < count; ++index)
+	{
+		sprintf(line, "line %d", first + index);
+		if(strcmp(lines[index], line))
+		{
+			return 0;
+		}
+	}
+	return 1;
+}
+
+static void test_full_ring(int policy)
+{
+	bt_log_stats_t stats;
+
+	btrace_log_init(policy);
+	write_lines(0, BTRACE_LOG_SLOTS);
+	num_lines = 0;
+	BT_CHECK_EQ(btrace_log_drain(collect, BTRACE_LOG_SLOTS * 2), BTRACE_LOG_SLOTS);
+	BT_CHECK(expect_lines(0, BTRACE_LOG_SLOTS));
+	btrace_log_get_stats(&stats);
+	BT_CHECK_EQ(stats.overwritten, 0);
+	BT_CHECK_EQ(stats.dropped, 0);
+	BT_CHECK_EQ(stats.max_used, BTRACE_LOG_SLOTS);
+}
+
+static void test_drop_newest(void)
+{
+	char line[] = "one too many";
+	bt_log_stats_t stats;
+
+	btrace_log_init(BT_LOG_DROP_NEWEST);
+	write_lines(0, BTRACE_LOG_SLOTS);
+	BT_CHECK_EQ(btrace_log_write(line), STOP_BTRACE);
+	num_lines = 0;
+	BT_CHECK_EQ(btrace_log_drain(collect, BTRACE_LOG_SLOTS * 2), BTRACE_LOG_SLOTS);
+	BT_CHECK(expect_lines(0, BTRACE_LOG_SLOTS));
+	btrace_log_get_stats(&stats);
+	BT_CHECK_EQ(stats.dropped, 1);
+}
+
+static void test_overwrite_oldest(void)
+{
+	bt_log_stats_t stats;
+
+	btrace_log_init(BT_LOG_OVERWRITE_OLDEST);
+	write_lines(0, BTRACE_LOG_SLOTS + 3);
+	num_lines = 0;
+	BT_CHECK_EQ(btrace_log_drain(collect, BTRACE_LOG_SLOTS * 2), BTRACE_LOG_SLOTS);
+	BT_CHECK(expect_lines(3, BTRACE_LOG_SLOTS));
+	btrace_log_get_stats(&stats);
+	BT_CHECK_EQ(stats.overwritten, 3);
+	BT_CHECK_EQ(stats.drained, BTRACE_LOG_SLOTS);
+}
+
+static void* writer_main(void* arg)
+{
+	char line[BTRACE_LOG_LINE_SIZE];
+	int index;
+
+	(void)arg;
+	for(index = 0; index < WRITER_LINES; ++index)
+	{   /*both halves of a line carry the same number*/
+		sprintf(line, "%08d %08d", index, index);
+		btrace_log_write(line);
+	}
+	writer_done = 1;
+	return 0;
+}
+
+static int check_line(char* line)
+{
+	int first, second;
+
+	if((sscanf(line, "%d %d", &first, &second) != 2) || (first != second))
+	{
+		++torn;
+	}
+	return 0;
+}
+
+static void test_concurrent_overwrite(void)
+{
+	pthread_t writer;
+	bt_log_stats_t stats;
+
+	btrace_log_init(BT_LOG_OVERWRITE_OLDEST);
+	writer_done = 0;
+	torn = 0;
+	pthread_create(&writer, 0, writer_main, 0);
+	while(!writer_done)
+	{
+		btrace_log_drain(check_line, 1);
+	}
+	pthread_join(writer, 0);
+	while(btrace_log_drain(check_line, BTRACE_LOG_SLOTS))
+	{
+	}
+	btrace_log_get_stats(&stats);
+	BT_CHECK_EQ(torn, 0);
+	BT_CHECK_EQ(stats.drained + stats.overwritten, WRITER_LINES);
+}
+
+int main(void)
+{
+	test_full_ring(BT_LOG_DROP_NEWEST);
+	test_full_ring(BT_LOG_OVERWRITE_OLDEST);
+	test_drop_newest();
+	test_overwrite_oldest();
+	test_concurrent_overwrite();
+	BT_TEST_EXIT("test_log");
+}
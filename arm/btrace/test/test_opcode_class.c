@@ -0,0 +1,107 @@
+/*
+ * The MIT License
+ *
+ * Copyright (c) 2013 Rakesh D Nair
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+/*
+ * Opcode classification of the prologue scanner: the class table must
+ * agree with the IS_xxx macros it was built from for whole opcodes, and
+ * SP adjustments with rotated immediates must be undone in full.
+ */
+
+#include "arm_defs.h"
+#include "bt_test.h"
+#include "test_image.h"
+
+static const bt_uint8_t class_table[256] = { OPCODE_CLASS_256 };
+
+static bt_uint32_t macro_class(bt_uint32_t opcode)
+{
+	return (IS_ADD(opcode)         ? OPCODE_CLASS_ADD     : 0) |
+	       (IS_SUB(opcode)         ? OPCODE_CLASS_SUB     : 0) |
+	       (IS_SINGLE_DATA(opcode) ? OPCODE_CLASS_SINGLE  : 0) |
+	       (IS_BLOCK_DATA(opcode)  ? OPCODE_CLASS_BLOCK   : 0) |
+	       (IS_LDC_STC(opcode)     ? OPCODE_CLASS_LDC_STC : 0);
+}
+
+static void test_class_table(void)
+{
+	bt_uint32_t seed = 0x12345678;
+	int i, mismatches = 0;
+
+	/*the table only sees bits 27:20, the macros see the whole word*/
+	for(i = 0; i < 0x100000; ++i)
+	{
+		seed ^= seed << 13;
+		seed ^= seed >> 17;
+		seed ^= seed << 5;
+		if(class_table[OPCODE_CLASS_INDEX(seed)] != macro_class(seed))
+		{
+			++mismatches;
+		}
+	}
+	BT_CHECK_EQ(mismatches, 0);
+	BT_CHECK_EQ(class_table[OPCODE_CLASS_INDEX(ARM_PUSH(0x4010))], OPCODE_CLASS_BLOCK);
+	BT_CHECK(class_table[OPCODE_CLASS_INDEX(ARM_SUB_SP(0))] & OPCODE_CLASS_SUB);
+}
+
+static void test_rotated_immediate(void)
+{
+	static test_image_t image;
+	bt_stackframe_t frame;
+	bt_uint32_t pcs[4];
+	bt_uint32_t caller = TEST_CODE_BASE, callee = TEST_CODE_BASE + 0x100;
+	bt_uint32_t caller_sp = TEST_STACK_TOP - 8 - 0x400;
+	int frames, stop;
+
+	BT_CHECK_EQ(GET_ROTATED_IMMEDIATE(0xE24DDB01), 0x400);
+	BT_CHECK_EQ(GET_ROTATED_IMMEDIATE(0xE24DDF40), 0x100);
+	BT_CHECK_EQ(GET_ROTATED_IMMEDIATE(0xE24DD010), 0x10);
+
+	/* caller: push {r4, lr}; sub sp, sp, #0x400; bl callee
+	 * callee: push {r4, lr}; nop <- pc*/
+	test_image_init(&image);
+	test_code(&image, caller, ARM_PUSH(0x4010));
+	test_code(&image, caller + 4, 0xE24DDB01);
+	test_code(&image, caller + 8, ARM_BL(caller + 8, callee));
+	test_code(&image, callee, ARM_PUSH(0x4010));
+	test_stack(&image, TEST_STACK_TOP - 4, 0);            /* caller's LR, entry function */
+	test_stack(&image, caller_sp - 4, caller + 12);       /* callee's LR                 */
+
+	frame.pc = callee + 4;
+	frame.sp = caller_sp - 8;
+	frame.lr = caller + 12;
+	frame.fp = 0;
+	frames = test_unwind(&image, &frame, BT_ENGINE_SCAN, pcs, 4, &stop);
+	BT_CHECK_EQ(frames, 2);
+	BT_CHECK_EQ(pcs[0], callee + 4);
+	BT_CHECK_EQ(pcs[1], caller + 8);
+	BT_CHECK_EQ(stop, BT_STOP_END_OF_STACK);
+}
+
+int main(void)
+{
+	test_class_table();
+	test_rotated_immediate();
+	BT_TEST_EXIT("test_opcode_class");
+}
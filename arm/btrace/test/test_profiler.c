@@ -0,0 +1,221 @@
+/*
+ * The MIT License
+ *
+ * Copyright (c) 2013 Rakesh D Nair
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+/*
+ * Sampling profiler: samples go through the single producer / single
+ * consumer ring and come out of btrace_profiler_drain as collapsed stacks
+ * with identical stacks merged, including when the ring overflows, the
+ * merge table fills and the print function stops the drain. Taking a
+ * sample leaves the state of btrace_callstack alone.
+ */
+
+#include <string.h>
+
+#include "bt_test.h"
+#include "test_image.h"
+#include "btrace_profiler.h"
+
+#define FN_MAIN   (TEST_CODE_BASE)
+#define FN_WORK   (TEST_CODE_BASE + 0x100)
+#define FN_LEAF   (TEST_CODE_BASE + 0x200)
+
+static test_image_t image;
+static char printed[4096];
+static int printed_lines;
+static int stop_after;
+
+static int print_collapsed(char* line)
+{
+	strcat(printed, line);
+	++printed_lines;
+	return (printed_lines == stop_after) ? STOP_BTRACE : 0;
+}
+
+static void reset_output(int stopAfter)
+{
+	printed[0] = 0;
+	printed_lines = 0;
+	stop_after = stopAfter;
+}
+
+/* main: push {r4, lr}; bl work
+ * work: push {r4, lr}; bl leaf; nop...
+ * leaf: push {r4, lr}; nop...
+ * main is the entry function, its saved LR is 0.*/
+static void build_image(void)
+{
+	test_image_init(&image);
+	test_code(&image, FN_MAIN, ARM_PUSH(0x4010));
+	test_code(&image, FN_MAIN + 4, ARM_BL(FN_MAIN + 4, FN_WORK));
+	test_code(&image, FN_WORK, ARM_PUSH(0x4010));
+	test_code(&image, FN_WORK + 4, ARM_BL(FN_WORK + 4, FN_LEAF));
+	test_code(&image, FN_LEAF, ARM_PUSH(0x4010));
+	test_stack(&image, TEST_STACK_TOP - 4, 0);
+	test_stack(&image, TEST_STACK_TOP - 12, FN_MAIN + 8);
+	test_stack(&image, TEST_STACK_TOP - 20, FN_WORK + 8);
+}
+
+/*interrupted in work at pc, or in leaf if inLeaf*/
+static void sample(bt_uint32_t pc, int inLeaf)
+{
+	bt_stackframe_t frame;
+
+	frame.fp = 0;
+	frame.pc = pc;
+	frame.sp = inLeaf ? TEST_STACK_TOP - 24 : TEST_STACK_TOP - 16;
+	frame.lr = inLeaf ? FN_WORK + 8 : FN_MAIN + 8;
+	btrace_profiler_sample(&frame);
+}
+
+static void test_merge(void)
+{
+	bt_profiler_stats_t stats;
+
+	btrace_profiler_init(0);
+	btrace_profiler_start();
+	sample(FN_WORK + 4, 0);
+	sample(FN_LEAF + 4, 1);
+	sample(FN_WORK + 4, 0);
+	sample(FN_WORK + 4, 0);
+	sample(FN_LEAF + 4, 1);
+	sample(FN_WORK + 4, 0);
+
+	reset_output(0);
+	BT_CHECK_EQ(btrace_profiler_drain(print_collapsed, 100), 6);
+	BT_CHECK(!strcmp(printed, "8004;8104 4\n8004;8104;8204 2\n"));
+	BT_CHECK_EQ(btrace_profiler_drain(print_collapsed, 100), 0);
+	BT_CHECK_EQ(printed_lines, 2);
+
+	btrace_profiler_get_stats(&stats);
+	BT_CHECK_EQ(stats.samples, 6);
+	BT_CHECK_EQ(stats.drained, 6);
+	BT_CHECK_EQ(stats.dropped, 0);
+
+	/*stopped profiler does not sample*/
+	btrace_profiler_stop();
+	sample(FN_WORK + 4, 0);
+	BT_CHECK_EQ(btrace_profiler_drain(print_collapsed, 100), 0);
+}
+
+static void test_ring_full(void)
+{
+	bt_profiler_stats_t stats;
+	int i;
+
+	btrace_profiler_init(0);
+	btrace_profiler_start();
+	for(i = 0; i < BTRACE_PROFILER_SLOTS + 5; ++i)
+	{
+		sample(FN_WORK + 4, 0);
+	}
+	btrace_profiler_get_stats(&stats);
+	BT_CHECK_EQ(stats.samples, BTRACE_PROFILER_SLOTS);
+	BT_CHECK_EQ(stats.dropped, 5);
+
+	/*maxSamples limits the samples taken, not the lines*/
+	reset_output(0);
+	BT_CHECK_EQ(btrace_profiler_drain(print_collapsed, 10), 10);
+	BT_CHECK(!strcmp(printed, "8004;8104 10\n"));
+
+	/*a slot freed by the drain is used again*/
+	sample(FN_LEAF + 4, 1);
+	reset_output(0);
+	BT_CHECK_EQ(btrace_profiler_drain(print_collapsed, 1000), BTRACE_PROFILER_SLOTS - 9);
+	sprintf(printed + 512, "8004;8104 %d\n8004;8104;8204 1\n", BTRACE_PROFILER_SLOTS - 10);
+	BT_CHECK(!strcmp(printed, printed + 512));
+}
+
+static void test_merge_table_full(void)
+{
+	char expected[1024];
+	char* out = expected;
+	int i;
+
+	/*more distinct stacks than the merge table holds*/
+	btrace_profiler_init(0);
+	btrace_profiler_start();
+	for(i = 0; i < BTRACE_PROFILER_MERGE + 4; ++i)
+	{
+		sample(FN_WORK + 8 + 4 * i, 0);
+		out += sprintf(out, "8004;%x 1\n", FN_WORK + 8 + 4 * i);
+	}
+	reset_output(0);
+	BT_CHECK_EQ(btrace_profiler_drain(print_collapsed, 100), BTRACE_PROFILER_MERGE + 4);
+	BT_CHECK(!strcmp(printed, expected));
+}
+
+static void test_print_stopped(void)
+{
+	btrace_profiler_init(0);
+	btrace_profiler_start();
+	sample(FN_WORK + 4, 0);
+	sample(FN_LEAF + 4, 1);
+
+	/*the second stack is kept for the next drain*/
+	reset_output(1);
+	BT_CHECK_EQ(btrace_profiler_drain(print_collapsed, 100), 2);
+	BT_CHECK(!strcmp(printed, "8004;8104 1\n"));
+	reset_output(0);
+	BT_CHECK_EQ(btrace_profiler_drain(print_collapsed, 100), 0);
+	BT_CHECK(!strcmp(printed, "8004;8104;8204 1\n"));
+}
+
+static void test_trace_untouched(void)
+{
+	bt_frame_record_t records[4];
+	bt_stackframe_t frame;
+
+	/*a trace stopped after one frame, then sampled in the middle of it*/
+	frame.fp = 0;
+	frame.pc = FN_LEAF + 4;
+	frame.sp = TEST_STACK_TOP - 24;
+	frame.lr = FN_WORK + 8;
+	btrace_set_record_buffer(records, 4);
+	btrace_callstack_frame(&frame, 0, 1);
+
+	btrace_profiler_init(0);
+	btrace_profiler_start();
+	sample(FN_WORK + 4, 0);
+	btrace_profiler_stop();
+
+	BT_CHECK_EQ(btrace_get_record_count(), 1);
+	BT_CHECK_EQ(btrace_last_stop_reason(), BT_STOP_MAX_FRAMES);
+	btrace_set_record_buffer(0, 0);
+}
+
+int main(void)
+{
+	build_image();
+	btrace_set_mem_reader(&image.reader);
+
+	test_merge();
+	test_ring_full();
+	test_merge_table_full();
+	test_print_stopped();
+	test_trace_untouched();
+
+	btrace_set_mem_reader(0);
+	BT_TEST_EXIT("test_profiler");
+}
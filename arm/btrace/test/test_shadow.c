@@ -0,0 +1,295 @@
+/*
+ * The MIT License
+ *
+ * Copyright (c) 2013 Rakesh D Nair
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+/*
+ * Shadow call stack: the hooks keep enters and exits balanced, calls
+ * nested deeper than BTRACE_SHADOW_DEPTH are counted as overflow, a trace
+ * ends with MAX_FRAMES or END_OF_STACK as btrace_unwind would, thumb
+ * return addresses give the BL or BLX that made the call, and
+ * btrace_shadow_switch moves the hooks to another stack. The hooks are
+ * called directly with made up call sites, nothing here is instrumented.
+ */
+
+#include <string.h>
+
+#include "bt_test.h"
+#include "test_image.h"
+#include "btrace_shadow.h"
+
+#define FN_MAIN    (TEST_CODE_BASE)
+#define FN_WORK    (TEST_CODE_BASE + 0x100)
+#define FN_THUMB   (TEST_CODE_BASE + 0x1000)
+
+#define THUMB_BL0         0xF800F000 /* bl . + 4 */
+#define THUMB_BLX_R3      0x4798
+#define THUMB_NOP         0xBF00
+
+static test_image_t image;
+static char printed[1024];
+static char printBuffer[BTRACE_PRINT_BUFFER_SIZE];
+static int stopAt;
+static bt_uint32_t callbackPcs[8];
+static int callbackSpHighSet;
+
+static void enter(bt_uint32_t returnAddr)
+{
+	__cyg_profile_func_enter(0, (void*)(unsigned long)returnAddr);
+}
+
+static void leave(bt_uint32_t returnAddr)
+{
+	__cyg_profile_func_exit(0, (void*)(unsigned long)returnAddr);
+}
+
+static int print_frame(char* line)
+{
+	strcat(printed, line);
+	return 0;
+}
+
+static int collect_frame(int frameIndex, bt_stackframe_t* frame, bt_uint32_t* spHigh)
+{
+	if(frameIndex < 8)
+	{
+		callbackPcs[frameIndex] = frame->pc;
+	}
+	if(spHigh)
+	{
+		++callbackSpHighSet;
+	}
+	return (frameIndex == stopAt) ? STOP_BTRACE : 0;
+}
+
+/* main: bl work  (ARM)
+ * work: bl ..    (ARM)
+ * thumb code: bl at FN_THUMB, blx r3 at FN_THUMB + 0x10 and + 0x16*/
+static void build_image(void)
+{
+	test_image_init(&image);
+	test_code(&image, FN_MAIN + 4, ARM_BL(FN_MAIN + 4, FN_WORK));
+	test_code(&image, FN_THUMB, THUMB_BL0);
+	test_code(&image, FN_THUMB + 0x10, (THUMB_NOP << 16) | THUMB_BLX_R3);
+	test_code(&image, FN_THUMB + 0x14, (THUMB_BLX_R3 << 16) | THUMB_NOP);
+}
+
+static int unwind(int maxFrames, bt_frame_record_t* records, int maxRecords)
+{
+	bt_unwind_ctx_t ctx;
+	int frameCount;
+
+	btrace_init_context(&ctx);
+	ctx.max_frames = maxFrames;
+	ctx.callback_fn = records ? 0 : collect_frame;
+	ctx.records = records;
+	ctx.max_records = maxRecords;
+	frameCount = btrace_shadow_unwind(&ctx);
+	BT_CHECK(!records || (ctx.num_records == ((frameCount < maxRecords) ? frameCount : maxRecords)));
+	return frameCount | (ctx.stop_reason << 16);
+}
+
+#define FRAMES(_ret)   ((_ret) & 0xFFFF)
+#define REASON(_ret)   ((_ret) >> 16)
+
+static void test_balance(void)
+{
+	bt_shadow_stack_t* stack = btrace_shadow_switch(0);
+	bt_uint32_t pcs[4];
+
+	BT_CHECK_EQ(stack->depth, 0);
+	enter(FN_MAIN + 8);
+	enter(FN_WORK + 8);
+	BT_CHECK_EQ(stack->depth, 2);
+	BT_CHECK_EQ(stack->sites[0], FN_MAIN + 8);
+	BT_CHECK_EQ(stack->sites[1], FN_WORK + 8);
+
+	/*pcs[0] is this call, then the calls innermost first*/
+	BT_CHECK_EQ(btrace_shadow_capture(pcs, 4), 3);
+	BT_CHECK_EQ(pcs[1], FN_WORK + 4);
+	BT_CHECK_EQ(pcs[2], FN_MAIN + 4);
+	BT_CHECK_EQ(btrace_shadow_capture(pcs, 2), 2);
+
+	leave(FN_WORK + 8);
+	leave(FN_MAIN + 8);
+	BT_CHECK_EQ(stack->depth, 0);
+	BT_CHECK_EQ(stack->max_depth, 2);
+
+	/*an exit without an enter leaves the stack empty*/
+	leave(FN_MAIN + 8);
+	BT_CHECK_EQ(stack->depth, 0);
+}
+
+static void test_overflow(void)
+{
+	bt_shadow_stack_t* stack = btrace_shadow_switch(0);
+	bt_frame_record_t records[BTRACE_SHADOW_DEPTH + 4];
+	int index, ret;
+
+	for(index = 0; index < BTRACE_SHADOW_DEPTH + 2; ++index)
+	{
+		enter(FN_MAIN + 8 + (index << 4));
+	}
+	BT_CHECK_EQ(stack->depth, BTRACE_SHADOW_DEPTH + 2);
+	BT_CHECK_EQ(stack->overflow, 2);
+	BT_CHECK_EQ(stack->max_depth, BTRACE_SHADOW_DEPTH + 2);
+
+	/*only the recorded calls are traced, the innermost are missing*/
+	ret = unwind(BTRACE_SHADOW_DEPTH + 4, records, BTRACE_SHADOW_DEPTH + 4);
+	BT_CHECK_EQ(FRAMES(ret), BTRACE_SHADOW_DEPTH + 1);
+	BT_CHECK_EQ(REASON(ret), BT_STOP_END_OF_STACK);
+	BT_CHECK_EQ(records[1].pc, FN_MAIN + 4 + ((BTRACE_SHADOW_DEPTH - 1) << 4));
+	BT_CHECK_EQ(records[BTRACE_SHADOW_DEPTH].pc, FN_MAIN + 4);
+
+	for(index = 0; index < BTRACE_SHADOW_DEPTH + 2; ++index)
+	{
+		leave(FN_MAIN + 8);
+	}
+	BT_CHECK_EQ(stack->depth, 0);
+	BT_CHECK_EQ(stack->overflow, 2);
+}
+
+static void test_stop_reasons(void)
+{
+	bt_frame_record_t records[4];
+	int ret;
+
+	enter(FN_MAIN + 8);
+	enter(FN_WORK + 8);
+
+	/*3 frames: this call, work and main*/
+	ret = unwind(4, records, 4);
+	BT_CHECK_EQ(FRAMES(ret), 3);
+	BT_CHECK_EQ(REASON(ret), BT_STOP_END_OF_STACK);
+	BT_CHECK_EQ(records[1].pc, FN_WORK + 4);
+	BT_CHECK_EQ(records[1].flags, BT_RECORD_VALID);
+	BT_CHECK_EQ(records[3].flags, 0);
+
+	ret = unwind(3, records, 4);
+	BT_CHECK_EQ(FRAMES(ret), 3);
+	BT_CHECK_EQ(REASON(ret), BT_STOP_END_OF_STACK);
+
+	ret = unwind(2, records, 4);
+	BT_CHECK_EQ(FRAMES(ret), 2);
+	BT_CHECK_EQ(REASON(ret), BT_STOP_MAX_FRAMES);
+
+	/*more frames than records*/
+	ret = unwind(4, records, 2);
+	BT_CHECK_EQ(FRAMES(ret), 3);
+	BT_CHECK_EQ(REASON(ret), BT_STOP_CALLBACK);
+
+	stopAt = 1;
+	callbackSpHighSet = 0;
+	ret = unwind(4, 0, 0);
+	BT_CHECK_EQ(FRAMES(ret), 2);
+	BT_CHECK_EQ(REASON(ret), BT_STOP_CALLBACK);
+	BT_CHECK_EQ(callbackPcs[1], FN_WORK + 4);
+	BT_CHECK_EQ(callbackSpHighSet, 0);
+
+	stopAt = -1;
+	ret = unwind(4, 0, 0);
+	BT_CHECK_EQ(FRAMES(ret), 3);
+	BT_CHECK_EQ(callbackPcs[2], FN_MAIN + 4);
+
+	leave(FN_WORK + 8);
+	leave(FN_MAIN + 8);
+}
+
+static void test_print(void)
+{
+	bt_unwind_ctx_t ctx;
+
+	enter(FN_MAIN + 8);
+	btrace_init_context(&ctx);
+	ctx.max_frames = 4;
+	ctx.print_fn = print_frame;
+	ctx.print_buffer = printBuffer;
+	printed[0] = 0;
+	BT_CHECK_EQ(btrace_shadow_unwind(&ctx), 2);
+	BT_CHECK(strstr(printed, "#01: PC= 8004\n") != 0);
+	leave(FN_MAIN + 8);
+}
+
+static void test_thumb(void)
+{
+	bt_uint32_t pcs[4];
+
+	/*return addresses of thumb calls have bit 0 set*/
+	enter(FN_THUMB + 0x04 + 1);
+	enter(FN_THUMB + 0x12 + 1);
+	enter(FN_THUMB + 0x18 + 1);
+	BT_CHECK_EQ(btrace_shadow_capture(pcs, 4), 4);
+	BT_CHECK_EQ(pcs[1], FN_THUMB + 0x16);
+	BT_CHECK_EQ(pcs[2], FN_THUMB + 0x10);
+	BT_CHECK_EQ(pcs[3], FN_THUMB);
+	leave(0);
+	leave(0);
+	leave(0);
+
+	BT_CHECK_EQ(btrace_call_site(&image.reader, FN_THUMB + 0x12 + 1), FN_THUMB + 0x10);
+	BT_CHECK_EQ(btrace_call_site(&image.reader, FN_THUMB + 0x04 + 1), FN_THUMB);
+	BT_CHECK_EQ(btrace_call_site(&image.reader, FN_MAIN + 8), FN_MAIN + 4);
+}
+
+static void test_switch(void)
+{
+	bt_shadow_stack_t* defaultStack = btrace_shadow_switch(0);
+	bt_shadow_stack_t task;
+	bt_uint32_t pcs[4];
+
+	btrace_shadow_init(&task);
+	enter(FN_MAIN + 8);
+
+	BT_CHECK(btrace_shadow_switch(&task) == defaultStack);
+	BT_CHECK_EQ(btrace_shadow_capture(pcs, 4), 1);
+	enter(FN_WORK + 8);
+	BT_CHECK_EQ(task.depth, 1);
+	BT_CHECK_EQ(task.sites[0], FN_WORK + 8);
+	BT_CHECK_EQ(defaultStack->depth, 1);
+	BT_CHECK_EQ(btrace_shadow_capture(pcs, 4), 2);
+	BT_CHECK_EQ(pcs[1], FN_WORK + 4);
+
+	/*back on the default stack, the task keeps its calls*/
+	BT_CHECK(btrace_shadow_switch(0) == &task);
+	BT_CHECK_EQ(btrace_shadow_capture(pcs, 4), 2);
+	BT_CHECK_EQ(pcs[1], FN_MAIN + 4);
+	leave(FN_MAIN + 8);
+	BT_CHECK_EQ(defaultStack->depth, 0);
+	BT_CHECK_EQ(task.depth, 1);
+}
+
+int main(void)
+{
+	build_image();
+	btrace_set_mem_reader(&image.reader);
+
+	test_balance();
+	test_overflow();
+	test_stop_reasons();
+	test_print();
+	test_thumb();
+	test_switch();
+
+	btrace_set_mem_reader(0);
+	BT_TEST_EXIT("test_shadow");
+}
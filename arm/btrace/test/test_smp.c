@@ -0,0 +1,145 @@
+/*
+ * The MIT License
+ *
+ * Copyright (c) 2013 Rakesh D Nair
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+/*
+ * Per core slots of the SMP build (BTRACE_NUM_CPUS = 4, see makefile):
+ * the index the exception handler derives from MPIDR, the hook entry it
+ * returns to, the slot exceptionTraceCallstackCpu traces for that core
+ * and the record count and stop reason it keeps for the core.
+ */
+
+#include <string.h>
+
+#include "bt_test.h"
+#include "test_image.h"
+
+#define FN_MAIN   (TEST_CODE_BASE)
+#define FN_WORK   (TEST_CODE_BASE + 0x100)
+#define FN_LEAF   (TEST_CODE_BASE + 0x200)
+
+#define SLICE     4
+
+extern bt_stackframe_t Exception_CpuStackFrame[BTRACE_NUM_CPUS];
+extern int exceptionTraceCallstackCpu(int cpu);
+
+static test_image_t image;
+static int exception_cpu;
+static const bt_stackframe_t* exception_frame;
+
+/* main: push {r4, lr}; bl work
+ * work: push {r4, lr}; bl leaf
+ * leaf: push {r4, lr}; nop <- core 2 stopped here*/
+static void build_image(void)
+{
+	test_image_init(&image);
+	test_code(&image, FN_MAIN, ARM_PUSH(0x4010));
+	test_code(&image, FN_MAIN + 4, ARM_BL(FN_MAIN + 4, FN_WORK));
+	test_code(&image, FN_WORK, ARM_PUSH(0x4010));
+	test_code(&image, FN_WORK + 4, ARM_BL(FN_WORK + 4, FN_LEAF));
+	test_code(&image, FN_LEAF, ARM_PUSH(0x4010));
+	test_stack(&image, TEST_STACK_TOP - 4, 0);
+	test_stack(&image, TEST_STACK_TOP - 12, FN_MAIN + 8);
+	test_stack(&image, TEST_STACK_TOP - 20, FN_WORK + 8);
+}
+
+static void exception_fn(int cpu, const bt_stackframe_t* frame)
+{
+	exception_cpu = cpu;
+	exception_frame = frame;
+}
+
+static void test_cpu_index(void)
+{
+	BT_CHECK_EQ(BTRACE_CPU_INDEX(0x80000000), 0);
+	BT_CHECK_EQ(BTRACE_CPU_INDEX(0x80000001), 1);
+	BT_CHECK_EQ(BTRACE_CPU_INDEX(0x80000003), 3);
+	/*only affinity level 0 selects the slot*/
+	BT_CHECK_EQ(BTRACE_CPU_INDEX(0x80000102), 2);
+	/*out of range cores share the slots of core 0*/
+	BT_CHECK_EQ(BTRACE_CPU_INDEX(0x80000004), 0);
+	BT_CHECK_EQ(BTRACE_CPU_INDEX(0x800000FF), 0);
+}
+
+static void test_hook_entry(void)
+{
+	BT_CHECK_EQ(BTRACE_HOOK_ENTRY(0x8000, 0), 0x8000);
+	BT_CHECK_EQ(BTRACE_HOOK_ENTRY(0x8000, 1), 0x8008);
+	BT_CHECK_EQ(BTRACE_HOOK_ENTRY(0x8000, BTRACE_CPU_INDEX(0x80000003)), 0x8018);
+}
+
+static void test_record_slice(void)
+{
+	bt_frame_record_t records[BTRACE_NUM_CPUS * SLICE];
+	int index;
+
+	memset(records, 0, sizeof(records));
+	memset(Exception_CpuStackFrame, 0, sizeof(Exception_CpuStackFrame));
+	Exception_CpuStackFrame[2].pc = FN_LEAF + 4;
+	Exception_CpuStackFrame[2].sp = TEST_STACK_TOP - 24;
+	Exception_CpuStackFrame[2].lr = FN_WORK + 8;
+
+	btrace_set_mem_reader(&image.reader);
+	btrace_set_print_fn(0, SLICE);
+	btrace_set_record_buffer(records, BTRACE_NUM_CPUS * SLICE);
+	BT_CHECK_EQ(exceptionTraceCallstackCpu(2), 2);
+	btrace_set_record_buffer(0, 0);
+
+	BT_CHECK_EQ(records[2 * SLICE].pc, FN_LEAF + 4);
+	BT_CHECK_EQ(records[2 * SLICE + 1].pc, FN_WORK + 4);
+	BT_CHECK_EQ(records[2 * SLICE + 2].pc, FN_MAIN + 4);
+	BT_CHECK_EQ(records[2 * SLICE + 3].flags, 0);
+	BT_CHECK_EQ(btrace_get_cpu_record_count(2), 3);
+	BT_CHECK_EQ(btrace_cpu_stop_reason(2), BT_STOP_END_OF_STACK);
+	BT_CHECK_EQ(btrace_get_cpu_record_count(1), 0);
+	BT_CHECK_EQ(btrace_get_cpu_record_count(BTRACE_NUM_CPUS), 0);
+	/*the slices of the other cores are left alone*/
+	for(index = 0; index < BTRACE_NUM_CPUS * SLICE; ++index)
+	{
+		if((index / SLICE) != 2)
+		{
+			BT_CHECK_EQ(records[index].flags, 0);
+		}
+	}
+}
+
+static void test_exception_fn(void)
+{
+	btrace_set_exception_fn(exception_fn);
+	BT_CHECK_EQ(exceptionTraceCallstackCpu(3), 3);
+	btrace_set_exception_fn(0);
+
+	BT_CHECK_EQ(exception_cpu, 3);
+	BT_CHECK(exception_frame == &Exception_CpuStackFrame[3]);
+}
+
+int main(void)
+{
+	build_image();
+	test_cpu_index();
+	test_hook_entry();
+	test_record_slice();
+	test_exception_fn();
+	BT_TEST_EXIT("test_smp");
+}
@@ -0,0 +1,169 @@
+/*
+ * The MIT License
+ *
+ * Copyright (c) 2013 Rakesh D Nair
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+/*
+ * Stop reasons and statistics of the unwinder (BTRACE_STATS = 1, see
+ * makefile): a frame reserved with a register operand stops the scanner
+ * with BT_STOP_SP_FROM_REG, a scan that leaves the code with
+ * BT_STOP_MEM_READ, and both are counted. BT_ENGINE_FP_SCAN takes such
+ * a frame from the FP chain instead.
+ */
+
+#include <string.h>
+
+#include "bt_test.h"
+#include "test_image.h"
+
+#define FN_MAIN   (TEST_CODE_BASE)
+#define FN_WORK   (TEST_CODE_BASE + 0x100)
+#define FN_LEAF   (TEST_CODE_BASE + 0x200)
+
+#define ARM_SUB_SP_R0   0xE04DD000  /* sub sp, sp, r0 */
+
+static test_image_t image;
+
+/* main: push {r4, lr}; bl work
+ * work: push {r4, lr}; nop; sub sp, sp, r0; bl leaf
+ * leaf: push {r4, lr}; nop <- stopped here*/
+static void build_image(void)
+{
+	test_image_init(&image);
+	test_code(&image, FN_MAIN, ARM_PUSH(0x4010));
+	test_code(&image, FN_MAIN + 4, ARM_BL(FN_MAIN + 4, FN_WORK));
+	test_code(&image, FN_WORK, ARM_PUSH(0x4010));
+	test_code(&image, FN_WORK + 8, ARM_SUB_SP_R0);
+	test_code(&image, FN_WORK + 12, ARM_BL(FN_WORK + 12, FN_LEAF));
+	test_code(&image, FN_LEAF, ARM_PUSH(0x4010));
+	test_stack(&image, TEST_STACK_TOP - 4, 0);
+	test_stack(&image, TEST_STACK_TOP - 12, FN_MAIN + 8);
+	/*work reserved 8 bytes with r0*/
+	test_stack(&image, TEST_STACK_TOP - 28, FN_WORK + 16);
+}
+
+/* main: push {fp, lr}; add fp, sp, #4; bl work
+ * work: push {fp, lr}; add fp, sp, #4; sub sp, sp, r0; bl leaf
+ * leaf: push {fp, lr}; add fp, sp, #4; nop <- stopped here*/
+static void build_fp_image(void)
+{
+	test_image_init(&image);
+	test_code(&image, FN_MAIN, ARM_PUSH(0x4800));
+	test_code(&image, FN_MAIN + 4, ARM_ADD_FP_SP(4));
+	test_code(&image, FN_MAIN + 8, ARM_BL(FN_MAIN + 8, FN_WORK));
+	test_code(&image, FN_WORK, ARM_PUSH(0x4800));
+	test_code(&image, FN_WORK + 4, ARM_ADD_FP_SP(4));
+	test_code(&image, FN_WORK + 8, ARM_SUB_SP_R0);
+	test_code(&image, FN_WORK + 12, ARM_BL(FN_WORK + 12, FN_LEAF));
+	test_code(&image, FN_LEAF, ARM_PUSH(0x4800));
+	test_code(&image, FN_LEAF + 4, ARM_ADD_FP_SP(4));
+	test_stack(&image, TEST_STACK_TOP - 4, 0);
+	test_stack(&image, TEST_STACK_TOP - 8, 0);
+	test_stack(&image, TEST_STACK_TOP - 12, FN_MAIN + 12);
+	test_stack(&image, TEST_STACK_TOP - 16, TEST_STACK_TOP - 4);
+	/*work reserved 8 bytes with r0*/
+	test_stack(&image, TEST_STACK_TOP - 28, FN_WORK + 16);
+	test_stack(&image, TEST_STACK_TOP - 32, TEST_STACK_TOP - 12);
+}
+
+static void test_sp_from_reg(void)
+{
+	bt_stackframe_t frame;
+	bt_unwind_stats_t stats;
+	bt_uint32_t pcs[8];
+	int stop;
+
+	memset(&frame, 0, sizeof(frame));
+	frame.pc = FN_LEAF + 4;
+	frame.sp = TEST_STACK_TOP - 32;
+	frame.lr = FN_WORK + 16;
+
+	/*the frame of work cannot be sized, so it is not passed on. The
+	 *nop between the push and the sub must not hide the failure*/
+	build_image();
+	btrace_unwind_stats_reset();
+	BT_CHECK_EQ(test_unwind(&image, &frame, BT_ENGINE_SCAN, pcs, 8, &stop), 1);
+	BT_CHECK_EQ(stop, BT_STOP_SP_FROM_REG);
+	BT_CHECK_EQ(pcs[0], FN_LEAF + 4);
+
+	BT_CHECK_EQ(btrace_unwind_stats(&stats), 1);
+	BT_CHECK_EQ(stats.traces, 1);
+	BT_CHECK_EQ(stats.stop_reasons[BT_STOP_SP_FROM_REG], 1);
+	BT_CHECK_EQ(stats.stop_reasons[BT_STOP_END_OF_STACK], 0);
+}
+
+static void test_mem_read(void)
+{
+	bt_stackframe_t frame;
+	bt_unwind_stats_t stats;
+	bt_uint32_t pcs[8];
+	int stop;
+
+	/*no push between the code base and pc*/
+	test_image_init(&image);
+	memset(&frame, 0, sizeof(frame));
+	frame.pc = FN_MAIN + 0x80;
+	frame.sp = TEST_STACK_TOP - 32;
+
+	btrace_unwind_stats_reset();
+	BT_CHECK_EQ(test_unwind(&image, &frame, BT_ENGINE_SCAN, pcs, 8, &stop), 0);
+	BT_CHECK_EQ(stop, BT_STOP_MEM_READ);
+	btrace_unwind_stats(&stats);
+	BT_CHECK_EQ(stats.stop_reasons[BT_STOP_MEM_READ], 1);
+}
+
+static void test_fp_chain(void)
+{
+	bt_stackframe_t frame;
+	bt_unwind_stats_t stats;
+	bt_uint32_t pcs[8];
+	int stop;
+
+	build_fp_image();
+	frame.pc = FN_LEAF + 8;
+	frame.sp = TEST_STACK_TOP - 32;
+	frame.fp = TEST_STACK_TOP - 28;
+	frame.lr = FN_WORK + 16;
+
+	btrace_unwind_stats_reset();
+	BT_CHECK_EQ(test_unwind(&image, &frame, BT_ENGINE_SCAN, pcs, 8, &stop), 1);
+	BT_CHECK_EQ(stop, BT_STOP_SP_FROM_REG);
+	BT_CHECK_EQ(test_unwind(&image, &frame, BT_ENGINE_FP_SCAN, pcs, 8, &stop), 3);
+	BT_CHECK_EQ(stop, BT_STOP_END_OF_STACK);
+	BT_CHECK_EQ(pcs[1], FN_WORK + 12);
+	BT_CHECK_EQ(pcs[2], FN_MAIN + 8);
+
+	/*only work came from the chain, main saved an LR of 0*/
+	btrace_unwind_stats(&stats);
+	BT_CHECK_EQ(stats.traces, 2);
+	BT_CHECK_EQ(stats.fp_frames, 1);
+	BT_CHECK_EQ(stats.stop_reasons[BT_STOP_END_OF_STACK], 1);
+}
+
+int main(void)
+{
+	test_sp_from_reg();
+	test_mem_read();
+	test_fp_chain();
+	BT_TEST_EXIT("test_stats");
+}
@@ -0,0 +1,124 @@
+/*
+ * The MIT License
+ *
+ * Copyright (c) 2013 Rakesh D Nair
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+/*
+ * Window encoder limits: a buffer too short for the header and
+ * BT_WINDOW_END is refused by btrace_window_finish without writing past
+ * its end, and a frame that does not fit is left out whole.
+ */
+
+#include <string.h>
+
+#include "bt_test.h"
+#include "btrace_window.h"
+
+#define GUARD  0xA5
+#define TEXT_START  0x8000
+#define TEXT_END    0x9000
+
+static bt_uint8_t buffer[64];
+
+static int untouched(int from)
+{
+	int index;
+
+	for(index = from; index < (int)sizeof(buffer); ++index)
+	{
+		if(buffer[index] != GUARD)
+		{
+			return 0;
+		}
+	}
+	return 1;
+}
+
+static void frame_of(bt_stackframe_t* frame)
+{
+	frame->pc = TEXT_START + 0x104;
+	frame->sp = 0x20000000;
+	frame->lr = TEXT_START + 0x208;
+	frame->fp = 0;
+}
+
+static void test_short_buffer(void)
+{
+	bt_window_encoder_t enc;
+
+	memset(buffer, GUARD, sizeof(buffer));
+	btrace_window_init(&enc, buffer, 12, TEXT_START, TEXT_END);
+	BT_CHECK(btrace_window_finish(&enc) < 0);
+	BT_CHECK(untouched(12));
+
+	memset(buffer, GUARD, sizeof(buffer));
+	btrace_window_init(&enc, buffer, 0, TEXT_START, TEXT_END);
+	BT_CHECK(btrace_window_finish(&enc) < 0);
+	BT_CHECK(untouched(0));
+}
+
+static void test_header_only(void)
+{
+	bt_window_encoder_t enc;
+	bt_stackframe_t frame;
+	bt_uint32_t words[2] = { 0, 0 };
+
+	memset(buffer, GUARD, sizeof(buffer));
+	frame_of(&frame);
+	btrace_window_init(&enc, buffer, 13, TEXT_START, TEXT_END);
+	BT_CHECK(btrace_window_encode(&enc, 0, &frame, words, 2) < 0);
+	BT_CHECK_EQ(enc.dropped, 1);
+	BT_CHECK_EQ(enc.frames, 0);
+	BT_CHECK_EQ(btrace_window_finish(&enc), 13);
+	BT_CHECK_EQ(buffer[0], BT_WINDOW_MAGIC & 0xFF);
+	BT_CHECK_EQ(buffer[12], BT_WINDOW_END);
+	BT_CHECK(untouched(13));
+}
+
+static void test_frame(void)
+{
+	bt_window_encoder_t enc;
+	bt_stackframe_t frame;
+	bt_uint32_t words[6] = { 0, 0, 0, TEXT_START + 0x20C, 0x20000008, 0xFFFFFFFE };
+	int bytes, size;
+
+	memset(buffer, GUARD, sizeof(buffer));
+	frame_of(&frame);
+	btrace_window_init(&enc, buffer, sizeof(buffer), TEXT_START, TEXT_END);
+	bytes = btrace_window_encode(&enc, 0, &frame, words, 6);
+	BT_CHECK(bytes > 0);
+	BT_CHECK_EQ(enc.frames, 1);
+	BT_CHECK_EQ(buffer[12], BT_WINDOW_FRAME);
+	size = btrace_window_finish(&enc);
+	BT_CHECK_EQ(size, 12 + bytes + 1);
+	BT_CHECK_EQ(buffer[size - 1], BT_WINDOW_END);
+	BT_CHECK(untouched(size));
+}
+
+int main(void)
+{
+	test_short_buffer();
+	test_header_only();
+	test_frame();
+	BT_TEST_EXIT("test_window");
+}
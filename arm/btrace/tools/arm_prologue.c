@@ -0,0 +1,190 @@
+/*
+ * The MIT License
+ *
+ * Copyright (c) 2013 Rakesh D Nair
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#include "arm_defs.h"
+#include "arm_prologue.h"
+
+/*record the word slot (1 based, below the caller's SP) holding LR or FP*/
+static void save_slot(arm_prologue_t* prologue, int regid, unsigned int depth)
+{
+	if(regid == LR_ID)
+	{
+		prologue->lr_slot = depth >> 2;
+	}
+	else if(regid == FP_ID)
+	{
+		prologue->fp_slot = depth >> 2;
+	}
+}
+
+/*process one instruction, returns bytes pushed, 0 if SP is unchanged,
+ * -1 for a restore of SP and ARM_PROLOGUE_DYNAMIC_SP on error*/
+static int decode_instruction(Elf32_Word opcode, arm_prologue_t* prologue)
+{
+	unsigned int depth = prologue->sp_delta;
+
+	if(IS_SUB(opcode) || IS_ADD(opcode) || IS_MOV(opcode))
+	{
+		if(IS_MOV_DST_REG(opcode, SP_ID))
+		{
+			if(IS_SUB(opcode) && IS_OPERAND_REG(opcode, SP_ID))
+			{   /* sub sp, sp, #imm */
+				return IS_IMMEDIATE(opcode) ? (int)GET_ROTATED_IMMEDIATE(opcode) : ARM_PROLOGUE_DYNAMIC_SP;
+			}
+			/* add sp, sp, #imm; mov sp, fp; sub sp, fp, #imm ...*/
+			return -1;
+		}
+		if(IS_MOV_DST_REG(opcode, FP_ID) && IS_ADD(opcode) &&
+		   IS_OPERAND_REG(opcode, SP_ID) && IS_IMMEDIATE(opcode))
+		{   /* add fp, sp, #offset */
+			prologue->flags |= ARM_PROLOGUE_FP_FROM_SP;
+		}
+	}
+	else if(IS_SINGLE_DATA(opcode))
+	{
+		if(IS_LDST_DST_REG(opcode, SP_ID) && (IS_WRITE_BACK(opcode) || !IS_PRE_INDEX(opcode)))
+		{
+			if(IS_INCREMENT(opcode))
+			{   /* ldr rX, [sp], #4 */
+				return -1;
+			}
+			if(IS_IMMEDIATE(opcode))
+			{   /*register offset*/
+				return ARM_PROLOGUE_DYNAMIC_SP;
+			}
+			depth += opcode & 0xFFF;
+			if(!IS_LOAD(opcode) && IS_PRE_INDEX(opcode))
+			{   /* str rX, [sp, #-n]! */
+				save_slot(prologue, (opcode >> 12) & 0xF, depth);
+			}
+			return opcode & 0xFFF;
+		}
+	}
+	else if(IS_BLOCK_DATA(opcode))
+	{
+		if(IS_LDST_DST_REG(opcode, SP_ID) && IS_WRITE_BACK(opcode))
+		{
+			int regid, count = 0;
+			if(IS_INCREMENT(opcode))
+			{   /* pop */
+				return -1;
+			}
+			for(regid = R00_ID; regid <= PC_ID; ++regid)
+			{
+				count += (opcode >> regid) & 1;
+			}
+			/*lowest register is stored at the lowest address*/
+			depth += count << 2;
+			for(regid = R00_ID; regid <= PC_ID; ++regid)
+			{
+				if((opcode >> regid) & 1)
+				{
+					save_slot(prologue, regid, depth);
+					depth -= 4;
+				}
+			}
+			return count << 2;
+		}
+	}
+	else if(IS_LDC_STC(opcode))
+	{
+		if(IS_LDST_DST_REG(opcode, SP_ID) && IS_WRITE_BACK(opcode))
+		{   /* vpush, vpop */
+			return IS_INCREMENT(opcode) ? -1 : (int)(GET_IMMEDIATE_OPERAND(opcode) << 2);
+		}
+	}
+	return 0;
+}
+
+int arm_decode_prologue(const elf32_image_t* image, const elf32_function_t* fn, arm_prologue_t* prologue)
+{
+	Elf32_Addr addr;
+	int restored = 0;
+
+	prologue->sp_delta = 0;
+	prologue->prologue_words = 0;
+	prologue->lr_slot = 0;
+	prologue->fp_slot = 0;
+	prologue->flags = 0;
+
+	if(fn->thumb)
+	{
+		return ARM_PROLOGUE_THUMB;
+	}
+
+	for(addr = fn->start; addr + 4 <= fn->end; addr += 4)
+	{
+		Elf32_Word opcode;
+		unsigned int flags;
+		int delta;
+
+		if(elf32_is_data(image, addr))
+		{   /*literal pool*/
+			continue;
+		}
+		if(elf32_read_word(image, addr, &opcode) < 0)
+		{
+			return ARM_PROLOGUE_UNREADABLE;
+		}
+		flags = prologue->flags;
+		delta = decode_instruction(opcode, prologue);
+		if(restored)
+		{   /*flags of the epilogue are of no interest*/
+			prologue->flags = flags;
+		}
+
+		if(delta == ARM_PROLOGUE_DYNAMIC_SP)
+		{
+			return ARM_PROLOGUE_DYNAMIC_SP;
+		}
+		else if(delta < 0)
+		{
+			restored = 1;
+		}
+		else if(delta > 0)
+		{
+			if(restored)
+			{
+				return ARM_PROLOGUE_LATE_PUSH;
+			}
+			prologue->sp_delta += delta;
+			prologue->prologue_words = ((addr - fn->start) >> 2) + 1;
+		}
+	}
+	return 0;
+}
+
+const char* arm_prologue_error(int code)
+{
+	switch(code)
+	{
+		case 0:                       return "ok";
+		case ARM_PROLOGUE_THUMB:      return "thumb code";
+		case ARM_PROLOGUE_UNREADABLE: return "not in image";
+		case ARM_PROLOGUE_DYNAMIC_SP: return "dynamic stack adjustment";
+		case ARM_PROLOGUE_LATE_PUSH:  return "stack adjusted after restore";
+		default:                      return "unknown";
+	}
+}
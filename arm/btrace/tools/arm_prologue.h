@@ -0,0 +1,71 @@
+/*
+ * The MIT License
+ *
+ * Copyright (c) 2013 Rakesh D Nair
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef _ARM_PROLOGUE_H_
+#define _ARM_PROLOGUE_H_
+
+/*
+ * Forward decoder for ARM (not thumb) function prologues, shared by the
+ * host side btrace tools. It walks a function from its first instruction
+ * and records every change made to SP, using the same opcode helpers
+ * from arm_defs.h that the target side unwinder uses when walking back.
+ */
+
+#include "elf32_image.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*prologue has "add fp, sp, #offset"*/
+#define ARM_PROLOGUE_FP_FROM_SP    0x01
+
+/*failure codes returned by arm_decode_prologue*/
+#define ARM_PROLOGUE_THUMB         -1 /* thumb code is not supported          */
+#define ARM_PROLOGUE_UNREADABLE    -2 /* function body is not in the file     */
+#define ARM_PROLOGUE_DYNAMIC_SP    -3 /* SP decremented by a register value   */
+#define ARM_PROLOGUE_LATE_PUSH     -4 /* SP decremented again after a restore */
+
+typedef struct ArmPrologue {
+	unsigned int sp_delta;       /* bytes pushed or reserved before the body      */
+	unsigned int prologue_words; /* words from start up to the last SP decrement  */
+	unsigned int lr_slot;        /* LR saved at callerSP - 4 * lr_slot, 0 = no    */
+	unsigned int fp_slot;        /* FP saved at callerSP - 4 * fp_slot, 0 = no    */
+	unsigned int flags;          /* ARM_PROLOGUE_xxx                              */
+} arm_prologue_t;
+
+/*returns 0 on success or one of the ARM_PROLOGUE_xxx failure codes*/
+extern int arm_decode_prologue( const elf32_image_t* image,
+                                const elf32_function_t* fn,
+                                arm_prologue_t* prologue );
+
+/*printable reason for a failure code*/
+extern const char* arm_prologue_error( int code );
+
+#ifdef __cplusplus
+} /*extern C */
+#endif
+
+#endif /*_ARM_PROLOGUE_H_*/
@@ -0,0 +1,533 @@
+/*
+ * The MIT License
+ *
+ * Copyright (c) 2013 Rakesh D Nair
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+/*
+ * btrace_bench: measures the unwinder (libbtrace_host.a, see "make host")
+ * on synthetic ARM call chains and prints one CSV line per configuration.
+ *
+ * usage: btrace_bench [-s | -o] [-d depths] [-w words] [-p profiles] [-n iterations]
+ *
+ *   -d  comma separated call depths (default 4,16,64)
+ *   -w  comma separated NOPs in the body of each function, half of them
+ *       before the call (default 8,64,512)
+ *   -p  comma separated prologue shapes (default O0,Os,O2,O3):
+ *         O0  push {fp, lr}; add fp, sp, #4; sub sp, sp, #8
+ *         Os  push {r4, lr}
+ *         O2  push {r4-r6, lr}; sub sp, sp, #16
+ *         O3  push {r4-r10, lr}; vpush {d8-d9}; sub sp, sp, #256
+ *   -n  traces per configuration (default 2000)
+ *   -s  compare with the shadow call stack (btrace_shadow.h) instead
+ *   -o  time opcode classification instead, see below
+ *
+ * Every configuration is traced by scanning for the prologue ("scan"),
+ * with an unwind table ("table") and by following the frame pointer chain
+ * where the prologue sets one ("fp", BT_ENGINE_FP_SCAN). Columns are
+ *
+ *   profile,engine,depth,body_words,frames,ok,ns_per_frame,opcodes_per_frame,stack_reads_per_frame
+ *
+ * frames is the number of frames reported per trace, ok is 1 if all of
+ * them had the expected PC, opcodes and stack reads are the words fetched
+ * by the unwinder from code and from the stack. Time is host time of the
+ * same C code that runs on the target, compare it between builds of the
+ * library rather than as an absolute figure.
+ *
+ * With -s the unwinder runs on the first profile and body size only and
+ * each depth prints
+ *
+ *   depth,hook_ns_per_call,shadow_frames,shadow_ns_per_frame,scan_ns_per_frame,table_ns_per_frame,fp_ns_per_frame
+ *
+ * hook_ns_per_call is what the enter and exit hooks add to every call of
+ * an instrumented native chain that deep, shadow_ns_per_frame the cost of
+ * btrace_shadow_capture at its bottom. The shadow stack holds at most
+ * BTRACE_SHADOW_DEPTH calls, shadow_frames shows when a chain is deeper.
+ * A trace costs frames * ns_per_frame either way, the hooks are paid on
+ * every call whether a trace is taken or not.
+ *
+ * With -o the first step of process_instruction, finding the class of a
+ * scanned word and the register count of a block transfer, is timed over
+ * random ARM opcodes, -n times over a buffer of 64K words, as the IS_xxx
+ * chain and bit loop it used to be ("chain") and as the class table and
+ * popcount it is now ("table"). Columns are
+ *
+ *   decoder,opcodes,ns_per_opcode,mopcodes_per_s,checksum
+ *
+ * checksum must be the same on both lines.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "arm_defs.h"
+#include "arm_btrace.h"
+#include "btrace_bench_shadow.h"
+
+#define CODE_BASE   0x00008000
+#define STACK_TOP   0x20100000
+#define NOP         0xE1A00000
+#define MAX_LIST    16
+
+typedef struct BenchProfile {
+	const char*  name;
+	bt_uint32_t  prologue[4];
+	int          prologue_words;
+	bt_uint32_t  epilogue[4];
+	int          epilogue_words;
+	bt_uint32_t  frame_bytes;  /* SP delta of the prologue               */
+	int          fp_chain;     /* prologue sets fp = callerSP - 4        */
+	bt_uint8_t   lr_slot;
+	bt_uint8_t   fp_slot;
+} bench_profile_t;
+
+static const bench_profile_t profiles[] = {
+	{ "O0", { 0xE92D4800, 0xE28DB004, 0xE24DD008 }, 3, { 0xE24BD004, 0xE8BD8800 }, 2,  16, 1, 1, 2 },
+	{ "Os", { 0xE92D4010 },                         1, { 0xE8BD8010 },             1,   8, 0, 1, 0 },
+	{ "O2", { 0xE92D4070, 0xE24DD010 },             2, { 0xE28DD010, 0xE8BD8070 }, 2,  32, 0, 1, 0 },
+	{ "O3", { 0xE92D47F0, 0xED2D8B04, 0xE24DDF40 }, 3, { 0xE28DDF40, 0xECBD8B04, 0xE8BD87F0 }, 3, 304, 0, 1, 0 },
+};
+
+#define NUM_PROFILES ((int)(sizeof(profiles) / sizeof(profiles[0])))
+
+/*synthetic image, code and stack are plain arrays at fixed addresses*/
+typedef struct BenchImage {
+	bt_uint32_t*       code;
+	bt_uint32_t        code_words;
+	bt_uint32_t*       stack;
+	bt_uint32_t        stack_base;
+	bt_uint32_t        stack_words;
+	bt_uint32_t*       expected_pc;   /* expected PC of frame i           */
+	bt_unwind_entry_t* table;
+	bt_stackframe_t    start;
+	unsigned long      code_reads;
+	unsigned long      stack_reads;
+} bench_image_t;
+
+typedef struct BenchRun {
+	int frames;
+	int ok;
+	int depth;
+	const bench_image_t* image;
+} bench_run_t;
+
+static int read_bench_word(void* ctx, bt_uint32_t addr, bt_uint32_t* value)
+{
+	bench_image_t* image = (bench_image_t*)ctx;
+
+	if((addr >= CODE_BASE) && (((addr - CODE_BASE) >> 2) < image->code_words))
+	{
+		++image->code_reads;
+		*value = image->code[(addr - CODE_BASE) >> 2];
+		return 0;
+	}
+	if((addr >= image->stack_base) && (((addr - image->stack_base) >> 2) < image->stack_words))
+	{
+		++image->stack_reads;
+		*value = image->stack[(addr - image->stack_base) >> 2];
+		return 0;
+	}
+	return -1;
+}
+
+static int check_frame(int frameIndex, bt_stackframe_t* pFrame, bt_uint32_t* sp_high)
+{
+	bench_run_t* run = (bench_run_t*)((bt_unwind_ctx_t*)pFrame)->user;
+
+	if((frameIndex >= run->depth) || (pFrame->pc != run->image->expected_pc[frameIndex]))
+	{
+		run->ok = 0;
+	}
+	run->frames = frameIndex + 1;
+	return 0;
+}
+
+static void store_stack(bench_image_t* image, bt_uint32_t addr, bt_uint32_t value)
+{
+	image->stack[(addr - image->stack_base) >> 2] = value;
+}
+
+/* Lays out depth functions, function k calls function k + 1 from the middle
+ * of its body, and builds the stack as it looks when the innermost one is
+ * halfway through its body.*/
+static int build_image(bench_image_t* image, const bench_profile_t* profile, int depth, int body_words)
+{
+	int fn_words = profile->prologue_words + body_words + 1 + profile->epilogue_words;
+	bt_uint32_t caller_sp = STACK_TOP;
+	bt_uint32_t caller_fp = 0;
+	bt_uint32_t return_addr = 0;
+	int k, i;
+
+	memset(image, 0, sizeof(*image));
+	image->code_words = depth * fn_words;
+	image->stack_words = (depth * profile->frame_bytes) >> 2;
+	image->stack_base = STACK_TOP - (image->stack_words << 2);
+	image->code = calloc(image->code_words, sizeof(bt_uint32_t));
+	image->stack = calloc(image->stack_words, sizeof(bt_uint32_t));
+	image->expected_pc = calloc(depth, sizeof(bt_uint32_t));
+	image->table = calloc(depth, sizeof(bt_unwind_entry_t));
+	if(!image->code || !image->stack || !image->expected_pc || !image->table)
+	{
+		return -1;
+	}
+
+	for(k = 0; k < depth; ++k)
+	{
+		bt_uint32_t* fn = &image->code[k * fn_words];
+		bt_uint32_t fn_start = CODE_BASE + ((k * fn_words) << 2);
+		bt_uint32_t call_addr = fn_start + ((profile->prologue_words + (body_words >> 1)) << 2);
+		bt_uint32_t sp = caller_sp - profile->frame_bytes;
+		bt_unwind_entry_t* entry = &image->table[k];
+
+		memcpy(fn, profile->prologue, profile->prologue_words * sizeof(bt_uint32_t));
+		for(i = profile->prologue_words; i < fn_words - profile->epilogue_words; ++i)
+		{
+			fn[i] = NOP;
+		}
+		memcpy(&fn[fn_words - profile->epilogue_words], profile->epilogue,
+		       profile->epilogue_words * sizeof(bt_uint32_t));
+		if(k + 1 < depth)
+		{   /*bl to the next function*/
+			fn[(call_addr - fn_start) >> 2] = 0xEB000000 | (((fn_start + (fn_words << 2) - call_addr - 8) >> 2) & 0x00FFFFFF);
+		}
+
+		/*slots written by the prologue*/
+		for(i = 0; i < (int)(profile->frame_bytes >> 2); ++i)
+		{
+			store_stack(image, sp + (i << 2), 0xDEAD0000 | i);
+		}
+		store_stack(image, caller_sp - (profile->lr_slot << 2), return_addr);
+		if(profile->fp_slot)
+		{
+			store_stack(image, caller_sp - (profile->fp_slot << 2), caller_fp);
+		}
+
+		entry->fn_start = fn_start;
+		entry->fn_words = (bt_uint16_t)fn_words;
+		entry->sp_delta = (bt_uint16_t)profile->frame_bytes;
+		entry->prologue_words = (bt_uint8_t)profile->prologue_words;
+		entry->lr_slot = profile->lr_slot;
+		entry->fp_slot = profile->fp_slot;
+		entry->flags = profile->fp_chain ? BT_UNWIND_FP_FROM_SP : 0;
+
+		/*frame index counts from the innermost function*/
+		image->expected_pc[depth - 1 - k] = call_addr;
+
+		image->start.sp = sp;
+		image->start.lr = return_addr;
+		image->start.fp = profile->fp_chain ? (caller_sp - 4) : 0;
+		caller_fp = image->start.fp;
+		caller_sp = sp;
+		return_addr = call_addr + 4;
+	}
+	image->start.pc = image->expected_pc[0];
+	return 0;
+}
+
+static void free_image(bench_image_t* image)
+{
+	free(image->code);
+	free(image->stack);
+	free(image->expected_pc);
+	free(image->table);
+}
+
+static double now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/*prints one line per engine, or stores ns_per_frame of each when it is given*/
+static void run_config(const bench_profile_t* profile, int depth, int body_words, int iterations,
+                       double* ns_per_frame)
+{
+	bench_image_t image;
+	bt_mem_reader_t reader;
+	static const char* const engine_names[] = { "scan", "table", "fp" };
+	int engine;
+
+	if(build_image(&image, profile, depth, body_words) < 0)
+	{
+		fprintf(stderr, "btrace_bench: out of memory\n");
+		exit(1);
+	}
+	reader.read_word = read_bench_word;
+	reader.ctx = &image;
+	btrace_set_mem_reader(&reader);
+
+	for(engine = 0; engine < 3; ++engine)
+	{
+		bench_run_t run;
+		bt_unwind_ctx_t ctx;
+		double start, elapsed;
+		unsigned long frames = 0;
+		int ok = 1, n;
+
+		btrace_set_unwind_table((engine == 1) ? image.table : 0, (engine == 1) ? depth : 0);
+		btrace_frame_cache_flush();
+		image.code_reads = 0;
+		image.stack_reads = 0;
+
+		start = now_ns();
+		for(n = 0; n < iterations; ++n)
+		{
+			run.frames = 0;
+			run.ok = 1;
+			run.depth = depth;
+			run.image = &image;
+			btrace_init_context(&ctx);
+			ctx.frame = image.start;
+			ctx.max_frames = depth + 1;
+			ctx.callback_fn = check_frame;
+			ctx.user = &run;
+			ctx.engine = (engine == 2) ? BT_ENGINE_FP_SCAN : BT_ENGINE_SCAN;
+			btrace_unwind(&ctx);
+			frames += run.frames;
+			ok &= run.ok && (run.frames == depth);
+		}
+		elapsed = now_ns() - start;
+
+		if(!frames)
+		{
+			frames = 1;
+		}
+		if(ns_per_frame)
+		{
+			ns_per_frame[engine] = elapsed / frames;
+			continue;
+		}
+		printf("%s,%s,%d,%d,%d,%d,%.1f,%.1f,%.1f\n", profile->name, engine_names[engine],
+		       depth, body_words, (int)(frames / iterations), ok,
+		       elapsed / frames, (double)image.code_reads / frames, (double)image.stack_reads / frames);
+	}
+	btrace_set_unwind_table(0, 0);
+	btrace_set_mem_reader(0);
+	free_image(&image);
+}
+
+static void run_shadow(const bench_profile_t* profile, const int* depths, int num_depths,
+                       int body_words, int iterations)
+{
+	int d;
+
+	printf("depth,hook_ns_per_call,shadow_frames,shadow_ns_per_frame,scan_ns_per_frame,table_ns_per_frame,fp_ns_per_frame\n");
+	for(d = 0; d < num_depths; ++d)
+	{
+		double ns_per_frame[3];
+		double hook_ns, shadow_ns;
+		int frames;
+
+		hook_ns = bench_shadow_hook_ns(depths[d], iterations);
+		shadow_ns = bench_shadow_capture_ns(depths[d], iterations, &frames);
+		run_config(profile, depths[d], body_words, iterations, ns_per_frame);
+		printf("%d,%.1f,%d,%.1f,%.1f,%.1f,%.1f\n", depths[d], hook_ns, frames, shadow_ns,
+		       ns_per_frame[0], ns_per_frame[1], ns_per_frame[2]);
+	}
+}
+
+#define BENCH_OPCODES  0x10000
+
+/*register count as process_instruction did it before the class table*/
+static int count_registers_loop(bt_uint32_t opcode)
+{
+	int nbits, count = 0;
+	for(nbits = 0; nbits < 16; ++nbits)
+	{
+		if((opcode >> nbits) & 1)
+		{
+			++count;
+		}
+	}
+	return count;
+}
+
+/*order of the tests in the old process_instruction*/
+static bt_uint32_t classify_chain(bt_uint32_t opcode)
+{
+	if(IS_SUB(opcode) || IS_ADD(opcode))
+	{
+		return IS_SUB(opcode) ? OPCODE_CLASS_SUB : OPCODE_CLASS_ADD;
+	}
+	else if(IS_SINGLE_DATA(opcode))
+	{
+		return OPCODE_CLASS_SINGLE;
+	}
+	else if(IS_BLOCK_DATA(opcode))
+	{
+		return OPCODE_CLASS_BLOCK + (count_registers_loop(opcode) << 8);
+	}
+	else if(IS_LDC_STC(opcode))
+	{
+		return OPCODE_CLASS_LDC_STC;
+	}
+	return 0;
+}
+
+static const bt_uint8_t bench_class_table[256] = { OPCODE_CLASS_256 };
+
+static bt_uint32_t classify_table(bt_uint32_t opcode)
+{
+	bt_uint32_t opcode_class = bench_class_table[OPCODE_CLASS_INDEX(opcode)];
+
+	if(opcode_class & (OPCODE_CLASS_SUB | OPCODE_CLASS_ADD))
+	{
+		return (opcode_class & OPCODE_CLASS_SUB) ? OPCODE_CLASS_SUB : OPCODE_CLASS_ADD;
+	}
+	else if(opcode_class & OPCODE_CLASS_SINGLE)
+	{
+		return OPCODE_CLASS_SINGLE;
+	}
+	else if(opcode_class & OPCODE_CLASS_BLOCK)
+	{
+		return OPCODE_CLASS_BLOCK + (__builtin_popcount(opcode & 0xFFFF) << 8);
+	}
+	return opcode_class & OPCODE_CLASS_LDC_STC;
+}
+
+static void run_opcodes(int iterations)
+{
+	static const char* const decoder_names[] = { "chain", "table" };
+	bt_uint32_t* opcodes = malloc(BENCH_OPCODES * sizeof(bt_uint32_t));
+	bt_uint32_t seed = 0x2545F491;
+	int decoder, n, i;
+
+	if(!opcodes)
+	{
+		fprintf(stderr, "btrace_bench: out of memory\n");
+		exit(1);
+	}
+	for(i = 0; i < BENCH_OPCODES; ++i)
+	{   /*xorshift, always executed condition as in compiled code*/
+		seed ^= seed << 13;
+		seed ^= seed >> 17;
+		seed ^= seed << 5;
+		opcodes[i] = (seed & 0x0FFFFFFF) | 0xE0000000;
+	}
+
+	printf("decoder,opcodes,ns_per_opcode,mopcodes_per_s,checksum\n");
+	for(decoder = 0; decoder < 2; ++decoder)
+	{
+		bt_uint32_t checksum = 0;
+		double start, elapsed;
+		unsigned long total = (unsigned long)iterations * BENCH_OPCODES;
+
+		start = now_ns();
+		for(n = 0; n < iterations; ++n)
+		{
+			for(i = 0; i < BENCH_OPCODES; ++i)
+			{
+				checksum += decoder ? classify_table(opcodes[i]) : classify_chain(opcodes[i]);
+			}
+		}
+		elapsed = now_ns() - start;
+		printf("%s,%lu,%.2f,%.1f,%08x\n", decoder_names[decoder], total, elapsed / total,
+		       total * 1e3 / elapsed, checksum);
+	}
+	free(opcodes);
+}
+
+static int parse_list(const char* text, int* values)
+{
+	int count = 0;
+	char* end;
+
+	while(*text && count < MAX_LIST)
+	{
+		values[count] = (int)strtol(text, &end, 0);
+		if(end == text || values[count] <= 0)
+		{
+			return -1;
+		}
+		++count;
+		text = (*end == ',') ? end + 1 : end;
+	}
+	return count;
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: btrace_bench [-s | -o] [-d depths] [-w words] [-p profiles] [-n iterations]\n");
+	exit(2);
+}
+
+int main(int argc, char** argv)
+{
+	int depths[MAX_LIST] = { 4, 16, 64 };
+	int words[MAX_LIST] = { 8, 64, 512 };
+	int num_depths = 3, num_words = 3, iterations = 2000, shadow = 0, opcodes = 0;
+	const char* profile_list = "O0,Os,O2,O3";
+	int opt, p, d, w;
+
+	while((opt = getopt(argc, argv, "sod:w:p:n:")) != -1)
+	{
+		switch(opt)
+		{
+			case 'd': if((num_depths = parse_list(optarg, depths)) <= 0) usage(); break;
+			case 'w': if((num_words = parse_list(optarg, words)) <= 0) usage(); break;
+			case 'p': profile_list = optarg; break;
+			case 'n': if((iterations = atoi(optarg)) <= 0) usage(); break;
+			case 's': shadow = 1; break;
+			case 'o': opcodes = 1; break;
+			default: usage();
+		}
+	}
+	if((optind != argc) || (shadow && opcodes))
+	{
+		usage();
+	}
+	if(opcodes)
+	{
+		run_opcodes(iterations);
+		return 0;
+	}
+
+	if(!shadow)
+	{
+		printf("profile,engine,depth,body_words,frames,ok,ns_per_frame,opcodes_per_frame,stack_reads_per_frame\n");
+	}
+	for(p = 0; p < NUM_PROFILES; ++p)
+	{
+		const char* found = strstr(profile_list, profiles[p].name);
+		if(!found || (found[2] && found[2] != ','))
+		{
+			continue;
+		}
+		if(shadow)
+		{
+			run_shadow(&profiles[p], depths, num_depths, words[0], iterations);
+			break;
+		}
+		for(d = 0; d < num_depths; ++d)
+		{
+			for(w = 0; w < num_words; ++w)
+			{
+				run_config(&profiles[p], depths[d], words[w], iterations, 0);
+			}
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,139 @@
+/*
+ * The MIT License
+ *
+ * Copyright (c) 2013 Rakesh D Nair
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#include <time.h>
+
+#include "btrace_shadow.h"
+#include "btrace_bench_shadow.h"
+
+/* Built with -finstrument-functions. Calls go through a volatile pointer
+ * so that the compiler keeps one real call per level in both chains.*/
+
+#define BENCH_MAX_CAPTURE 256
+#define BENCH_ROUNDS      5
+
+typedef struct BenchChain {
+	int         captures;  /* btrace_shadow_capture calls at the bottom */
+	int         frames;    /* PCs returned by the last capture          */
+	double      elapsed;   /* ns spent in the captures                  */
+	bt_uint32_t pcs[BENCH_MAX_CAPTURE];
+} bench_chain_t;
+
+static double chain_now_ns(void) __attribute__ ((no_instrument_function));
+static double chain_now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int shadow_level(int depth, bench_chain_t* chain) __attribute__ ((noinline));
+static int plain_level(int depth, bench_chain_t* chain) __attribute__ ((noinline, no_instrument_function));
+
+static int (* volatile shadow_next)(int, bench_chain_t*) = shadow_level;
+static int (* volatile plain_next)(int, bench_chain_t*) = plain_level;
+
+static int shadow_level(int depth, bench_chain_t* chain)
+{
+	int n;
+	double start;
+
+	if(depth > 1)
+	{
+		return shadow_next(depth - 1, chain) + 1;
+	}
+	start = chain_now_ns();
+	for(n = 0; n < chain->captures; ++n)
+	{
+		chain->frames = btrace_shadow_capture(chain->pcs, BENCH_MAX_CAPTURE);
+	}
+	chain->elapsed += chain_now_ns() - start;
+	return 1;
+}
+
+static int plain_level(int depth, bench_chain_t* chain)
+{
+	if(depth > 1)
+	{
+		return plain_next(depth - 1, chain) + 1;
+	}
+	return 1;
+}
+
+double bench_shadow_hook_ns(int depth, int iterations)
+{
+	bt_shadow_stack_t stack;
+	bt_shadow_stack_t* oldStack;
+	bench_chain_t chain;
+	double start, elapsed, shadow_ns = 0, plain_ns = 0;
+	int n, round;
+
+	btrace_shadow_init(&stack);
+	oldStack = btrace_shadow_switch(&stack);
+	chain.captures = 0;
+	chain.elapsed = 0;
+
+	/*best of a few rounds, the difference is small next to the noise*/
+	for(round = 0; round < BENCH_ROUNDS; ++round)
+	{
+		start = chain_now_ns();
+		for(n = 0; n < iterations; ++n)
+		{
+			shadow_next(depth, &chain);
+		}
+		elapsed = chain_now_ns() - start;
+		shadow_ns = (!round || (elapsed < shadow_ns)) ? elapsed : shadow_ns;
+
+		start = chain_now_ns();
+		for(n = 0; n < iterations; ++n)
+		{
+			plain_next(depth, &chain);
+		}
+		elapsed = chain_now_ns() - start;
+		plain_ns = (!round || (elapsed < plain_ns)) ? elapsed : plain_ns;
+	}
+
+	btrace_shadow_switch(oldStack);
+	shadow_ns = (shadow_ns - plain_ns) / ((double)iterations * depth);
+	return (shadow_ns > 0) ? shadow_ns : 0;
+}
+
+double bench_shadow_capture_ns(int depth, int iterations, int* frames)
+{
+	bt_shadow_stack_t stack;
+	bt_shadow_stack_t* oldStack;
+	bench_chain_t chain;
+
+	btrace_shadow_init(&stack);
+	oldStack = btrace_shadow_switch(&stack);
+	chain.captures = iterations;
+	chain.frames = 0;
+	chain.elapsed = 0;
+	shadow_next(depth, &chain);
+	btrace_shadow_switch(oldStack);
+
+	*frames = chain.frames;
+	return chain.frames ? (chain.elapsed / ((double)iterations * chain.frames)) : 0;
+}
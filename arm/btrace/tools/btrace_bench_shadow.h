@@ -0,0 +1,52 @@
+/*
+ * The MIT License
+ *
+ * Copyright (c) 2013 Rakesh D Nair
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+*/
+
+#ifndef _BTRACE_BENCH_SHADOW_H_
+#define _BTRACE_BENCH_SHADOW_H_
+
+/*
+ * Native call chains for btrace_bench -s. btrace_bench_shadow.c is the
+ * only file built with -finstrument-functions, so these are the only
+ * calls that reach the shadow stack hooks of libbtrace_host.a.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ns added to each call of a depth deep chain by the enter and exit hooks.
+ * Both switch to a stack of their own while measuring, so they are not
+ * instrumented themselves.*/
+extern double bench_shadow_hook_ns( int depth, int iterations ) __attribute__ ((no_instrument_function));
+
+/* ns per frame of btrace_shadow_capture at the bottom of a depth deep
+ * chain, frames gets the number of PCs captured*/
+extern double bench_shadow_capture_ns( int depth, int iterations, int* frames ) __attribute__ ((no_instrument_function));
+
+#ifdef __cplusplus
+} /*extern C */
+#endif
+
+#endif /*_BTRACE_BENCH_SHADOW_H_*/
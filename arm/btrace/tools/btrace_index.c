@@ -0,0 +1,509 @@
+/*
+ * The MIT License
+ *
+ * Copyright (c) 2013 Rakesh D Nair
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+/*
+ * btrace_index: lists every ARM push (IS_PUSH in arm_defs.h) in the
+ * executable sections of an image. These are the prologues the unwinder
+ * scans back to, so the list is an index of function starts for offline
+ * unwinding and unwind table generation that does not depend on symbols.
+ *
+ * usage: btrace_index [-j threads] [-o index.bin] [-b] image.elf
+ *
+ *   -j  number of worker threads (default: number of online CPUs)
+ *   -o  also write the addresses as little endian 32 bit words
+ *   -b  instead of listing, time the scalar and SIMD scans with 1 and
+ *       -j threads and print CSV:
+ *         scanner,threads,bytes,pushes,ms,mb_per_s
+ *
+ * Each output line is "address opcode function+offset". Pushes found in
+ * literal pools ($d mapping symbols) or in thumb functions are left out.
+ * Sections are cut into chunks that the threads scan with the widest
+ * compare the host supports: 8 words at a time with AVX2, 4 with SSE2,
+ * otherwise one.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "arm_defs.h"
+#include "elf32_image.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define INDEX_X86_SIMD 1
+#include <immintrin.h>
+#else
+#define INDEX_X86_SIMD 0
+#endif
+
+/*words per chunk handed to a thread*/
+#define CHUNK_WORDS 16384
+
+#define PUSH_MASK   0xFFFF0000
+#define PUSH_STM    0xE92D0000
+#define PUSH_STR    0xE52D0000
+
+/*stores addresses of the pushes in words[0..count) to hits, returns number found*/
+typedef size_t (*ScanFnPtr)(const unsigned char* words, size_t count, Elf32_Addr base, Elf32_Addr* hits);
+
+typedef struct Scanner {
+	const char* name;
+	ScanFnPtr   scan_fn;
+	int         available;
+} scanner_t;
+
+typedef struct Chunk {
+	const unsigned char* words;
+	size_t               count;
+	Elf32_Addr           base;
+	Elf32_Addr*          hits;
+	size_t               num_hits;
+} chunk_t;
+
+typedef struct Indexer {
+	elf32_image_t   image;
+	chunk_t*        chunks;
+	int             num_chunks;
+	int             next_chunk;
+	ScanFnPtr       scan_fn;
+	int             filter;     /* drop pushes in literal pools and thumb code */
+	pthread_mutex_t lock;
+} indexer_t;
+
+static size_t scan_scalar(const unsigned char* words, size_t count, Elf32_Addr base, Elf32_Addr* hits)
+{
+	size_t i, num_hits = 0;
+
+	for(i = 0; i < count; ++i)
+	{
+		const unsigned char* word = words + (i << 2);
+		Elf32_Word opcode = word[0] | (word[1] << 8) | (word[2] << 16) | ((Elf32_Word)word[3] << 24);
+		if(IS_PUSH(opcode))
+		{
+			hits[num_hits++] = base + (Elf32_Addr)(i << 2);
+		}
+	}
+	return num_hits;
+}
+
+#if INDEX_X86_SIMD
+/*x86 is little endian like the image, so words can be compared as loaded*/
+__attribute__((target("sse2")))
+static size_t scan_sse2(const unsigned char* words, size_t count, Elf32_Addr base, Elf32_Addr* hits)
+{
+	const __m128i mask = _mm_set1_epi32((int)PUSH_MASK);
+	const __m128i stm = _mm_set1_epi32((int)PUSH_STM);
+	const __m128i str = _mm_set1_epi32((int)PUSH_STR);
+	size_t i, num_hits = 0;
+
+	for(i = 0; i + 4 <= count; i += 4)
+	{
+		__m128i top = _mm_and_si128(_mm_loadu_si128((const __m128i*)(words + (i << 2))), mask);
+		__m128i push = _mm_or_si128(_mm_cmpeq_epi32(top, stm), _mm_cmpeq_epi32(top, str));
+		unsigned int bits = (unsigned int)_mm_movemask_ps(_mm_castsi128_ps(push));
+		while(bits)
+		{
+			hits[num_hits++] = base + (Elf32_Addr)((i + __builtin_ctz(bits)) << 2);
+			bits &= bits - 1;
+		}
+	}
+	return num_hits + scan_scalar(words + (i << 2), count - i, base + (Elf32_Addr)(i << 2), hits + num_hits);
+}
+
+__attribute__((target("avx2")))
+static size_t scan_avx2(const unsigned char* words, size_t count, Elf32_Addr base, Elf32_Addr* hits)
+{
+	const __m256i mask = _mm256_set1_epi32((int)PUSH_MASK);
+	const __m256i stm = _mm256_set1_epi32((int)PUSH_STM);
+	const __m256i str = _mm256_set1_epi32((int)PUSH_STR);
+	size_t i, num_hits = 0;
+
+	for(i = 0; i + 8 <= count; i += 8)
+	{
+		__m256i top = _mm256_and_si256(_mm256_loadu_si256((const __m256i*)(words + (i << 2))), mask);
+		__m256i push = _mm256_or_si256(_mm256_cmpeq_epi32(top, stm), _mm256_cmpeq_epi32(top, str));
+		unsigned int bits = (unsigned int)_mm256_movemask_ps(_mm256_castsi256_ps(push));
+		while(bits)
+		{
+			hits[num_hits++] = base + (Elf32_Addr)((i + __builtin_ctz(bits)) << 2);
+			bits &= bits - 1;
+		}
+	}
+	return num_hits + scan_scalar(words + (i << 2), count - i, base + (Elf32_Addr)(i << 2), hits + num_hits);
+}
+#endif
+
+static scanner_t scanners[] = {
+	{ "scalar", scan_scalar, 1 },
+#if INDEX_X86_SIMD
+	{ "sse2",   scan_sse2,   0 },
+	{ "avx2",   scan_avx2,   0 },
+#endif
+};
+
+#define NUM_SCANNERS ((int)(sizeof(scanners) / sizeof(scanners[0])))
+
+/*marks the scanners the host can run, returns the widest*/
+static const scanner_t* detect_scanners(void)
+{
+	const scanner_t* best = &scanners[0];
+#if INDEX_X86_SIMD
+	int i;
+
+	__builtin_cpu_init();
+	scanners[1].available = __builtin_cpu_supports("sse2");
+	scanners[2].available = __builtin_cpu_supports("avx2");
+	for(i = 1; i < NUM_SCANNERS; ++i)
+	{
+		if(scanners[i].available)
+		{
+			best = &scanners[i];
+		}
+	}
+#endif
+	return best;
+}
+
+static int compare_chunks(const void* a, const void* b)
+{
+	const chunk_t* ca = (const chunk_t*)a;
+	const chunk_t* cb = (const chunk_t*)b;
+	return (ca->base < cb->base) ? -1 : (ca->base > cb->base);
+}
+
+/*cuts the executable sections into chunks, in address order*/
+static int add_chunks(indexer_t* idx)
+{
+	const elf32_image_t* image = &idx->image;
+	int i;
+
+	for(i = 0; i < image->ehdr->e_shnum; ++i)
+	{
+		const Elf32_Shdr* sec = &image->shdrs[i];
+		size_t words, done;
+
+		if((sec->sh_type != SHT_PROGBITS) || !(sec->sh_flags & SHF_EXECINSTR) ||
+		   (sec->sh_offset + sec->sh_size > image->size))
+		{
+			continue;
+		}
+		words = sec->sh_size >> 2;
+		for(done = 0; done < words; done += CHUNK_WORDS)
+		{
+			chunk_t* chunk;
+
+			idx->chunks = realloc(idx->chunks, (idx->num_chunks + 1) * sizeof(chunk_t));
+			if(!idx->chunks)
+			{
+				perror("btrace_index");
+				exit(1);
+			}
+			chunk = &idx->chunks[idx->num_chunks++];
+			chunk->words = image->data + sec->sh_offset + (done << 2);
+			chunk->count = (words - done < CHUNK_WORDS) ? (words - done) : CHUNK_WORDS;
+			chunk->base = sec->sh_addr + (Elf32_Addr)(done << 2);
+			chunk->hits = malloc(chunk->count * sizeof(Elf32_Addr));
+			chunk->num_hits = 0;
+			if(!chunk->hits)
+			{
+				perror("btrace_index");
+				exit(1);
+			}
+		}
+	}
+	qsort(idx->chunks, idx->num_chunks, sizeof(chunk_t), compare_chunks);
+	return idx->num_chunks;
+}
+
+/*drops pushes that are literal pool data or inside thumb functions*/
+static size_t filter_hits(const elf32_image_t* image, Elf32_Addr* hits, size_t num_hits)
+{
+	size_t i, kept = 0;
+
+	for(i = 0; i < num_hits; ++i)
+	{
+		const elf32_function_t* fn;
+
+		if(elf32_is_data(image, hits[i]))
+		{
+			continue;
+		}
+		fn = elf32_find_function(image, hits[i]);
+		if(fn && fn->thumb)
+		{
+			continue;
+		}
+		hits[kept++] = hits[i];
+	}
+	return kept;
+}
+
+static void* worker(void* arg)
+{
+	indexer_t* idx = (indexer_t*)arg;
+
+	for(;;)
+	{
+		chunk_t* chunk;
+
+		pthread_mutex_lock(&idx->lock);
+		chunk = (idx->next_chunk < idx->num_chunks) ? &idx->chunks[idx->next_chunk++] : 0;
+		pthread_mutex_unlock(&idx->lock);
+		if(!chunk)
+		{
+			break;
+		}
+		chunk->num_hits = idx->scan_fn(chunk->words, chunk->count, chunk->base, chunk->hits);
+		if(idx->filter)
+		{
+			chunk->num_hits = filter_hits(&idx->image, chunk->hits, chunk->num_hits);
+		}
+	}
+	return 0;
+}
+
+/*scans all chunks with num_threads threads, returns number of pushes*/
+static size_t run_index(indexer_t* idx, ScanFnPtr scan_fn, int num_threads)
+{
+	pthread_t* threads;
+	size_t total = 0;
+	int i;
+
+	if(num_threads > idx->num_chunks)
+	{
+		num_threads = idx->num_chunks;
+	}
+	idx->scan_fn = scan_fn;
+	idx->next_chunk = 0;
+	if(num_threads <= 1)
+	{
+		worker(idx);
+	}
+	else
+	{
+		threads = calloc(num_threads, sizeof(pthread_t));
+		for(i = 0; i < num_threads; ++i)
+		{
+			pthread_create(&threads[i], 0, worker, idx);
+		}
+		for(i = 0; i < num_threads; ++i)
+		{
+			pthread_join(threads[i], 0);
+		}
+		free(threads);
+	}
+	for(i = 0; i < idx->num_chunks; ++i)
+	{
+		total += idx->chunks[i].num_hits;
+	}
+	return total;
+}
+
+static double now_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+/*times the raw scan (no filtering) of every available scanner*/
+static int benchmark(indexer_t* idx, int num_threads)
+{
+	size_t bytes = 0, expected = 0;
+	int threads[2];
+	int i, t, status = 0;
+
+	for(i = 0; i < idx->num_chunks; ++i)
+	{
+		bytes += idx->chunks[i].count << 2;
+	}
+	threads[0] = 1;
+	threads[1] = num_threads;
+	idx->filter = 0;
+	expected = run_index(idx, scan_scalar, 1);
+
+	printf("scanner,threads,bytes,pushes,ms,mb_per_s\n");
+	for(i = 0; i < NUM_SCANNERS; ++i)
+	{
+		if(!scanners[i].available)
+		{
+			continue;
+		}
+		for(t = 0; t < ((num_threads > 1) ? 2 : 1); ++t)
+		{
+			double start, elapsed;
+			size_t pushes = 0;
+			int runs = 0;
+
+			/*repeat for at least 200 ms to get a stable figure*/
+			start = now_ms();
+			do
+			{
+				pushes = run_index(idx, scanners[i].scan_fn, threads[t]);
+				++runs;
+				elapsed = now_ms() - start;
+			} while(elapsed < 200.0);
+			elapsed /= runs;
+
+			printf("%s,%d,%lu,%lu,%.3f,%.1f\n", scanners[i].name, threads[t], (unsigned long)bytes,
+			       (unsigned long)pushes, elapsed, (elapsed > 0) ? (bytes / 1e3 / elapsed) : 0.0);
+			if(pushes != expected)
+			{
+				fprintf(stderr, "error: %s found %lu pushes, scalar found %lu\n", scanners[i].name,
+				        (unsigned long)pushes, (unsigned long)expected);
+				status = 1;
+			}
+		}
+	}
+	return status;
+}
+
+static int write_index(const indexer_t* idx, const char* path)
+{
+	FILE* out = fopen(path, "wb");
+	int i;
+	size_t h;
+
+	if(!out)
+	{
+		perror(path);
+		return -1;
+	}
+	for(i = 0; i < idx->num_chunks; ++i)
+	{
+		for(h = 0; h < idx->chunks[i].num_hits; ++h)
+		{
+			Elf32_Addr addr = idx->chunks[i].hits[h];
+			unsigned char le[4];
+			le[0] = (unsigned char)addr;
+			le[1] = (unsigned char)(addr >> 8);
+			le[2] = (unsigned char)(addr >> 16);
+			le[3] = (unsigned char)(addr >> 24);
+			fwrite(le, 1, sizeof(le), out);
+		}
+	}
+	return fclose(out);
+}
+
+static void print_index(const indexer_t* idx)
+{
+	int i;
+	size_t h;
+
+	for(i = 0; i < idx->num_chunks; ++i)
+	{
+		const chunk_t* chunk = &idx->chunks[i];
+		for(h = 0; h < chunk->num_hits; ++h)
+		{
+			Elf32_Addr addr = chunk->hits[h];
+			const elf32_function_t* fn = elf32_find_function(&idx->image, addr);
+			Elf32_Word opcode = 0;
+
+			elf32_read_word(&idx->image, addr, &opcode);
+			if(fn)
+			{
+				printf("%08x %08x %s+0x%x\n", addr, opcode, fn->name, addr - fn->start);
+			}
+			else
+			{
+				printf("%08x %08x ??\n", addr, opcode);
+			}
+		}
+	}
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: btrace_index [-j threads] [-o index.bin] [-b] image.elf\n");
+	exit(2);
+}
+
+int main(int argc, char** argv)
+{
+	static indexer_t idx;
+	const scanner_t* best;
+	const char* out_path = 0;
+	int num_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	int bench = 0;
+	int i, opt, status = 0;
+	size_t pushes;
+
+	while((opt = getopt(argc, argv, "j:o:b")) != -1)
+	{
+		switch(opt)
+		{
+			case 'j': num_threads = atoi(optarg); break;
+			case 'o': out_path = optarg; break;
+			case 'b': bench = 1; break;
+			default: usage();
+		}
+	}
+	if(optind + 1 != argc)
+	{
+		usage();
+	}
+	if(num_threads < 1)
+	{
+		num_threads = 1;
+	}
+	if(elf32_open(&idx.image, argv[optind]) < 0)
+	{
+		return 1;
+	}
+	pthread_mutex_init(&idx.lock, 0);
+	best = detect_scanners();
+	if(!add_chunks(&idx))
+	{
+		fprintf(stderr, "warning: %s has no executable sections\n", argv[optind]);
+	}
+
+	if(bench)
+	{
+		status = benchmark(&idx, num_threads);
+	}
+	else
+	{
+		idx.filter = 1;
+		pushes = run_index(&idx, best->scan_fn, num_threads);
+		print_index(&idx);
+		if(out_path && (write_index(&idx, out_path) != 0))
+		{
+			status = 1;
+		}
+		fprintf(stderr, "%lu pushes in %d functions (%s scan)\n", (unsigned long)pushes,
+		        idx.image.num_functions, best->name);
+	}
+
+	for(i = 0; i < idx.num_chunks; ++i)
+	{
+		free(idx.chunks[i].hits);
+	}
+	free(idx.chunks);
+	elf32_close(&idx.image);
+	return status;
+}
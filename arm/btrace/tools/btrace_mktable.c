@@ -0,0 +1,178 @@
+/*
+ * The MIT License
+ *
+ * Copyright (c) 2013 Rakesh D Nair
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+/*
+ * btrace_mktable: generates the unwind table used by btrace_callstack
+ * from a linked ARM ELF image.
+ *
+ * usage: btrace_mktable [-b] [-v] [-o output] image.elf
+ *
+ *   -o  write to output instead of stdout
+ *   -b  write raw little endian bt_unwind_entry_t records instead of C source
+ *   -v  list functions left out of the table and why
+ *
+ * Functions are left out when their prologue cannot be decoded statically
+ * (thumb code, SP adjusted by a register, SP decremented again after a
+ * restore). btrace_callstack falls back to scanning for those.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "elf32_image.h"
+#include "arm_prologue.h"
+
+/*limits imposed by the field widths of bt_unwind_entry_t*/
+#define MAX_FN_WORDS        0xFFFF
+#define MAX_SP_DELTA        0xFFFF
+#define MAX_PROLOGUE_WORDS  0xFF
+#define MAX_SLOT            0xFF
+
+static void write_le(FILE* out, unsigned int value, int bytes)
+{
+	while(bytes--)
+	{
+		fputc(value & 0xFF, out);
+		value >>= 8;
+	}
+}
+
+static void write_entry(FILE* out, int binary, const elf32_function_t* fn, const arm_prologue_t* prologue)
+{
+	unsigned int fn_words = (fn->end - fn->start) >> 2;
+
+	if(binary)
+	{
+		write_le(out, fn->start, 4);
+		write_le(out, fn_words, 2);
+		write_le(out, prologue->sp_delta, 2);
+		write_le(out, prologue->prologue_words, 1);
+		write_le(out, prologue->lr_slot, 1);
+		write_le(out, prologue->fp_slot, 1);
+		write_le(out, prologue->flags, 1);
+	}
+	else
+	{
+		fprintf(out, "\t{ 0x%08x, %5u, %5u, %3u, %3u, %3u, 0x%02x }, /* %s */\n",
+		        fn->start, fn_words, prologue->sp_delta, prologue->prologue_words,
+		        prologue->lr_slot, prologue->fp_slot, prologue->flags, fn->name);
+	}
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: btrace_mktable [-b] [-v] [-o output] image.elf\n");
+	exit(2);
+}
+
+int main(int argc, char** argv)
+{
+	elf32_image_t image;
+	FILE* out = stdout;
+	const char* out_path = 0;
+	int binary = 0, verbose = 0;
+	int i, opt, entries = 0, skipped = 0;
+
+	while((opt = getopt(argc, argv, "bvo:")) != -1)
+	{
+		switch(opt)
+		{
+			case 'b': binary = 1; break;
+			case 'v': verbose = 1; break;
+			case 'o': out_path = optarg; break;
+			default: usage();
+		}
+	}
+	if(optind + 1 != argc)
+	{
+		usage();
+	}
+	if(elf32_open(&image, argv[optind]) < 0)
+	{
+		return 1;
+	}
+	if(out_path && !(out = fopen(out_path, binary ? "wb" : "w")))
+	{
+		perror(out_path);
+		elf32_close(&image);
+		return 1;
+	}
+
+	if(!binary)
+	{
+		fprintf(out, "/* generated by btrace_mktable from %s, do not edit */\n\n", argv[optind]);
+		fprintf(out, "#include \"arm_btrace.h\"\n\n");
+		fprintf(out, "/* { fn_start, fn_words, sp_delta, prologue_words, lr_slot, fp_slot, flags } */\n");
+		fprintf(out, "const bt_unwind_entry_t btrace_unwind_table[] = {\n");
+	}
+
+	for(i = 0; i < image.num_functions; ++i)
+	{
+		const elf32_function_t* fn = &image.functions[i];
+		arm_prologue_t prologue;
+		int status = arm_decode_prologue(&image, fn, &prologue);
+		const char* reason = arm_prologue_error(status);
+
+		if((status == 0) &&
+		   (((fn->end - fn->start) >> 2) > MAX_FN_WORDS || prologue.sp_delta > MAX_SP_DELTA ||
+		    prologue.prologue_words > MAX_PROLOGUE_WORDS ||
+		    prologue.lr_slot > MAX_SLOT || prologue.fp_slot > MAX_SLOT))
+		{
+			status = -1;
+			reason = "too large for table entry";
+		}
+		if(status < 0)
+		{
+			if(verbose)
+			{
+				fprintf(stderr, "skipped %08x %s: %s\n", fn->start, fn->name, reason);
+			}
+			++skipped;
+			continue;
+		}
+		write_entry(out, binary, fn, &prologue);
+		++entries;
+	}
+
+	if(!binary)
+	{
+		if(!entries)
+		{   /*C does not allow an empty initializer list*/
+			fprintf(out, "\t{ 0, 0, 0, 0, 0, 0, 0 }\n");
+		}
+		fprintf(out, "};\n\n");
+		fprintf(out, "const int btrace_unwind_table_entries = %d;\n", entries);
+	}
+	fprintf(stderr, "btrace_mktable: %d functions in table, %d left to the scanner\n", entries, skipped);
+
+	if(out != stdout)
+	{
+		fclose(out);
+	}
+	elf32_close(&image);
+	return 0;
+}
@@ -0,0 +1,147 @@
+/*
+ * The MIT License
+ *
+ * Copyright (c) 2013 Rakesh D Nair
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+/*
+ * btrace_records: prints binary frame records (bt_frame_record_t) dumped
+ * from the target as the text the library prints through TracePrintFnPtr.
+ *
+ * usage: btrace_records [-v] [-c cpus] dump.bin...
+ *
+ *   dump.bin  raw little endian copy of the buffer passed to
+ *             btrace_set_record_buffer, e.g. saved by a debugger
+ *   -v        also print the record flags
+ *   -c cpus   the dump was written by a library built with
+ *             BTRACE_NUM_CPUS = cpus, decode the slice of each core
+ *
+ * Decoding of a dump (or slice) stops at the first unused record.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "arm_btrace.h"
+#include "tool_files.h"
+
+#define RECORD_SIZE 24
+
+/*prints records from the current position of in, returns number printed*/
+static int print_slice(FILE* in, int maxRecords, int verbose)
+{
+	unsigned char bytes[RECORD_SIZE];
+	int count = 0;
+
+	while((count < maxRecords) && (fread(bytes, sizeof(bytes), 1, in) == 1))
+	{
+		bt_frame_record_t record;
+
+		record.pc = tool_get_le(bytes, 4);
+		record.sp = tool_get_le(bytes + 4, 4);
+		record.lr = tool_get_le(bytes + 8, 4);
+		record.fp = tool_get_le(bytes + 12, 4);
+		record.caller_sp = tool_get_le(bytes + 16, 4);
+		record.index = tool_get_le(bytes + 20, 2);
+		record.flags = tool_get_le(bytes + 22, 2);
+
+		if(!(record.flags & BT_RECORD_VALID) || (record.index != count))
+		{
+			break;
+		}
+		printf("#%02d: PC= %x, SP= %x, LR= %x, FP= %x, callerSP= %x", record.index,
+		       record.pc, record.sp, record.lr, record.fp, record.caller_sp);
+		if(verbose)
+		{
+			printf(" [%s%s%s]",
+			       (record.flags & BT_RECORD_LR_ON_STACK) ? " lr" : "",
+			       (record.flags & BT_RECORD_FP_ON_STACK) ? " fp" : "",
+			       (record.flags & BT_RECORD_FP_FROM_SP) ? " fp=sp+n" : "");
+		}
+		printf("\n");
+		++count;
+	}
+	return count;
+}
+
+static int print_records(const char* path, int cpus, int verbose)
+{
+	FILE* in = fopen(path, "rb");
+	long size;
+	int slice, cpu, count = 0;
+
+	if(!in)
+	{
+		perror(path);
+		return -1;
+	}
+	printf("%s:\n", path);
+	if(cpus <= 1)
+	{
+		count = print_slice(in, 0x7FFFFFFF, verbose);
+		fclose(in);
+		return count;
+	}
+
+	fseek(in, 0, SEEK_END);
+	size = ftell(in);
+	slice = (int)(size / RECORD_SIZE) / cpus;
+	for(cpu = 0; cpu < cpus; ++cpu)
+	{
+		printf("cpu %d:\n", cpu);
+		fseek(in, (long)cpu * slice * RECORD_SIZE, SEEK_SET);
+		count += print_slice(in, slice, verbose);
+	}
+	fclose(in);
+	return count;
+}
+
+int main(int argc, char** argv)
+{
+	int opt, verbose = 0, cpus = 1, failed = 0;
+
+	while((opt = getopt(argc, argv, "vc:")) != -1)
+	{
+		switch(opt)
+		{
+			case 'v': verbose = 1; break;
+			case 'c': cpus = atoi(optarg); break;
+			default:
+				fprintf(stderr, "usage: btrace_records [-v] [-c cpus] dump.bin...\n");
+				return 2;
+		}
+	}
+	if(optind >= argc)
+	{
+		fprintf(stderr, "usage: btrace_records [-v] [-c cpus] dump.bin...\n");
+		return 2;
+	}
+	for(; optind < argc; ++optind)
+	{
+		if(print_records(argv[optind], cpus, verbose) < 0)
+		{
+			failed = 1;
+		}
+	}
+	return failed;
+}
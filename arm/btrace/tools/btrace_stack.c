@@ -0,0 +1,365 @@
+/*
+ * The MIT License
+ *
+ * Copyright (c) 2013 Rakesh D Nair
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+/*
+ * btrace_stack: static worst case stack usage of a linked ARM ELF image.
+ *
+ * usage: btrace_stack [-a] [-v] [-e entry]... image.elf
+ *
+ *   -e  report the task entry function with this name (repeatable),
+ *       default is every function that is not the target of a direct call
+ *   -a  also list the frame size of every function
+ *   -v  print the deepest call chain of each reported function
+ *
+ * The frame size of a function is the SP delta of its prologue as decoded
+ * by arm_decode_prologue, the same figure btrace_mktable puts in the
+ * unwind table. Direct calls (BL, BLX #imm) and tail calls (B out of the
+ * function) form the call graph. The worst case of a function is its frame
+ * plus the worst case of its deepest callee; a tail call replaces the
+ * frame instead of adding to it.
+ *
+ * A result is a lower bound, printed with a '+', when anything below the
+ * function recurses (R), calls through a register (I) or has a frame that
+ * could not be decoded (U, e.g. thumb code or SP adjusted by a register).
+ * Interrupt and exception stacking is not included.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "arm_defs.h"
+#include "elf32_image.h"
+#include "arm_prologue.h"
+
+/*flags of a function and everything it can reach*/
+#define STACK_RECURSIVE   0x01
+#define STACK_INDIRECT    0x02
+#define STACK_UNKNOWN     0x04
+
+/*depth first search state*/
+#define VISIT_NONE        0
+#define VISIT_ACTIVE      1
+#define VISIT_DONE        2
+
+/*BLX #imm, switches to thumb*/
+#define IS_BLX_IMMEDIATE(_opcode)  _IS_PART_EQUAL(_opcode, 0xFE000000, 0xFA000000)
+/*BLX rX*/
+#define IS_BLX_REGISTER(_opcode)   _IS_PART_EQUAL(_opcode, 0x0FFFFFF0, 0x012FFF30)
+/*mov lr, pc, start of an old style indirect call*/
+#define IS_MOV_LR_PC(_opcode)      _IS_PART_EQUAL(_opcode, 0x0FFFFFFF, 0x01A0E00F)
+
+typedef struct CallEdge {
+	int callee;  /* index into the function table */
+	int tail;    /* 1 for a branch that does not return here */
+} call_edge_t;
+
+typedef struct StackNode {
+	unsigned int frame;      /* bytes used by the function itself        */
+	unsigned int worst;      /* frame plus deepest callee                */
+	unsigned int flags;      /* STACK_xxx of this function only          */
+	unsigned int reach;      /* STACK_xxx of this function and callees   */
+	int          visit;      /* VISIT_xxx                                */
+	int          next;       /* callee on the deepest chain, -1 for none */
+	int          called;     /* 1 if target of a direct call             */
+	call_edge_t* edges;
+	int          num_edges;
+} stack_node_t;
+
+static elf32_image_t image;
+static stack_node_t* nodes;
+
+static int function_index(Elf32_Addr addr)
+{
+	const elf32_function_t* fn = elf32_find_function(&image, addr);
+	return fn ? (int)(fn - image.functions) : -1;
+}
+
+static void add_edge(int caller, int callee, int tail)
+{
+	stack_node_t* node = &nodes[caller];
+	int i;
+
+	for(i = 0; i < node->num_edges; ++i)
+	{
+		if(node->edges[i].callee == callee && node->edges[i].tail == tail)
+		{
+			return;
+		}
+	}
+	node->edges = realloc(node->edges, (node->num_edges + 1) * sizeof(call_edge_t));
+	if(!node->edges)
+	{
+		perror("btrace_stack");
+		exit(1);
+	}
+	node->edges[node->num_edges].callee = callee;
+	node->edges[node->num_edges].tail = tail;
+	++node->num_edges;
+	if(!tail)
+	{
+		nodes[callee].called = 1;
+	}
+}
+
+/*frame size and outgoing calls of function i*/
+static void scan_function(int i)
+{
+	const elf32_function_t* fn = &image.functions[i];
+	stack_node_t* node = &nodes[i];
+	arm_prologue_t prologue;
+	Elf32_Addr addr;
+
+	if(arm_decode_prologue(&image, fn, &prologue) < 0)
+	{
+		node->flags |= STACK_UNKNOWN;
+		return;
+	}
+	node->frame = prologue.sp_delta;
+
+	for(addr = fn->start; addr + 4 <= fn->end; addr += 4)
+	{
+		Elf32_Word opcode;
+		Elf32_Addr target;
+		int callee;
+
+		if(elf32_is_data(&image, addr) || (elf32_read_word(&image, addr, &opcode) < 0))
+		{
+			continue;
+		}
+		if(IS_BRANCH(opcode))
+		{   /*signed 24 bit word offset from PC+8*/
+			target = addr + 8 + (((Elf32_Sword)(opcode << 8)) >> 6);
+			if(IS_BLX_IMMEDIATE(opcode))
+			{
+				target += (opcode >> 23) & 2;
+			}
+			callee = function_index(target);
+			if(IS_BLX_IMMEDIATE(opcode) || (opcode & 0x01000000))
+			{   /* bl, blx */
+				if(callee >= 0)
+				{
+					add_edge(i, callee, 0);
+				}
+				else
+				{
+					node->flags |= STACK_UNKNOWN;
+				}
+			}
+			else if((target < fn->start) || (target >= fn->end))
+			{   /* b to another function */
+				if(callee >= 0)
+				{
+					add_edge(i, callee, 1);
+				}
+			}
+		}
+		else if(IS_BLX_REGISTER(opcode) || IS_MOV_LR_PC(opcode))
+		{
+			node->flags |= STACK_INDIRECT;
+		}
+	}
+}
+
+/*worst case of function i, memoized*/
+static unsigned int walk(int i)
+{
+	stack_node_t* node = &nodes[i];
+	unsigned int worst = node->frame;
+	int e;
+
+	if(node->visit == VISIT_DONE)
+	{
+		return node->worst;
+	}
+	if(node->visit == VISIT_ACTIVE)
+	{   /*call cycle, the caller gets the recursion flag*/
+		return 0;
+	}
+	node->visit = VISIT_ACTIVE;
+	node->reach = node->flags;
+	node->next = -1;
+
+	for(e = 0; e < node->num_edges; ++e)
+	{
+		int callee = node->edges[e].callee;
+		unsigned int depth;
+
+		if(nodes[callee].visit == VISIT_ACTIVE)
+		{
+			node->reach |= STACK_RECURSIVE;
+			continue;
+		}
+		depth = walk(callee);
+		node->reach |= nodes[callee].reach;
+		if(!node->edges[e].tail)
+		{
+			depth += node->frame;
+		}
+		if(depth > worst)
+		{
+			worst = depth;
+			node->next = callee;
+		}
+	}
+	node->worst = worst;
+	node->visit = VISIT_DONE;
+	return worst;
+}
+
+static const char* flag_string(unsigned int flags)
+{
+	static char text[8];
+	char* p = text;
+
+	if(flags & STACK_RECURSIVE) *p++ = 'R';
+	if(flags & STACK_INDIRECT)  *p++ = 'I';
+	if(flags & STACK_UNKNOWN)   *p++ = 'U';
+	*p = 0;
+	return text;
+}
+
+static void report(int i, int verbose)
+{
+	stack_node_t* node = &nodes[i];
+
+	walk(i);
+	printf("%8u%c %-3s %s\n", node->worst, node->reach ? '+' : ' ',
+	       flag_string(node->reach), image.functions[i].name);
+	if(verbose)
+	{
+		int next;
+		for(next = i; next >= 0; next = nodes[next].next)
+		{
+			printf("          %6u %-3s %s\n", nodes[next].frame,
+			       flag_string(nodes[next].flags), image.functions[next].name);
+		}
+	}
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: btrace_stack [-a] [-v] [-e entry]... image.elf\n");
+	exit(2);
+}
+
+int main(int argc, char** argv)
+{
+	const char** entries = 0;
+	int num_entries = 0, all = 0, verbose = 0, failed = 0;
+	int i, opt;
+
+	while((opt = getopt(argc, argv, "ave:")) != -1)
+	{
+		switch(opt)
+		{
+			case 'a': all = 1; break;
+			case 'v': verbose = 1; break;
+			case 'e':
+				entries = realloc(entries, (num_entries + 1) * sizeof(char*));
+				if(!entries)
+				{
+					perror("btrace_stack");
+					return 1;
+				}
+				entries[num_entries++] = optarg;
+				break;
+			default: usage();
+		}
+	}
+	if(optind + 1 != argc)
+	{
+		usage();
+	}
+	if(elf32_open(&image, argv[optind]) < 0)
+	{
+		return 1;
+	}
+	nodes = calloc(image.num_functions ? image.num_functions : 1, sizeof(stack_node_t));
+	if(!nodes)
+	{
+		perror("btrace_stack");
+		elf32_close(&image);
+		return 1;
+	}
+	for(i = 0; i < image.num_functions; ++i)
+	{
+		scan_function(i);
+	}
+
+	if(all)
+	{
+		printf("frame sizes:\n");
+		for(i = 0; i < image.num_functions; ++i)
+		{
+			printf("%8u  %-3s %s\n", nodes[i].frame, flag_string(nodes[i].flags),
+			       image.functions[i].name);
+		}
+		printf("\n");
+	}
+
+	printf("worst case stack:\n");
+	if(num_entries)
+	{
+		int e;
+		for(e = 0; e < num_entries; ++e)
+		{
+			for(i = 0; i < image.num_functions; ++i)
+			{
+				if(!strcmp(image.functions[i].name, entries[e]))
+				{
+					break;
+				}
+			}
+			if(i == image.num_functions)
+			{
+				fprintf(stderr, "btrace_stack: %s not found\n", entries[e]);
+				failed = 1;
+				continue;
+			}
+			report(i, verbose);
+		}
+	}
+	else
+	{
+		for(i = 0; i < image.num_functions; ++i)
+		{
+			if(!nodes[i].called)
+			{
+				report(i, verbose);
+			}
+		}
+	}
+
+	for(i = 0; i < image.num_functions; ++i)
+	{
+		free(nodes[i].edges);
+	}
+	free(nodes);
+	free(entries);
+	elf32_close(&image);
+	return failed;
+}
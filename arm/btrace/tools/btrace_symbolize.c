@@ -0,0 +1,295 @@
+/*
+ * The MIT License
+ *
+ * Copyright (c) 2013 Rakesh D Nair
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+/*
+ * btrace_symbolize: annotates btrace output with function names and
+ * source lines, replacing one addr2line process per PC.
+ *
+ * usage: btrace_symbolize [-j threads] [-r] image.elf input...
+ *
+ *   input  log file containing "#NN: PC= ..." lines, or a directory of
+ *          such files. Other lines are copied unchanged.
+ *   -r     inputs are binary frame record dumps (see btrace_records)
+ *   -j     number of worker threads (default: number of online CPUs)
+ *
+ * The image is mapped and indexed once; inputs are then symbolized in
+ * parallel and printed in the order they were given.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "arm_btrace.h"
+#include "elf32_image.h"
+#include "elf32_lines.h"
+#include "tool_files.h"
+
+#define RECORD_SIZE 24
+
+typedef struct Job {
+	char*  path;
+	char*  output;
+	size_t output_size;
+	int    done;
+} job_t;
+
+typedef struct Symbolizer {
+	elf32_image_t   image;
+	elf32_lines_t   lines;
+	int             records;
+	job_t*          jobs;
+	int             num_jobs;
+	int             next_job;
+	pthread_mutex_t lock;
+	pthread_cond_t  job_done;
+} symbolizer_t;
+
+static void print_symbol(FILE* out, const symbolizer_t* sym, Elf32_Addr pc)
+{
+	const elf32_function_t* fn = elf32_find_function(&sym->image, pc);
+	const line_row_t* row = elf32_find_line(&sym->lines, pc);
+
+	if(fn)
+	{
+		fprintf(out, "  %s+0x%x", fn->name, pc - fn->start);
+	}
+	else
+	{
+		fprintf(out, "  ??");
+	}
+	if(row)
+	{
+		fprintf(out, " at %s:%u", sym->lines.files[row->file], row->line);
+	}
+}
+
+static void symbolize_text(FILE* in, FILE* out, const symbolizer_t* sym)
+{
+	char line[512];
+
+	while(fgets(line, sizeof(line), in))
+	{
+		size_t len = strlen(line);
+		const char* pc_text = strstr(line, "PC=");
+		char* end;
+		unsigned long pc;
+
+		if(!pc_text)
+		{
+			fputs(line, out);
+			continue;
+		}
+		pc = strtoul(pc_text + 3, &end, 16);
+		if(end == pc_text + 3)
+		{
+			fputs(line, out);
+			continue;
+		}
+		while(len && ((line[len - 1] == '\n') || (line[len - 1] == '\r')))
+		{
+			line[--len] = 0;
+		}
+		fputs(line, out);
+		print_symbol(out, sym, (Elf32_Addr)pc);
+		fputc('\n', out);
+	}
+}
+
+static void symbolize_records(FILE* in, FILE* out, const symbolizer_t* sym)
+{
+	unsigned char bytes[RECORD_SIZE];
+	unsigned int count = 0;
+
+	while(fread(bytes, sizeof(bytes), 1, in) == 1)
+	{
+		unsigned int index = tool_get_le(bytes + 20, 2);
+		unsigned int flags = tool_get_le(bytes + 22, 2);
+
+		if(!(flags & BT_RECORD_VALID) || (index != count))
+		{
+			break;
+		}
+		fprintf(out, "#%02d: PC= %x, SP= %x, LR= %x, FP= %x, callerSP= %x", index,
+		        tool_get_le(bytes, 4), tool_get_le(bytes + 4, 4), tool_get_le(bytes + 8, 4),
+		        tool_get_le(bytes + 12, 4), tool_get_le(bytes + 16, 4));
+		print_symbol(out, sym, tool_get_le(bytes, 4));
+		fputc('\n', out);
+		++count;
+	}
+}
+
+static void run_job(symbolizer_t* sym, job_t* job)
+{
+	FILE* out = open_memstream(&job->output, &job->output_size);
+	FILE* in = fopen(job->path, sym->records ? "rb" : "r");
+
+	if(!out)
+	{
+		perror("open_memstream");
+		if(in)
+		{
+			fclose(in);
+		}
+		return;
+	}
+	if(!in)
+	{
+		fprintf(out, "error: cannot open %s\n", job->path);
+	}
+	else
+	{
+		fprintf(out, "%s:\n", job->path);
+		if(sym->records)
+		{
+			symbolize_records(in, out, sym);
+		}
+		else
+		{
+			symbolize_text(in, out, sym);
+		}
+		fclose(in);
+	}
+	fclose(out);
+}
+
+static void* worker(void* arg)
+{
+	symbolizer_t* sym = (symbolizer_t*)arg;
+	for(;;)
+	{
+		int index = __sync_fetch_and_add(&sym->next_job, 1);
+		if(index >= sym->num_jobs)
+		{
+			return 0;
+		}
+		run_job(sym, &sym->jobs[index]);
+
+		pthread_mutex_lock(&sym->lock);
+		sym->jobs[index].done = 1;
+		pthread_cond_broadcast(&sym->job_done);
+		pthread_mutex_unlock(&sym->lock);
+	}
+}
+
+/*ToolFileFnPtr queueing every input file*/
+static int add_job(void* user, const char* path, const struct stat* st)
+{
+	symbolizer_t* sym = (symbolizer_t*)user;
+
+	if(!(sym->num_jobs & 255))
+	{
+		sym->jobs = realloc(sym->jobs, (sym->num_jobs + 256) * sizeof(job_t));
+	}
+	memset(&sym->jobs[sym->num_jobs], 0, sizeof(job_t));
+	sym->jobs[sym->num_jobs++].path = strdup(path);
+	return 0;
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: btrace_symbolize [-j threads] [-r] image.elf input...\n");
+	exit(2);
+}
+
+int main(int argc, char** argv)
+{
+	static symbolizer_t sym;
+	pthread_t* threads;
+	int num_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	int i, opt;
+
+	while((opt = getopt(argc, argv, "j:r")) != -1)
+	{
+		switch(opt)
+		{
+			case 'j': num_threads = atoi(optarg); break;
+			case 'r': sym.records = 1; break;
+			default: usage();
+		}
+	}
+	if(optind + 2 > argc)
+	{
+		usage();
+	}
+	if(elf32_open(&sym.image, argv[optind]) < 0)
+	{
+		return 1;
+	}
+	if(elf32_load_lines(&sym.image, &sym.lines) <= 0)
+	{
+		fprintf(stderr, "warning: no line information in %s\n", argv[optind]);
+	}
+	for(++optind; optind < argc; ++optind)
+	{
+		tool_walk_path(argv[optind], add_job, &sym);
+	}
+
+	if(num_threads < 1)
+	{
+		num_threads = 1;
+	}
+	if(num_threads > sym.num_jobs)
+	{
+		num_threads = sym.num_jobs ? sym.num_jobs : 1;
+	}
+	pthread_mutex_init(&sym.lock, 0);
+	pthread_cond_init(&sym.job_done, 0);
+	threads = calloc(num_threads, sizeof(pthread_t));
+	for(i = 0; i < num_threads; ++i)
+	{
+		pthread_create(&threads[i], 0, worker, &sym);
+	}
+
+	/*print in input order as results become available*/
+	for(i = 0; i < sym.num_jobs; ++i)
+	{
+		job_t* job = &sym.jobs[i];
+		pthread_mutex_lock(&sym.lock);
+		while(!job->done)
+		{
+			pthread_cond_wait(&sym.job_done, &sym.lock);
+		}
+		pthread_mutex_unlock(&sym.lock);
+		if(job->output)
+		{
+			fwrite(job->output, 1, job->output_size, stdout);
+		}
+		free(job->output);
+		free(job->path);
+	}
+
+	for(i = 0; i < num_threads; ++i)
+	{
+		pthread_join(threads[i], 0);
+	}
+	free(threads);
+	free(sym.jobs);
+	elf32_free_lines(&sym.lines);
+	elf32_close(&sym.image);
+	return 0;
+}
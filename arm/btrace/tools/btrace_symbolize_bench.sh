@@ -0,0 +1,108 @@
+#!/bin/sh
+#
+# The MIT License
+#
+# Copyright (c) 2013 Rakesh D Nair
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in
+# all copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+# THE SOFTWARE.
+#
+
+# btrace_symbolize_bench.sh: times tools/btrace_symbolize against
+# addr2line on the same PCs of an image.
+#
+# usage: btrace_symbolize_bench.sh image.elf [lines] [logs]
+#
+#   lines  "#NN: PC= ..." lines per log (default 2000)
+#   logs   number of logs (default 4)
+#
+# The PCs are taken from the function symbols of the image, a few
+# instructions into each function. Three runs are timed on the same logs:
+# btrace_symbolize over all of them, addr2line started once per PC (what
+# btrace_symbolize replaces) and addr2line started once per log with all
+# its PCs. Prints CSV: method,pcs,seconds,us_per_pc
+# ADDR2LINE and NM select the binutils used, e.g. arm-none-eabi-addr2line.
+
+set -e
+
+if [ $# -lt 1 ]; then
+	echo "usage: btrace_symbolize_bench.sh image.elf [lines] [logs]" >&2
+	exit 2
+fi
+
+IMAGE=$1
+LINES=${2:-2000}
+LOGS=${3:-4}
+ADDR2LINE=${ADDR2LINE:-addr2line}
+NM=${NM:-nm}
+TOOLS=$(dirname "$0")
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+# one PC per function, 8 bytes into its body (thumb bit cleared)
+"$NM" --defined-only "$IMAGE" | awk '$2 ~ /^[Tt]$/ && $3 !~ /^\$/ { print $1 }' | while read -r addr; do
+	printf "%x\n" $(((0x$addr & ~1) + 8))
+done > "$WORK/pcs"
+if [ ! -s "$WORK/pcs" ]; then
+	echo "error: no functions found in $IMAGE" >&2
+	exit 1
+fi
+
+mkdir "$WORK/logs"
+for log in $(seq 1 "$LOGS"); do
+	awk -v lines="$LINES" -v seed="$log" '
+		{ pc[n++] = $1 }
+		END {
+			srand(seed)
+			for(i = 0; i < lines; ++i)
+				printf "#%02d: PC= %s, SP= 20007bc0, LR= 0, FP= 0, callerSP= 20007bc8\n", i % 32, pc[int(rand() * n)]
+		}' "$WORK/pcs" > "$WORK/logs/$log.txt"
+	sed 's/.*PC= \([0-9a-f]*\),.*/0x\1/' "$WORK/logs/$log.txt" > "$WORK/logs/$log.pcs"
+done
+PCS=$((LINES * LOGS))
+
+now()
+{
+	date +%s.%N
+}
+
+report()
+{
+	awk -v m="$1" -v n="$PCS" -v t0="$2" -v t1="$3" \
+		'BEGIN { printf "%s,%d,%.3f,%.2f\n", m, n, t1 - t0, (t1 - t0) * 1e6 / n }'
+}
+
+echo "method,pcs,seconds,us_per_pc"
+
+t0=$(now)
+"$TOOLS/btrace_symbolize" "$IMAGE" "$WORK/logs"/*.txt > /dev/null
+report btrace_symbolize "$t0" "$(now)"
+
+t0=$(now)
+for log in "$WORK/logs"/*.pcs; do
+	while read -r pc; do
+		"$ADDR2LINE" -f -e "$IMAGE" "$pc" > /dev/null
+	done < "$log"
+done
+report addr2line_per_pc "$t0" "$(now)"
+
+t0=$(now)
+for log in "$WORK/logs"/*.pcs; do
+	"$ADDR2LINE" -f -e "$IMAGE" < "$log" > /dev/null
+done
+report addr2line_per_log "$t0" "$(now)"
@@ -0,0 +1,635 @@
+/*
+ * The MIT License
+ *
+ * Copyright (c) 2013 Rakesh D Nair
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+/*
+ * btrace_triage: groups the traces found in crash logs by call stack and
+ * ranks the groups (buckets) by the number of traces in them.
+ *
+ * usage: btrace_triage [-j threads] [-d depth] [-e image.elf] [-n top] [-c chunkMB] input...
+ *
+ *   input  log file with "#NN: PC= ..." lines as printed by the target,
+ *          btrace_unwind, btrace_crash_emit or btrace_symbolize, a
+ *          bt_snapshot_t file, or a directory of such files (recursive)
+ *   -d     innermost frames that make up the signature (default 8, 0 = all)
+ *   -e     image the traces were taken from. PCs are matched by the
+ *          function containing them, so traces that differ only in the
+ *          call sites within the same functions share a bucket, and
+ *          frames are printed with function names. Snapshots need it.
+ *   -n     print only the top buckets
+ *   -j     number of worker threads (default: number of online CPUs)
+ *   -c     text files are split into pieces of this many MB that are
+ *          read in parallel (default 64)
+ *
+ * Input is read a line at a time, so memory depends on the number of
+ * different stacks rather than on the size of the logs. Each worker fills
+ * its own table and the tables are merged at the end. A trace is dated
+ * by the modification time of its file. Snapshots are unwound by
+ * scanning, in parallel, each with its own memory reader.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "arm_btrace.h"
+#include "elf32_image.h"
+#include "tool_files.h"
+
+#define TRIAGE_MAX_DEPTH   64
+#define TRIAGE_LINE_SIZE   1024
+
+/*FNV-1a*/
+#define TRIAGE_HASH_SEED   0x811C9DC5
+#define TRIAGE_HASH_PRIME  0x01000193
+
+typedef struct Bucket {
+	bt_uint32_t hash;
+	bt_uint32_t count;         /* 0 = unused slot                          */
+	int         depth;
+	time_t      first;
+	time_t      last;
+	const char* example;       /* file holding the first trace             */
+	bt_uint32_t keys[TRIAGE_MAX_DEPTH]; /* PCs, or function starts with -e  */
+	bt_uint32_t pcs[TRIAGE_MAX_DEPTH];  /* PCs of the first trace           */
+} bucket_t;
+
+typedef struct BucketTable {
+	bucket_t* slots;
+	int       size;            /* power of 2                               */
+	int       used;
+} bucket_table_t;
+
+typedef struct Job {
+	const char* path;
+	off_t       offset;        /* text: traces starting in [offset, end)   */
+	off_t       end;
+	time_t      mtime;
+	int         snapshot;
+} job_t;
+
+typedef struct Triage {
+	elf32_image_t   image;
+	int             symbols;   /* image loaded                             */
+	int             depth;
+	job_t*          jobs;
+	int             num_jobs;
+	int             next_job;
+	char**          paths;
+	int             num_paths;
+	off_t           chunk;
+} triage_t;
+
+typedef struct Worker {
+	triage_t*       triage;
+	bucket_table_t  table;
+	pthread_t       thread;
+	unsigned long   traces;
+	unsigned long   bad_inputs;
+	off_t           bytes;
+} worker_t;
+
+/*trace being collected*/
+typedef struct Trace {
+	int         frames;        /* frames seen, -1 = no trace               */
+	bt_uint32_t pcs[TRIAGE_MAX_DEPTH];
+} trace_t;
+
+static int same_bucket(const bucket_t* a, const bucket_t* b)
+{
+	return (a->hash == b->hash) && (a->depth == b->depth) &&
+	       !memcmp(a->keys, b->keys, a->depth * sizeof(bt_uint32_t));
+}
+
+static void table_grow(bucket_table_t* table)
+{
+	bucket_t* old = table->slots;
+	int old_size = table->size;
+	int i;
+
+	table->size = old_size ? 2 * old_size : 1024;
+	table->slots = calloc(table->size, sizeof(bucket_t));
+	if(!table->slots)
+	{
+		fprintf(stderr, "error: out of memory\n");
+		exit(1);
+	}
+	for(i = 0; i < old_size; ++i)
+	{
+		if(old[i].count)
+		{
+			int slot = old[i].hash & (table->size - 1);
+			while(table->slots[slot].count)
+			{
+				slot = (slot + 1) & (table->size - 1);
+			}
+			table->slots[slot] = old[i];
+		}
+	}
+	free(old);
+}
+
+/*adds count traces of bucket b to the table*/
+static void table_add(bucket_table_t* table, const bucket_t* b)
+{
+	int slot;
+
+	if(2 * (table->used + 1) > table->size)
+	{
+		table_grow(table);
+	}
+	/*linear probing*/
+	for(slot = b->hash & (table->size - 1); table->slots[slot].count; slot = (slot + 1) & (table->size - 1))
+	{
+		bucket_t* entry = &table->slots[slot];
+		if(same_bucket(entry, b))
+		{
+			entry->count += b->count;
+			if(b->first < entry->first)
+			{
+				entry->first = b->first;
+				entry->example = b->example;
+				memcpy(entry->pcs, b->pcs, b->depth * sizeof(bt_uint32_t));
+			}
+			if(b->last > entry->last)
+			{
+				entry->last = b->last;
+			}
+			return;
+		}
+	}
+	table->slots[slot] = *b;
+	++table->used;
+}
+
+static bt_uint32_t normalize_pc(const triage_t* triage, bt_uint32_t pc)
+{
+	if(triage->symbols)
+	{
+		const elf32_function_t* fn = elf32_find_function(&triage->image, pc);
+		if(fn)
+		{
+			return fn->start;
+		}
+	}
+	return pc;
+}
+
+/*files the collected trace, if any, and starts over*/
+static void flush_trace(worker_t* worker, const job_t* job, trace_t* trace)
+{
+	triage_t* triage = worker->triage;
+	bucket_t b;
+	int frame;
+
+	if(trace->frames <= 0)
+	{
+		trace->frames = -1;
+		return;
+	}
+	b.depth = trace->frames;
+	if(triage->depth && (b.depth > triage->depth))
+	{
+		b.depth = triage->depth;
+	}
+	if(b.depth > TRIAGE_MAX_DEPTH)
+	{
+		b.depth = TRIAGE_MAX_DEPTH;
+	}
+	b.hash = TRIAGE_HASH_SEED;
+	for(frame = 0; frame < b.depth; ++frame)
+	{
+		bt_uint32_t key = normalize_pc(triage, trace->pcs[frame]);
+		int byte;
+		for(byte = 0; byte < 4; ++byte)
+		{
+			b.hash = (b.hash ^ ((key >> (8 * byte)) & 0xFF)) * TRIAGE_HASH_PRIME;
+		}
+		b.keys[frame] = key;
+		b.pcs[frame] = trace->pcs[frame];
+	}
+	b.count = 1;
+	b.first = b.last = job->mtime;
+	b.example = job->path;
+	table_add(&worker->table, &b);
+	++worker->traces;
+	trace->frames = -1;
+}
+
+/*returns the index of a "#NN: ... PC= x" line and its PC, or -1*/
+static int parse_frame(const char* line, bt_uint32_t* pc)
+{
+	const char* pc_text = strstr(line, "PC=");
+	const char* hash;
+	char* end;
+
+	if(!pc_text)
+	{
+		return -1;
+	}
+	for(hash = strchr(line, '#'); hash && (hash < pc_text); hash = strchr(hash + 1, '#'))
+	{
+		if(isdigit((unsigned char)hash[1]))
+		{
+			long index = strtol(hash + 1, &end, 10);
+			if(*end == ':')
+			{
+				unsigned long value = strtoul(pc_text + 3, &end, 16);
+				if(end == pc_text + 3)
+				{
+					return -1;
+				}
+				*pc = (bt_uint32_t)value;
+				return (int)index;
+			}
+		}
+	}
+	return -1;
+}
+
+/*reads the rest of a line longer than the buffer, returns bytes read*/
+static size_t skip_line(FILE* in, const char* line)
+{
+	size_t len = strlen(line);
+	size_t skipped = 0;
+	int c;
+
+	if(len && (line[len - 1] == '\n'))
+	{
+		return 0;
+	}
+	while(((c = getc(in)) != EOF) && (c != '\n'))
+	{
+		++skipped;
+	}
+	return skipped + (c == '\n');
+}
+
+static void triage_text(worker_t* worker, const job_t* job)
+{
+	FILE* in = fopen(job->path, "r");
+	char line[TRIAGE_LINE_SIZE];
+	trace_t trace;
+	off_t pos = job->offset;
+
+	if(!in)
+	{
+		perror(job->path);
+		++worker->bad_inputs;
+		return;
+	}
+	if(job->offset && (fseeko(in, job->offset - 1, SEEK_SET) == 0))
+	{   /*the line running into the piece belongs to the previous piece*/
+		if(fgets(line, sizeof(line), in))
+		{
+			pos += strlen(line) - 1 + skip_line(in, line);
+		}
+	}
+
+	trace.frames = -1;
+	while(fgets(line, sizeof(line), in))
+	{
+		off_t line_start = pos;
+		bt_uint32_t pc;
+		int index = parse_frame(line, &pc);
+
+		pos += strlen(line) + skip_line(in, line);
+		if(index == 0)
+		{
+			flush_trace(worker, job, &trace);
+			if(line_start >= job->end)
+			{   /*first trace of the next piece*/
+				break;
+			}
+			trace.frames = 0;
+		}
+		else if((index < 0) || (index != trace.frames))
+		{
+			flush_trace(worker, job, &trace);
+			if(line_start >= job->end)
+			{
+				break;
+			}
+			continue;
+		}
+		if(trace.frames < TRIAGE_MAX_DEPTH)
+		{
+			trace.pcs[trace.frames] = pc;
+		}
+		++trace.frames;
+	}
+	flush_trace(worker, job, &trace);
+	worker->bytes += ((pos < job->end) ? pos : job->end) - job->offset;
+	fclose(in);
+}
+
+/*TraceCallbackFnPtr collecting the PCs into the trace in ctx->user*/
+static int collect_pc(int frameIndex, bt_stackframe_t* pFrame, bt_uint32_t* sp_high)
+{
+	trace_t* trace = (trace_t*)((bt_unwind_ctx_t*)pFrame)->user;
+
+	trace->pcs[frameIndex] = pFrame->pc;
+	trace->frames = frameIndex + 1;
+	return 0;
+}
+
+static void triage_snapshot(worker_t* worker, const job_t* job)
+{
+	triage_t* triage = worker->triage;
+	tool_snapshot_t snapshot;
+	bt_unwind_ctx_t ctx;
+	trace_t trace;
+
+	if(tool_snapshot_load(&snapshot, &triage->image, job->path) < 0)
+	{
+		++worker->bad_inputs;
+		return;
+	}
+
+	trace.frames = 0;
+	btrace_init_context(&ctx);
+	ctx.frame = snapshot.header.frame;
+	ctx.max_frames = TRIAGE_MAX_DEPTH;
+	ctx.callback_fn = collect_pc;
+	ctx.user = &trace;
+	ctx.reader = &snapshot.reader;
+	btrace_unwind(&ctx);
+
+	flush_trace(worker, job, &trace);
+	worker->bytes += sizeof(snapshot.header) + snapshot.header.num_words * sizeof(bt_uint32_t);
+	tool_snapshot_free(&snapshot);
+}
+
+static void* worker_main(void* arg)
+{
+	worker_t* worker = (worker_t*)arg;
+	triage_t* triage = worker->triage;
+
+	for(;;)
+	{
+		int index = __sync_fetch_and_add(&triage->next_job, 1);
+		if(index >= triage->num_jobs)
+		{
+			return 0;
+		}
+		if(triage->jobs[index].snapshot)
+		{
+			triage_snapshot(worker, &triage->jobs[index]);
+		}
+		else
+		{
+			triage_text(worker, &triage->jobs[index]);
+		}
+	}
+}
+
+static void add_job(triage_t* triage, const job_t* job)
+{
+	if(!(triage->num_jobs & 255))
+	{
+		triage->jobs = realloc(triage->jobs, (triage->num_jobs + 256) * sizeof(job_t));
+	}
+	triage->jobs[triage->num_jobs++] = *job;
+}
+
+/*ToolFileFnPtr splitting every input file into jobs*/
+static int add_input(void* user, const char* path, const struct stat* st)
+{
+	triage_t* triage = (triage_t*)user;
+	bt_uint32_t magic = 0;
+	job_t job;
+	FILE* in;
+
+	if(!S_ISREG(st->st_mode) || !st->st_size)
+	{
+		return 0;
+	}
+
+	if((in = fopen(path, "rb")) != 0)
+	{
+		if(fread(&magic, sizeof(magic), 1, in) != 1)
+		{
+			magic = 0;
+		}
+		fclose(in);
+	}
+	if((magic == BT_SNAPSHOT_MAGIC) && !triage->symbols)
+	{
+		fprintf(stderr, "warning: %s: snapshots need -e image.elf, skipped\n", path);
+		return 0;
+	}
+
+	if(!(triage->num_paths & 255))
+	{
+		triage->paths = realloc(triage->paths, (triage->num_paths + 256) * sizeof(char*));
+	}
+	triage->paths[triage->num_paths] = strdup(path);
+	memset(&job, 0, sizeof(job));
+	job.path = triage->paths[triage->num_paths++];
+	job.mtime = st->st_mtime;
+
+	if(magic == BT_SNAPSHOT_MAGIC)
+	{
+		job.snapshot = 1;
+		add_job(triage, &job);
+		return 0;
+	}
+	for(job.offset = 0; job.offset < st->st_size; job.offset = job.end)
+	{
+		job.end = (st->st_size - job.offset > triage->chunk) ? (job.offset + triage->chunk) : st->st_size;
+		add_job(triage, &job);
+	}
+	return 0;
+}
+
+static int compare_buckets(const void* a, const void* b)
+{
+	const bucket_t* ba = *(const bucket_t* const*)a;
+	const bucket_t* bb = *(const bucket_t* const*)b;
+
+	if(ba->count != bb->count)
+	{
+		return (ba->count > bb->count) ? -1 : 1;
+	}
+	return (ba->first < bb->first) ? -1 : (ba->first > bb->first);
+}
+
+static void format_time(char* text, size_t size, time_t when)
+{
+	struct tm tm;
+	gmtime_r(&when, &tm);
+	strftime(text, size, "%Y-%m-%d %H:%M:%S", &tm);
+}
+
+static void print_buckets(const triage_t* triage, const bucket_table_t* table, unsigned long traces, int top)
+{
+	bucket_t** sorted = malloc((table->used + 1) * sizeof(bucket_t*));
+	int i, n = 0;
+
+	for(i = 0; i < table->size; ++i)
+	{
+		if(table->slots[i].count)
+		{
+			sorted[n++] = &table->slots[i];
+		}
+	}
+	qsort(sorted, n, sizeof(bucket_t*), compare_buckets);
+	if(top && (top < n))
+	{
+		n = top;
+	}
+	for(i = 0; i < n; ++i)
+	{
+		const bucket_t* b = sorted[i];
+		char first[32], last[32];
+		int frame;
+
+		format_time(first, sizeof(first), b->first);
+		format_time(last, sizeof(last), b->last);
+		printf("bucket %d: count= %u (%.1f%%), first= %s, last= %s, e.g. %s\n", i + 1, b->count,
+		       100.0 * b->count / traces, first, last, b->example);
+		for(frame = 0; frame < b->depth; ++frame)
+		{
+			const elf32_function_t* fn = triage->symbols ? elf32_find_function(&triage->image, b->pcs[frame]) : 0;
+			printf("#%02d: PC= %x", frame, b->pcs[frame]);
+			if(fn)
+			{
+				printf("  %s+0x%x", fn->name, b->pcs[frame] - fn->start);
+			}
+			else if(triage->symbols)
+			{
+				printf("  ??");
+			}
+			putchar('\n');
+		}
+	}
+	free(sorted);
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: btrace_triage [-j threads] [-d depth] [-e image.elf] [-n top] [-c chunkMB] input...\n");
+	exit(2);
+}
+
+int main(int argc, char** argv)
+{
+	static triage_t triage;
+	bucket_table_t merged;
+	worker_t* workers;
+	struct timespec start, stop;
+	unsigned long traces = 0, bad_inputs = 0;
+	off_t bytes = 0;
+	int num_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	int top = 0, chunk_mb = 64;
+	int i, j, opt;
+
+	triage.depth = 8;
+	while((opt = getopt(argc, argv, "j:d:e:n:c:")) != -1)
+	{
+		switch(opt)
+		{
+			case 'j': num_threads = atoi(optarg); break;
+			case 'd': triage.depth = atoi(optarg); break;
+			case 'n': top = atoi(optarg); break;
+			case 'c': chunk_mb = atoi(optarg); break;
+			case 'e':
+				if(elf32_open(&triage.image, optarg) < 0)
+				{
+					return 1;
+				}
+				triage.symbols = 1;
+				break;
+			default: usage();
+		}
+	}
+	if((optind >= argc) || (triage.depth < 0) || (chunk_mb < 1))
+	{
+		usage();
+	}
+	triage.chunk = (off_t)chunk_mb << 20;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(; optind < argc; ++optind)
+	{
+		tool_walk_path(argv[optind], add_input, &triage);
+	}
+	if(num_threads < 1)
+	{
+		num_threads = 1;
+	}
+	if(num_threads > triage.num_jobs)
+	{
+		num_threads = triage.num_jobs ? triage.num_jobs : 1;
+	}
+
+	workers = calloc(num_threads, sizeof(worker_t));
+	for(i = 0; i < num_threads; ++i)
+	{
+		workers[i].triage = &triage;
+		pthread_create(&workers[i].thread, 0, worker_main, &workers[i]);
+	}
+	memset(&merged, 0, sizeof(merged));
+	table_grow(&merged);
+	for(i = 0; i < num_threads; ++i)
+	{
+		pthread_join(workers[i].thread, 0);
+		for(j = 0; j < workers[i].table.size; ++j)
+		{
+			if(workers[i].table.slots[j].count)
+			{
+				table_add(&merged, &workers[i].table.slots[j]);
+			}
+		}
+		free(workers[i].table.slots);
+		traces += workers[i].traces;
+		bad_inputs += workers[i].bad_inputs;
+		bytes += workers[i].bytes;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &stop);
+
+	print_buckets(&triage, &merged, traces, top);
+	fprintf(stderr, "%lu traces in %d buckets from %d files (%lu unreadable), %.1f MB in %.0f ms\n",
+	        traces, merged.used, triage.num_paths, bad_inputs, bytes / 1048576.0,
+	        (stop.tv_sec - start.tv_sec) * 1e3 + (stop.tv_nsec - start.tv_nsec) / 1e6);
+
+	free(merged.slots);
+	free(workers);
+	free(triage.jobs);
+	for(i = 0; i < triage.num_paths; ++i)
+	{
+		free(triage.paths[i]);
+	}
+	free(triage.paths);
+	if(triage.symbols)
+	{
+		elf32_close(&triage.image);
+	}
+	return 0;
+}
@@ -0,0 +1,182 @@
+/*
+ * The MIT License
+ *
+ * Copyright (c) 2013 Rakesh D Nair
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+/*
+ * btrace_unwind: unwinds captured stacks on the host using the same
+ * engine as the target (libbtrace_host.a, see "make host").
+ *
+ * usage: btrace_unwind [-n maxFrames] [-t table.bin] [-e engine] image.elf snapshot...
+ *
+ *   image.elf  linked image the snapshots were taken from, code and
+ *              read only data are read from its sections
+ *   snapshot   bt_snapshot_t header followed by the captured stack words
+ *   -t         unwind table written by "btrace_mktable -b"
+ *   -n         maximum number of frames per snapshot (default 32)
+ *   -e         scan (default), exidx, exidx+scan or fp+scan, see
+ *              BT_ENGINE_xxx; exidx uses the .ARM.exidx section of the image
+ *
+ * Output is the same "#NN: PC= ..." text printed by the target.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "arm_btrace.h"
+#include "elf32_image.h"
+#include "tool_files.h"
+
+static int print_line(char* message)
+{
+	fputs(message, stdout);
+	return 0;
+}
+
+/*loads records written by btrace_mktable -b*/
+static bt_unwind_entry_t* load_table(const char* path, int* num_entries)
+{
+	unsigned char record[12];
+	bt_unwind_entry_t* table = 0;
+	int count = 0, capacity = 0;
+	FILE* in = fopen(path, "rb");
+
+	if(!in)
+	{
+		perror(path);
+		return 0;
+	}
+	while(fread(record, sizeof(record), 1, in) == 1)
+	{
+		if(count == capacity)
+		{
+			capacity = capacity ? 2 * capacity : 256;
+			table = realloc(table, capacity * sizeof(bt_unwind_entry_t));
+		}
+		table[count].fn_start = tool_get_le(record, 4);
+		table[count].fn_words = tool_get_le(record + 4, 2);
+		table[count].sp_delta = tool_get_le(record + 6, 2);
+		table[count].prologue_words = record[8];
+		table[count].lr_slot = record[9];
+		table[count].fp_slot = record[10];
+		table[count].flags = record[11];
+		++count;
+	}
+	fclose(in);
+	*num_entries = count;
+	return table;
+}
+
+static int unwind_snapshot(const elf32_image_t* image, const char* path, int max_frames)
+{
+	tool_snapshot_t snapshot;
+	int frames;
+
+	if(tool_snapshot_load(&snapshot, image, path) < 0)
+	{
+		return -1;
+	}
+	btrace_set_mem_reader(&snapshot.reader);
+	*get_frame_ptr() = snapshot.header.frame;
+
+	printf("%s:\n", path);
+	frames = btrace_callstack(0, max_frames);
+	printf("stop: %s\n", btrace_stop_reason_name(btrace_last_stop_reason()));
+
+	btrace_set_mem_reader(0);
+	tool_snapshot_free(&snapshot);
+	return frames;
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: btrace_unwind [-n maxFrames] [-t table.bin] [-e engine] image.elf snapshot...\n");
+	exit(2);
+}
+
+int main(int argc, char** argv)
+{
+	elf32_image_t image;
+	bt_unwind_entry_t* table = 0;
+	int num_entries = 0, max_frames = 32, engine = BT_ENGINE_SCAN;
+	int opt, failed = 0;
+
+	while((opt = getopt(argc, argv, "n:t:e:")) != -1)
+	{
+		switch(opt)
+		{
+			case 'n': max_frames = atoi(optarg); break;
+			case 'e':
+				if(!strcmp(optarg, "scan"))            engine = BT_ENGINE_SCAN;
+				else if(!strcmp(optarg, "exidx"))      engine = BT_ENGINE_EXIDX;
+				else if(!strcmp(optarg, "exidx+scan")) engine = BT_ENGINE_EXIDX_SCAN;
+				else if(!strcmp(optarg, "fp+scan"))    engine = BT_ENGINE_FP_SCAN;
+				else usage();
+				break;
+			case 't':
+				if(!(table = load_table(optarg, &num_entries)))
+				{
+					return 1;
+				}
+				break;
+			default: usage();
+		}
+	}
+	if(optind + 2 > argc)
+	{
+		usage();
+	}
+	if(elf32_open(&image, argv[optind]) < 0)
+	{
+		return 1;
+	}
+	btrace_set_unwind_table(table, num_entries);
+	btrace_set_print_fn(print_line, max_frames);
+	if((engine == BT_ENGINE_EXIDX) || (engine == BT_ENGINE_EXIDX_SCAN))
+	{
+		const Elf32_Shdr* exidx = elf32_find_section(&image, ".ARM.exidx");
+		if(!exidx)
+		{
+			fprintf(stderr, "warning: %s has no .ARM.exidx section\n", argv[optind]);
+		}
+		else
+		{
+			btrace_set_exidx(exidx->sh_addr, exidx->sh_addr + exidx->sh_size);
+		}
+	}
+	btrace_set_engine(engine);
+
+	for(++optind; optind < argc; ++optind)
+	{
+		if(unwind_snapshot(&image, argv[optind], max_frames) < 0)
+		{
+			failed = 1;
+		}
+	}
+
+	elf32_close(&image);
+	free(table);
+	return failed;
+}
@@ -0,0 +1,373 @@
+/*
+ * The MIT License
+ *
+ * Copyright (c) 2013 Rakesh D Nair
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+/*
+ * btrace_window: decodes stack windows written by the encoder in
+ * btrace_window.h back into the exact words of every frame.
+ *
+ * usage: btrace_window [-o snapshot.bin] dump.bin
+ *
+ *   dump.bin  the bytes of the encoder buffer (btrace_window_finish
+ *             returns how many), e.g. saved by a debugger
+ *   -o        also write the frames as one bt_snapshot_t, registers of
+ *             the first frame and the words of all frames with gaps set
+ *             to 0, to be unwound with tools/btrace_unwind
+ *
+ * Each frame is printed as "#NN: PC= ..." followed by its words from
+ * SP_HI down to SP, one "@address: value" per line.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "btrace_window.h"
+
+/*larger frames are taken as a corrupt dump*/
+#define MAX_FRAME_WORDS 0x1000000
+
+typedef struct WindowFrame {
+	int             index;
+	bt_stackframe_t frame;
+	bt_uint32_t*    words;
+	bt_uint32_t     num_words;
+} window_frame_t;
+
+typedef struct WindowReader {
+	const unsigned char* data;
+	size_t               size;
+	size_t               pos;
+	int                  error;
+} window_reader_t;
+
+static bt_uint32_t get_byte(window_reader_t* in)
+{
+	if(in->pos >= in->size)
+	{
+		in->error = 1;
+		return 0;
+	}
+	return in->data[in->pos++];
+}
+
+static bt_uint32_t get_word(window_reader_t* in)
+{
+	bt_uint32_t value = get_byte(in);
+	value |= get_byte(in) << 8;
+	value |= get_byte(in) << 16;
+	value |= get_byte(in) << 24;
+	return value;
+}
+
+static bt_uint32_t get_varint(window_reader_t* in)
+{
+	bt_uint32_t value = 0;
+	bt_uint32_t byte;
+	int shift = 0;
+
+	do
+	{
+		byte = get_byte(in);
+		if(shift < 32)
+		{
+			value |= (byte & 0x7F) << shift;
+		}
+		shift += 7;
+	} while((byte & 0x80) && !in->error);
+	return value;
+}
+
+/*decodes the words of one frame, returns 0 on success*/
+static int decode_words(window_reader_t* in, window_frame_t* frame, bt_uint32_t text_start)
+{
+	bt_uint32_t previous = 0;
+	bt_uint32_t i = 0;
+
+	while((i < frame->num_words) && !in->error)
+	{
+		bt_uint32_t token = get_byte(in);
+		bt_uint32_t arg = token & 0x1F;
+		bt_uint32_t value;
+
+		switch(token >> 5)
+		{
+			case BT_WINDOW_OP_ZERO:
+			case BT_WINDOW_OP_REPEAT:
+			{
+				bt_uint32_t count = arg ? arg : get_varint(in);
+				bt_uint32_t word = ((token >> 5) == BT_WINDOW_OP_ZERO) ? 0 : previous;
+				if(count > frame->num_words - i)
+				{
+					return -1;
+				}
+				while(count--)
+				{
+					frame->words[i++] = word;
+				}
+				previous = word;
+				continue;
+			}
+			case BT_WINDOW_OP_RAW:
+				value = get_word(in);
+				break;
+			case BT_WINDOW_OP_CONTROL:
+				return -1;
+			default:
+				value = arg & 0xF;
+				if(arg & BT_WINDOW_VARINT_BIT)
+				{
+					value |= get_varint(in) << 4;
+				}
+				switch(token >> 5)
+				{
+					case BT_WINDOW_OP_INVERTED: value = ~value; break;
+					case BT_WINDOW_OP_TEXT:     value += text_start; break;
+					case BT_WINDOW_OP_STACK:    value += frame->frame.sp; break;
+					default: break;
+				}
+				break;
+		}
+		frame->words[i++] = value;
+		previous = value;
+	}
+	return in->error ? -1 : 0;
+}
+
+/*decodes all frames, returns number of frames or < 0 if the stream is not valid*/
+static int decode_stream(window_reader_t* in, window_frame_t** frames_ptr)
+{
+	window_frame_t* frames = 0;
+	int num_frames = 0;
+	bt_uint32_t text_start;
+
+	if(get_word(in) != BT_WINDOW_MAGIC)
+	{
+		return -1;
+	}
+	text_start = get_word(in);
+	get_word(in); /*text_end is only needed by the encoder*/
+
+	for(;;)
+	{
+		window_frame_t* frame;
+		bt_uint32_t token = get_byte(in);
+
+		if(in->error || (token == BT_WINDOW_END))
+		{   /*a dump cut short keeps the frames decoded so far*/
+			break;
+		}
+		if(token != BT_WINDOW_FRAME)
+		{
+			fprintf(stderr, "error: bad token %02x at offset %lu\n", token, (unsigned long)(in->pos - 1));
+			break;
+		}
+		frames = realloc(frames, (num_frames + 1) * sizeof(window_frame_t));
+		if(!frames)
+		{
+			perror("btrace_window");
+			exit(1);
+		}
+		frame = &frames[num_frames];
+		frame->index = (int)get_varint(in);
+		frame->frame.pc = get_word(in);
+		frame->frame.sp = get_word(in);
+		frame->frame.lr = get_word(in);
+		frame->frame.fp = get_word(in);
+		frame->num_words = get_varint(in);
+		if(in->error || (frame->num_words > MAX_FRAME_WORDS))
+		{
+			break;
+		}
+		frame->words = calloc(frame->num_words + 1, sizeof(bt_uint32_t));
+		if(!frame->words)
+		{
+			perror("btrace_window");
+			exit(1);
+		}
+		if(decode_words(in, frame, text_start) < 0)
+		{
+			fprintf(stderr, "error: frame %d is corrupt\n", frame->index);
+			free(frame->words);
+			break;
+		}
+		++num_frames;
+	}
+	*frames_ptr = frames;
+	return num_frames;
+}
+
+static void print_frames(const window_frame_t* frames, int num_frames)
+{
+	int i;
+
+	for(i = 0; i < num_frames; ++i)
+	{
+		const window_frame_t* frame = &frames[i];
+		bt_uint32_t w;
+
+		printf("#%02d: PC= %x, SP= %x, LR= %x, FP= %x, SP_HI= %x\n", frame->index,
+		       frame->frame.pc, frame->frame.sp, frame->frame.lr, frame->frame.fp,
+		       frame->frame.sp + (frame->num_words << 2) - 4);
+		for(w = frame->num_words; w > 0; --w)
+		{
+			printf("\t@%x: %x\n", frame->frame.sp + ((w - 1) << 2), frame->words[w - 1]);
+		}
+	}
+}
+
+static int write_snapshot(const window_frame_t* frames, int num_frames, const char* path)
+{
+	bt_snapshot_t header;
+	bt_uint32_t* stack;
+	bt_uint32_t low = 0xFFFFFFFF, high = 0;
+	FILE* out;
+	int i;
+
+	for(i = 0; i < num_frames; ++i)
+	{
+		if(!frames[i].num_words)
+		{
+			continue;
+		}
+		if(frames[i].frame.sp < low)
+		{
+			low = frames[i].frame.sp;
+		}
+		if(frames[i].frame.sp + (frames[i].num_words << 2) > high)
+		{
+			high = frames[i].frame.sp + (frames[i].num_words << 2);
+		}
+	}
+	if(!num_frames || (high <= low))
+	{
+		fprintf(stderr, "error: no stack words to write\n");
+		return -1;
+	}
+
+	header.magic = BT_SNAPSHOT_MAGIC;
+	header.frame = frames[0].frame;
+	header.stack_base = low;
+	header.num_words = (high - low) >> 2;
+	stack = calloc(header.num_words, sizeof(bt_uint32_t));
+	if(!stack)
+	{
+		perror("btrace_window");
+		return -1;
+	}
+	for(i = 0; i < num_frames; ++i)
+	{
+		if(frames[i].num_words)
+		{
+			memcpy(&stack[(frames[i].frame.sp - low) >> 2], frames[i].words,
+			       frames[i].num_words * sizeof(bt_uint32_t));
+		}
+	}
+
+	out = fopen(path, "wb");
+	if(!out)
+	{
+		perror(path);
+		free(stack);
+		return -1;
+	}
+	fwrite(&header, sizeof(header), 1, out);
+	fwrite(stack, sizeof(bt_uint32_t), header.num_words, out);
+	free(stack);
+	return fclose(out);
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: btrace_window [-o snapshot.bin] dump.bin\n");
+	exit(2);
+}
+
+int main(int argc, char** argv)
+{
+	window_reader_t in;
+	window_frame_t* frames = 0;
+	const char* out_path = 0;
+	unsigned char* data;
+	long size;
+	FILE* file;
+	int num_frames, i, opt, status = 0;
+
+	while((opt = getopt(argc, argv, "o:")) != -1)
+	{
+		switch(opt)
+		{
+			case 'o': out_path = optarg; break;
+			default: usage();
+		}
+	}
+	if(optind + 1 != argc)
+	{
+		usage();
+	}
+
+	file = fopen(argv[optind], "rb");
+	if(!file)
+	{
+		perror(argv[optind]);
+		return 1;
+	}
+	fseek(file, 0, SEEK_END);
+	size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	data = malloc(size > 0 ? size : 1);
+	if(!data || (fread(data, 1, size, file) != (size_t)size))
+	{
+		fprintf(stderr, "error: cannot read %s\n", argv[optind]);
+		fclose(file);
+		return 1;
+	}
+	fclose(file);
+
+	memset(&in, 0, sizeof(in));
+	in.data = data;
+	in.size = size;
+	num_frames = decode_stream(&in, &frames);
+	if(num_frames < 0)
+	{
+		fprintf(stderr, "error: %s: not a btrace stack window dump\n", argv[optind]);
+		free(data);
+		return 1;
+	}
+
+	print_frames(frames, num_frames);
+	if(out_path && (write_snapshot(frames, num_frames, out_path) != 0))
+	{
+		status = 1;
+	}
+
+	for(i = 0; i < num_frames; ++i)
+	{
+		free(frames[i].words);
+	}
+	free(frames);
+	free(data);
+	return status;
+}
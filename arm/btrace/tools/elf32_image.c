@@ -0,0 +1,339 @@
+/*
+ * The MIT License
+ *
+ * Copyright (c) 2013 Rakesh D Nair
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "elf32_image.h"
+
+/*mapping symbol collected while loading, used to find literal pools*/
+typedef struct MappingSymbol {
+	Elf32_Addr addr;
+	Elf32_Addr section_end;
+	int        is_data;
+} mapping_symbol_t;
+
+static int compare_functions(const void* a, const void* b)
+{
+	const elf32_function_t* fa = (const elf32_function_t*)a;
+	const elf32_function_t* fb = (const elf32_function_t*)b;
+	if(fa->start != fb->start)
+	{
+		return (fa->start < fb->start) ? -1 : 1;
+	}
+	/*sized symbol first so that it survives de-duplication*/
+	return (fa->end > fb->end) ? -1 : (fa->end < fb->end);
+}
+
+static int compare_mapping_symbols(const void* a, const void* b)
+{
+	const mapping_symbol_t* ma = (const mapping_symbol_t*)a;
+	const mapping_symbol_t* mb = (const mapping_symbol_t*)b;
+	return (ma->addr < mb->addr) ? -1 : (ma->addr > mb->addr);
+}
+
+static int is_exec_section(const elf32_image_t* image, Elf32_Half index)
+{
+	if((index == SHN_UNDEF) || (index >= image->ehdr->e_shnum))
+	{
+		return 0;
+	}
+	return (image->shdrs[index].sh_flags & SHF_EXECINSTR) != 0;
+}
+
+static int load_symbols(elf32_image_t* image)
+{
+	const Elf32_Shdr* symtab = 0;
+	const Elf32_Sym* syms;
+	const char* strtab;
+	mapping_symbol_t* maps;
+	int num_syms, num_maps = 0, i, n;
+
+	for(i = 0; i < image->ehdr->e_shnum; ++i)
+	{
+		if(image->shdrs[i].sh_type == SHT_SYMTAB)
+		{
+			symtab = &image->shdrs[i];
+			break;
+		}
+	}
+	if(!symtab)
+	{
+		fprintf(stderr, "error: image has no symbol table (stripped?)\n");
+		return -1;
+	}
+
+	syms = (const Elf32_Sym*)(image->data + symtab->sh_offset);
+	strtab = (const char*)(image->data + image->shdrs[symtab->sh_link].sh_offset);
+	num_syms = symtab->sh_size / sizeof(Elf32_Sym);
+
+	image->functions = calloc(num_syms + 1, sizeof(elf32_function_t));
+	maps = calloc(num_syms + 1, sizeof(mapping_symbol_t));
+	if(!image->functions || !maps)
+	{
+		free(maps);
+		fprintf(stderr, "error: out of memory\n");
+		return -1;
+	}
+
+	for(i = 0; i < num_syms; ++i)
+	{
+		const Elf32_Sym* sym = &syms[i];
+		const char* name = strtab + sym->st_name;
+
+		if(!is_exec_section(image, sym->st_shndx))
+		{
+			continue;
+		}
+		if((name[0] == '$') && name[1] && ((name[2] == 0) || (name[2] == '.')))
+		{   /*ARM ELF mapping symbol $a, $t or $d*/
+			const Elf32_Shdr* sec = &image->shdrs[sym->st_shndx];
+			maps[num_maps].addr = sym->st_value;
+			maps[num_maps].section_end = sec->sh_addr + sec->sh_size;
+			maps[num_maps].is_data = (name[1] == 'd');
+			++num_maps;
+		}
+		else if(ELF32_ST_TYPE(sym->st_info) == STT_FUNC)
+		{
+			elf32_function_t* fn = &image->functions[image->num_functions++];
+			fn->name = name;
+			fn->thumb = sym->st_value & 1;
+			fn->start = sym->st_value & ~1u;
+			fn->end = sym->st_size ? (fn->start + sym->st_size) : 0;
+		}
+	}
+
+	qsort(image->functions, image->num_functions, sizeof(elf32_function_t), compare_functions);
+	/*drop aliases and give unsized symbols the gap to the next function*/
+	for(i = 0, n = 0; i < image->num_functions; ++i)
+	{
+		if(n && (image->functions[n - 1].start == image->functions[i].start))
+		{
+			continue;
+		}
+		image->functions[n++] = image->functions[i];
+	}
+	image->num_functions = n;
+	for(i = 0; i < n; ++i)
+	{
+		elf32_function_t* fn = &image->functions[i];
+		if(!fn->end)
+		{
+			const Elf32_Shdr* sec = elf32_section_at(image, fn->start);
+			fn->end = sec ? (sec->sh_addr + sec->sh_size) : fn->start;
+			if((i + 1 < n) && (image->functions[i + 1].start < fn->end))
+			{
+				fn->end = image->functions[i + 1].start;
+			}
+		}
+	}
+
+	qsort(maps, num_maps, sizeof(mapping_symbol_t), compare_mapping_symbols);
+	image->data_ranges = calloc(2 * num_maps + 2, sizeof(Elf32_Addr));
+	for(i = 0; image->data_ranges && (i < num_maps); ++i)
+	{
+		if(maps[i].is_data)
+		{
+			Elf32_Addr end = maps[i].section_end;
+			if((i + 1 < num_maps) && (maps[i + 1].addr < end))
+			{
+				end = maps[i + 1].addr;
+			}
+			image->data_ranges[2 * image->num_data_ranges] = maps[i].addr;
+			image->data_ranges[2 * image->num_data_ranges + 1] = end;
+			++image->num_data_ranges;
+		}
+	}
+	free(maps);
+	return 0;
+}
+
+int elf32_open(elf32_image_t* image, const char* path)
+{
+	struct stat st;
+	int fd;
+
+	memset(image, 0, sizeof(*image));
+	fd = open(path, O_RDONLY);
+	if(fd < 0)
+	{
+		perror(path);
+		return -1;
+	}
+	if((fstat(fd, &st) < 0) || (st.st_size < (off_t)sizeof(Elf32_Ehdr)))
+	{
+		fprintf(stderr, "error: %s: not an ELF file\n", path);
+		close(fd);
+		return -1;
+	}
+	image->size = st.st_size;
+	image->data = mmap(0, image->size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(image->data == MAP_FAILED)
+	{
+		image->data = 0;
+		perror(path);
+		return -1;
+	}
+
+	image->ehdr = (const Elf32_Ehdr*)image->data;
+	if(memcmp(image->ehdr->e_ident, ELFMAG, SELFMAG) ||
+	   (image->ehdr->e_ident[EI_CLASS] != ELFCLASS32) ||
+	   (image->ehdr->e_ident[EI_DATA] != ELFDATA2LSB) ||
+	   (image->ehdr->e_machine != EM_ARM))
+	{
+		fprintf(stderr, "error: %s: not a 32 bit little endian ARM ELF file\n", path);
+		elf32_close(image);
+		return -1;
+	}
+	if(!image->ehdr->e_shoff ||
+	   (image->ehdr->e_shoff + (size_t)image->ehdr->e_shnum * sizeof(Elf32_Shdr) > image->size))
+	{
+		fprintf(stderr, "error: %s: bad section header table\n", path);
+		elf32_close(image);
+		return -1;
+	}
+	image->shdrs = (const Elf32_Shdr*)(image->data + image->ehdr->e_shoff);
+	image->shstrtab = (const char*)(image->data + image->shdrs[image->ehdr->e_shstrndx].sh_offset);
+
+	if(load_symbols(image) < 0)
+	{
+		elf32_close(image);
+		return -1;
+	}
+	return 0;
+}
+
+void elf32_close(elf32_image_t* image)
+{
+	if(image->data)
+	{
+		munmap((void*)image->data, image->size);
+	}
+	free(image->functions);
+	free(image->data_ranges);
+	memset(image, 0, sizeof(*image));
+}
+
+const Elf32_Shdr* elf32_find_section(const elf32_image_t* image, const char* name)
+{
+	int i;
+	for(i = 0; i < image->ehdr->e_shnum; ++i)
+	{
+		if(!strcmp(image->shstrtab + image->shdrs[i].sh_name, name))
+		{
+			return &image->shdrs[i];
+		}
+	}
+	return 0;
+}
+
+const Elf32_Shdr* elf32_section_at(const elf32_image_t* image, Elf32_Addr addr)
+{
+	int i;
+	for(i = 0; i < image->ehdr->e_shnum; ++i)
+	{
+		const Elf32_Shdr* sec = &image->shdrs[i];
+		/*any loaded section with contents in the file, e.g. .ARM.exidx*/
+		if((sec->sh_flags & SHF_ALLOC) && (sec->sh_type != SHT_NOBITS) && (sec->sh_type != SHT_NULL) &&
+		   (addr >= sec->sh_addr) && (addr - sec->sh_addr < sec->sh_size))
+		{
+			return sec;
+		}
+	}
+	return 0;
+}
+
+const void* elf32_addr_to_ptr(const elf32_image_t* image, Elf32_Addr addr, size_t len)
+{
+	const Elf32_Shdr* sec = elf32_section_at(image, addr);
+	if(!sec || (addr - sec->sh_addr + len > sec->sh_size) ||
+	   (sec->sh_offset + sec->sh_size > image->size))
+	{
+		return 0;
+	}
+	return image->data + sec->sh_offset + (addr - sec->sh_addr);
+}
+
+int elf32_read_word(const elf32_image_t* image, Elf32_Addr addr, Elf32_Word* value)
+{
+	const void* ptr = elf32_addr_to_ptr(image, addr, sizeof(Elf32_Word));
+	if(!ptr)
+	{
+		return -1;
+	}
+	memcpy(value, ptr, sizeof(Elf32_Word));
+	return 0;
+}
+
+int elf32_is_data(const elf32_image_t* image, Elf32_Addr addr)
+{
+	int low = 0, high = image->num_data_ranges - 1;
+	while(low <= high)
+	{
+		int mid = (low + high) >> 1;
+		if(addr < image->data_ranges[2 * mid])
+		{
+			high = mid - 1;
+		}
+		else if(addr >= image->data_ranges[2 * mid + 1])
+		{
+			low = mid + 1;
+		}
+		else
+		{
+			return 1;
+		}
+	}
+	return 0;
+}
+
+const elf32_function_t* elf32_find_function(const elf32_image_t* image, Elf32_Addr addr)
+{
+	int low = 0, high = image->num_functions - 1;
+	while(low <= high)
+	{
+		int mid = (low + high) >> 1;
+		const elf32_function_t* fn = &image->functions[mid];
+		if(addr < fn->start)
+		{
+			high = mid - 1;
+		}
+		else if(addr >= fn->end)
+		{
+			low = mid + 1;
+		}
+		else
+		{
+			return fn;
+		}
+	}
+	return 0;
+}
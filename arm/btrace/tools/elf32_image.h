@@ -0,0 +1,88 @@
+/*
+ * The MIT License
+ *
+ * Copyright (c) 2013 Rakesh D Nair
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef _ELF32_IMAGE_H_
+#define _ELF32_IMAGE_H_
+
+/*
+ * Minimal read only access to a linked 32 bit little endian ARM ELF image
+ * for the host side btrace tools. The file is memory mapped once and all
+ * lookups are served from the mapping.
+ */
+
+#include <stddef.h>
+#include <elf.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*function symbol, addresses have the thumb bit cleared*/
+typedef struct Elf32Function {
+	const char*  name;
+	Elf32_Addr   start;
+	Elf32_Addr   end;    /* first address after the function */
+	int          thumb;  /* 1 if symbol had the thumb bit set */
+} elf32_function_t;
+
+typedef struct Elf32Image {
+	const unsigned char* data;
+	size_t               size;
+	const Elf32_Ehdr*    ehdr;
+	const Elf32_Shdr*    shdrs;
+	const char*          shstrtab;
+	elf32_function_t*    functions;     /* sorted by start address */
+	int                  num_functions;
+	Elf32_Addr*          data_ranges;   /* sorted [start,end) pairs marked by $d mapping symbols */
+	int                  num_data_ranges;
+} elf32_image_t;
+
+/*returns 0 on success, < 0 on error (message printed to stderr)*/
+extern int elf32_open( elf32_image_t* image, const char* path );
+extern void elf32_close( elf32_image_t* image );
+
+/*returns section with the given name or NULL*/
+extern const Elf32_Shdr* elf32_find_section( const elf32_image_t* image, const char* name );
+
+/*returns section containing the loaded address or NULL*/
+extern const Elf32_Shdr* elf32_section_at( const elf32_image_t* image, Elf32_Addr addr );
+
+/*pointer to the file contents at a loaded address, NULL if not backed by the file*/
+extern const void* elf32_addr_to_ptr( const elf32_image_t* image, Elf32_Addr addr, size_t len );
+
+/*reads a 32 bit word at a loaded address, returns 0 on success*/
+extern int elf32_read_word( const elf32_image_t* image, Elf32_Addr addr, Elf32_Word* value );
+
+/*1 if the word at addr lies in a literal pool ($d mapping symbol)*/
+extern int elf32_is_data( const elf32_image_t* image, Elf32_Addr addr );
+
+/*binary search the function table, returns NULL if addr is not in a function*/
+extern const elf32_function_t* elf32_find_function( const elf32_image_t* image, Elf32_Addr addr );
+
+#ifdef __cplusplus
+} /*extern C */
+#endif
+
+#endif /*_ELF32_IMAGE_H_*/
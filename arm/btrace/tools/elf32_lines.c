@@ -0,0 +1,617 @@
+/*
+ * The MIT License
+ *
+ * Copyright (c) 2013 Rakesh D Nair
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "elf32_lines.h"
+
+/*DWARF constants used by the line number program*/
+#define DW_LNS_copy               1
+#define DW_LNS_advance_pc         2
+#define DW_LNS_advance_line       3
+#define DW_LNS_set_file           4
+#define DW_LNS_const_add_pc       8
+#define DW_LNS_fixed_advance_pc   9
+#define DW_LNE_end_sequence       1
+#define DW_LNE_set_address        2
+#define DW_LNCT_path              1
+#define DW_LNCT_directory_index   2
+#define DW_FORM_block2            0x03
+#define DW_FORM_block4            0x04
+#define DW_FORM_data2             0x05
+#define DW_FORM_data4             0x06
+#define DW_FORM_data8             0x07
+#define DW_FORM_string            0x08
+#define DW_FORM_block             0x09
+#define DW_FORM_block1            0x0a
+#define DW_FORM_data1             0x0b
+#define DW_FORM_strp              0x0e
+#define DW_FORM_udata             0x0f
+#define DW_FORM_data16            0x1e
+#define DW_FORM_line_strp         0x1f
+
+#define MAX_FORMATS               16
+
+/*bounded reader over a section*/
+typedef struct DwarfCursor {
+	const unsigned char* ptr;
+	const unsigned char* end;
+	int                  error;
+} dwarf_cursor_t;
+
+/*string sections referenced by DWARF 5 line headers*/
+typedef struct DwarfStrings {
+	const char* str;
+	size_t      str_size;
+	const char* line_str;
+	size_t      line_str_size;
+} dwarf_strings_t;
+
+static unsigned int read_fixed(dwarf_cursor_t* cur, int bytes)
+{
+	unsigned int value = 0;
+	int i;
+	if(cur->end - cur->ptr < bytes)
+	{
+		cur->error = 1;
+		cur->ptr = cur->end;
+		return 0;
+	}
+	for(i = 0; i < bytes; ++i)
+	{   /*bytes beyond 4 (data8) only matter for the low word*/
+		if(i < 4)
+		{
+			value |= (unsigned int)cur->ptr[i] << (8 * i);
+		}
+	}
+	cur->ptr += bytes;
+	return value;
+}
+
+static unsigned int read_uleb(dwarf_cursor_t* cur)
+{
+	unsigned int value = 0;
+	int shift = 0;
+	while(cur->ptr < cur->end)
+	{
+		unsigned char byte = *cur->ptr++;
+		if(shift < 32)
+		{
+			value |= (unsigned int)(byte & 0x7F) << shift;
+		}
+		shift += 7;
+		if(!(byte & 0x80))
+		{
+			return value;
+		}
+	}
+	cur->error = 1;
+	return value;
+}
+
+static int read_sleb(dwarf_cursor_t* cur)
+{
+	int value = 0;
+	int shift = 0;
+	unsigned char byte = 0;
+	while(cur->ptr < cur->end)
+	{
+		byte = *cur->ptr++;
+		if(shift < 32)
+		{
+			value |= (int)(byte & 0x7F) << shift;
+		}
+		shift += 7;
+		if(!(byte & 0x80))
+		{
+			if((shift < 32) && (byte & 0x40))
+			{
+				value |= -(1 << shift);
+			}
+			return value;
+		}
+	}
+	cur->error = 1;
+	return value;
+}
+
+static const char* read_cstring(dwarf_cursor_t* cur)
+{
+	const char* str = (const char*)cur->ptr;
+	const unsigned char* nul = memchr(cur->ptr, 0, cur->end - cur->ptr);
+	if(!nul)
+	{
+		cur->error = 1;
+		cur->ptr = cur->end;
+		return "";
+	}
+	cur->ptr = nul + 1;
+	return str;
+}
+
+static const char* string_at(const char* base, size_t size, unsigned int offset)
+{
+	if(!base || (offset >= size))
+	{
+		return "";
+	}
+	return base + offset;
+}
+
+/*reads one attribute of a DWARF 5 directory or file entry*/
+static void read_form(dwarf_cursor_t* cur, unsigned int form, const dwarf_strings_t* strings,
+                      const char** str, unsigned int* value)
+{
+	*str = 0;
+	*value = 0;
+	switch(form)
+	{
+		case DW_FORM_string:    *str = read_cstring(cur); break;
+		case DW_FORM_line_strp: *str = string_at(strings->line_str, strings->line_str_size, read_fixed(cur, 4)); break;
+		case DW_FORM_strp:      *str = string_at(strings->str, strings->str_size, read_fixed(cur, 4)); break;
+		case DW_FORM_udata:     *value = read_uleb(cur); break;
+		case DW_FORM_data1:     *value = read_fixed(cur, 1); break;
+		case DW_FORM_data2:     *value = read_fixed(cur, 2); break;
+		case DW_FORM_data4:     *value = read_fixed(cur, 4); break;
+		case DW_FORM_data8:     *value = read_fixed(cur, 8); break;
+		case DW_FORM_data16:    read_fixed(cur, 16); break;
+		case DW_FORM_block1:    cur->ptr += read_fixed(cur, 1); break;
+		case DW_FORM_block2:    cur->ptr += read_fixed(cur, 2); break;
+		case DW_FORM_block4:    cur->ptr += read_fixed(cur, 4); break;
+		case DW_FORM_block:     cur->ptr += read_uleb(cur); break;
+		default:                cur->error = 1; break;
+	}
+	if(cur->ptr > cur->end)
+	{
+		cur->error = 1;
+		cur->ptr = cur->end;
+	}
+}
+
+static int add_file(elf32_lines_t* lines, const char* dir, const char* name)
+{
+	char* path;
+	if(!(lines->num_files & 63))
+	{
+		char** files = realloc(lines->files, (lines->num_files + 64) * sizeof(char*));
+		if(!files)
+		{
+			return -1;
+		}
+		lines->files = files;
+	}
+	if((name[0] == '/') || !dir || !dir[0])
+	{
+		path = strdup(name);
+	}
+	else
+	{
+		path = malloc(strlen(dir) + strlen(name) + 2);
+		if(path)
+		{
+			sprintf(path, "%s/%s", dir, name);
+		}
+	}
+	if(!path)
+	{
+		return -1;
+	}
+	lines->files[lines->num_files] = path;
+	return lines->num_files++;
+}
+
+static int add_row(elf32_lines_t* lines, int* capacity, Elf32_Addr addr, unsigned int line, int file)
+{
+	if(lines->num_rows == *capacity)
+	{
+		int new_capacity = *capacity ? 2 * *capacity : 4096;
+		line_row_t* rows = realloc(lines->rows, new_capacity * sizeof(line_row_t));
+		if(!rows)
+		{
+			return -1;
+		}
+		lines->rows = rows;
+		*capacity = new_capacity;
+	}
+	lines->rows[lines->num_rows].addr = addr;
+	lines->rows[lines->num_rows].line = line;
+	lines->rows[lines->num_rows].file = file;
+	++lines->num_rows;
+	return 0;
+}
+
+/* Reads the directory and file tables of one line program header and maps
+ * the unit's file numbers to entries in lines->files. file_map[i] is the
+ * global index of file number i.*/
+static int read_file_tables(dwarf_cursor_t* cur, int version, const dwarf_strings_t* strings,
+                            elf32_lines_t* lines, int** file_map, int* num_map)
+{
+	const char** dirs = 0;
+	int num_dirs = 0, count = 0, status = 0;
+
+	*file_map = 0;
+	*num_map = 0;
+
+	if(version >= 5)
+	{
+		unsigned int formats[MAX_FORMATS][2];
+		int num_formats, i, j;
+
+		/*directories*/
+		num_formats = read_fixed(cur, 1);
+		if(num_formats > MAX_FORMATS)
+		{
+			return -1;
+		}
+		for(i = 0; i < num_formats; ++i)
+		{
+			formats[i][0] = read_uleb(cur);
+			formats[i][1] = read_uleb(cur);
+		}
+		num_dirs = read_uleb(cur);
+		dirs = calloc(num_dirs + 1, sizeof(char*));
+		for(i = 0; dirs && (i < num_dirs) && !cur->error; ++i)
+		{
+			for(j = 0; j < num_formats; ++j)
+			{
+				const char* str;
+				unsigned int value;
+				read_form(cur, formats[j][1], strings, &str, &value);
+				if((formats[j][0] == DW_LNCT_path) && str)
+				{
+					dirs[i] = str;
+				}
+			}
+		}
+
+		/*files, numbered from 0*/
+		num_formats = read_fixed(cur, 1);
+		if(!dirs || (num_formats > MAX_FORMATS))
+		{
+			free(dirs);
+			return -1;
+		}
+		for(i = 0; i < num_formats; ++i)
+		{
+			formats[i][0] = read_uleb(cur);
+			formats[i][1] = read_uleb(cur);
+		}
+		count = read_uleb(cur);
+		*file_map = calloc(count + 1, sizeof(int));
+		for(i = 0; *file_map && (i < count) && !cur->error; ++i)
+		{
+			const char* name = "";
+			unsigned int dir = 0;
+			for(j = 0; j < num_formats; ++j)
+			{
+				const char* str;
+				unsigned int value;
+				read_form(cur, formats[j][1], strings, &str, &value);
+				if((formats[j][0] == DW_LNCT_path) && str)
+				{
+					name = str;
+				}
+				else if(formats[j][0] == DW_LNCT_directory_index)
+				{
+					dir = value;
+				}
+			}
+			(*file_map)[i] = add_file(lines, (dir < (unsigned int)num_dirs) ? dirs[dir] : 0, name);
+			if((*file_map)[i] < 0)
+			{
+				status = -1;
+				break;
+			}
+		}
+		*num_map = count;
+	}
+	else
+	{
+		/*directories, numbered from 1, 0 is the compilation directory*/
+		dwarf_cursor_t scan = *cur;
+		int i = 0;
+		while(*read_cstring(&scan))
+		{
+			++num_dirs;
+		}
+		dirs = calloc(num_dirs + 2, sizeof(char*));
+		if(!dirs)
+		{
+			return -1;
+		}
+		for(i = 1; i <= num_dirs; ++i)
+		{
+			dirs[i] = read_cstring(cur);
+		}
+		read_cstring(cur);
+
+		/*files, numbered from 1*/
+		scan = *cur;
+		while(*read_cstring(&scan) && !scan.error)
+		{
+			read_uleb(&scan);
+			read_uleb(&scan);
+			read_uleb(&scan);
+			++count;
+		}
+		*file_map = calloc(count + 1, sizeof(int));
+		for(i = 1; *file_map && (i <= count); ++i)
+		{
+			const char* name = read_cstring(cur);
+			unsigned int dir = read_uleb(cur);
+			read_uleb(cur);
+			read_uleb(cur);
+			(*file_map)[i] = add_file(lines, (dir <= (unsigned int)num_dirs) ? dirs[dir] : 0, name);
+			if((*file_map)[i] < 0)
+			{
+				status = -1;
+				break;
+			}
+		}
+		read_cstring(cur);
+		*num_map = count + 1;
+	}
+	free(dirs);
+	if(!*file_map || cur->error)
+	{
+		status = -1;
+	}
+	return status;
+}
+
+/*runs the line number program of one unit, returns < 0 on error*/
+static int read_unit(dwarf_cursor_t* cur, const dwarf_strings_t* strings, elf32_lines_t* lines, int* capacity)
+{
+	dwarf_cursor_t unit, program;
+	unsigned int unit_length, header_length;
+	unsigned int min_inst_length, line_range, opcode_base;
+	unsigned char opcode_lengths[256];
+	int version, line_base, default_is_stmt;
+	int* file_map;
+	int num_map, i, status = 0;
+
+	/*registers of the line number state machine*/
+	Elf32_Addr addr = 0;
+	unsigned int file = 1, line = 1;
+
+	unit_length = read_fixed(cur, 4);
+	if((unit_length >= 0xFFFFFFF0) || (unit_length > (unsigned int)(cur->end - cur->ptr)))
+	{   /*64 bit DWARF is not used by 32 bit targets*/
+		return -1;
+	}
+	unit.ptr = cur->ptr;
+	unit.end = cur->ptr + unit_length;
+	unit.error = 0;
+	cur->ptr = unit.end;
+
+	version = read_fixed(&unit, 2);
+	if((version < 2) || (version > 5))
+	{   /*skip units of unknown versions*/
+		return 0;
+	}
+	if(version >= 5)
+	{
+		read_fixed(&unit, 1); /*address_size*/
+		read_fixed(&unit, 1); /*segment_selector_size*/
+	}
+	header_length = read_fixed(&unit, 4);
+	if(header_length > (unsigned int)(unit.end - unit.ptr))
+	{
+		return -1;
+	}
+	program.ptr = unit.ptr + header_length;
+	program.end = unit.end;
+	program.error = 0;
+
+	min_inst_length = read_fixed(&unit, 1);
+	if(version >= 4)
+	{
+		read_fixed(&unit, 1); /*maximum_operations_per_instruction*/
+	}
+	default_is_stmt = read_fixed(&unit, 1);
+	line_base = (signed char)read_fixed(&unit, 1);
+	line_range = read_fixed(&unit, 1);
+	opcode_base = read_fixed(&unit, 1);
+	(void)default_is_stmt;
+	if(!line_range || !opcode_base)
+	{
+		return -1;
+	}
+	memset(opcode_lengths, 0, sizeof(opcode_lengths));
+	for(i = 1; i < (int)opcode_base; ++i)
+	{
+		opcode_lengths[i] = read_fixed(&unit, 1);
+	}
+	if(read_file_tables(&unit, version, strings, lines, &file_map, &num_map) < 0)
+	{
+		free(file_map);
+		return -1;
+	}
+	if(version >= 5)
+	{
+		file = 1;
+	}
+
+#define EMIT_ROW(_line) \
+	status = add_row(lines, capacity, addr, (_line), (file < (unsigned int)num_map) ? file_map[file] : -1)
+
+	while((program.ptr < program.end) && !program.error && (status == 0))
+	{
+		unsigned int opcode = read_fixed(&program, 1);
+
+		if(opcode >= opcode_base)
+		{   /*special opcode*/
+			unsigned int adjusted = opcode - opcode_base;
+			addr += (adjusted / line_range) * min_inst_length;
+			line += line_base + (int)(adjusted % line_range);
+			EMIT_ROW(line);
+		}
+		else if(opcode == 0)
+		{   /*extended opcode*/
+			unsigned int length = read_uleb(&program);
+			const unsigned char* next = program.ptr + length;
+			unsigned int sub_opcode = length ? read_fixed(&program, 1) : 0;
+
+			if(sub_opcode == DW_LNE_end_sequence)
+			{
+				EMIT_ROW(0);
+				addr = 0;
+				file = 1;
+				line = 1;
+			}
+			else if(sub_opcode == DW_LNE_set_address)
+			{
+				addr = read_fixed(&program, length - 1);
+			}
+			if(next > program.end)
+			{
+				break;
+			}
+			program.ptr = next;
+		}
+		else switch(opcode)
+		{
+			case DW_LNS_copy:             EMIT_ROW(line); break;
+			case DW_LNS_advance_pc:       addr += read_uleb(&program) * min_inst_length; break;
+			case DW_LNS_advance_line:     line += read_sleb(&program); break;
+			case DW_LNS_set_file:         file = read_uleb(&program); break;
+			case DW_LNS_const_add_pc:     addr += ((255 - opcode_base) / line_range) * min_inst_length; break;
+			case DW_LNS_fixed_advance_pc: addr += read_fixed(&program, 2); break;
+			default:
+				for(i = 0; i < opcode_lengths[opcode]; ++i)
+				{
+					read_uleb(&program);
+				}
+				break;
+		}
+	}
+#undef EMIT_ROW
+
+	free(file_map);
+	return status;
+}
+
+static int compare_rows(const void* a, const void* b)
+{
+	const line_row_t* ra = (const line_row_t*)a;
+	const line_row_t* rb = (const line_row_t*)b;
+	if(ra->addr != rb->addr)
+	{
+		return (ra->addr < rb->addr) ? -1 : 1;
+	}
+	/*end of one sequence sorts before the start of the next at the same address*/
+	return (ra->line != 0) - (rb->line != 0);
+}
+
+int elf32_load_lines(const elf32_image_t* image, elf32_lines_t* lines)
+{
+	const Elf32_Shdr* section = elf32_find_section(image, ".debug_line");
+	const Elf32_Shdr* str = elf32_find_section(image, ".debug_str");
+	const Elf32_Shdr* line_str = elf32_find_section(image, ".debug_line_str");
+	dwarf_strings_t strings;
+	dwarf_cursor_t cur;
+	int capacity = 0, i, n;
+
+	memset(lines, 0, sizeof(*lines));
+	if(!section)
+	{
+		return 0;
+	}
+	if(section->sh_offset + section->sh_size > image->size)
+	{
+		fprintf(stderr, "error: .debug_line is truncated\n");
+		return -1;
+	}
+	strings.str = str ? (const char*)image->data + str->sh_offset : 0;
+	strings.str_size = str ? str->sh_size : 0;
+	strings.line_str = line_str ? (const char*)image->data + line_str->sh_offset : 0;
+	strings.line_str_size = line_str ? line_str->sh_size : 0;
+
+	cur.ptr = image->data + section->sh_offset;
+	cur.end = cur.ptr + section->sh_size;
+	cur.error = 0;
+	while((cur.ptr < cur.end) && !cur.error)
+	{
+		if(read_unit(&cur, &strings, lines, &capacity) < 0)
+		{
+			fprintf(stderr, "error: cannot parse .debug_line\n");
+			elf32_free_lines(lines);
+			return -1;
+		}
+	}
+
+	qsort(lines->rows, lines->num_rows, sizeof(line_row_t), compare_rows);
+	/*keep the last row for each address*/
+	for(i = 0, n = 0; i < lines->num_rows; ++i)
+	{
+		if(n && (lines->rows[n - 1].addr == lines->rows[i].addr))
+		{
+			--n;
+		}
+		lines->rows[n++] = lines->rows[i];
+	}
+	lines->num_rows = n;
+	return n;
+}
+
+void elf32_free_lines(elf32_lines_t* lines)
+{
+	int i;
+	for(i = 0; i < lines->num_files; ++i)
+	{
+		free(lines->files[i]);
+	}
+	free(lines->files);
+	free(lines->rows);
+	memset(lines, 0, sizeof(*lines));
+}
+
+const line_row_t* elf32_find_line(const elf32_lines_t* lines, Elf32_Addr addr)
+{
+	int low = 0, high = lines->num_rows - 1;
+	const line_row_t* row = 0;
+
+	/*last row with row->addr <= addr*/
+	while(low <= high)
+	{
+		int mid = (low + high) >> 1;
+		if(lines->rows[mid].addr <= addr)
+		{
+			row = &lines->rows[mid];
+			low = mid + 1;
+		}
+		else
+		{
+			high = mid - 1;
+		}
+	}
+	if(!row || !row->line || (row->file < 0))
+	{
+		return 0;
+	}
+	return row;
+}
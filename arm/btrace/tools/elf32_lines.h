@@ -0,0 +1,65 @@
+/*
+ * The MIT License
+ *
+ * Copyright (c) 2013 Rakesh D Nair
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef _ELF32_LINES_H_
+#define _ELF32_LINES_H_
+
+/*
+ * Address to source line index built from the DWARF .debug_line section
+ * (versions 2 to 5) of an elf32_image_t. The index is read only once
+ * built, so lookups may be made from several threads.
+ */
+
+#include "elf32_image.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct LineRow {
+	Elf32_Addr   addr;
+	unsigned int line;  /* 0 marks the end of a sequence (no line info) */
+	int          file;  /* index into elf32_lines_t.files */
+} line_row_t;
+
+typedef struct Elf32Lines {
+	line_row_t* rows;      /* sorted by address */
+	int         num_rows;
+	char**      files;     /* "directory/name" */
+	int         num_files;
+} elf32_lines_t;
+
+/*returns number of rows loaded (0 if the image has no line info), < 0 on error*/
+extern int elf32_load_lines( const elf32_image_t* image, elf32_lines_t* lines );
+extern void elf32_free_lines( elf32_lines_t* lines );
+
+/*returns row describing addr or NULL if there is no line info for it*/
+extern const line_row_t* elf32_find_line( const elf32_lines_t* lines, Elf32_Addr addr );
+
+#ifdef __cplusplus
+} /*extern C */
+#endif
+
+#endif /*_ELF32_LINES_H_*/
@@ -0,0 +1,131 @@
+/*
+ * The MIT License
+ *
+ * Copyright (c) 2013 Rakesh D Nair
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+
+#include "tool_files.h"
+
+bt_uint32_t tool_get_le(const unsigned char* bytes, int count)
+{
+	bt_uint32_t value = 0;
+	while(count--)
+	{
+		value = (value << 8) | bytes[count];
+	}
+	return value;
+}
+
+static int read_snapshot_word(void* ctx, bt_uint32_t addr, bt_uint32_t* value)
+{
+	tool_snapshot_t* snapshot = (tool_snapshot_t*)ctx;
+	bt_uint32_t offset = addr - snapshot->header.stack_base;
+
+	if((addr >= snapshot->header.stack_base) && ((offset >> 2) < snapshot->header.num_words))
+	{
+		*value = snapshot->stack[offset >> 2];
+		return 0;
+	}
+	return elf32_read_word(snapshot->image, addr, value);
+}
+
+int tool_snapshot_load(tool_snapshot_t* snapshot, const elf32_image_t* image, const char* path)
+{
+	FILE* in = fopen(path, "rb");
+
+	memset(snapshot, 0, sizeof(*snapshot));
+	if(!in)
+	{
+		perror(path);
+		return -1;
+	}
+	if((fread(&snapshot->header, sizeof(snapshot->header), 1, in) != 1) ||
+	   (snapshot->header.magic != BT_SNAPSHOT_MAGIC))
+	{
+		fprintf(stderr, "error: %s: not a btrace snapshot\n", path);
+		fclose(in);
+		return -1;
+	}
+	snapshot->stack = calloc(snapshot->header.num_words + 1, sizeof(bt_uint32_t));
+	if(!snapshot->stack ||
+	   (fread(snapshot->stack, sizeof(bt_uint32_t), snapshot->header.num_words, in) != snapshot->header.num_words))
+	{
+		fprintf(stderr, "error: %s: truncated snapshot\n", path);
+		tool_snapshot_free(snapshot);
+		fclose(in);
+		return -1;
+	}
+	fclose(in);
+
+	snapshot->image = image;
+	snapshot->reader.read_word = read_snapshot_word;
+	snapshot->reader.ctx = snapshot;
+	return 0;
+}
+
+void tool_snapshot_free(tool_snapshot_t* snapshot)
+{
+	free(snapshot->stack);
+	snapshot->stack = 0;
+}
+
+int tool_walk_path(const char* path, ToolFileFnPtr file_fn, void* user)
+{
+	struct stat st;
+	struct dirent** entries;
+	int i, count;
+
+	if(stat(path, &st) < 0)
+	{
+		perror(path);
+		return -1;
+	}
+	if(!S_ISDIR(st.st_mode))
+	{
+		return file_fn(user, path, &st);
+	}
+
+	count = scandir(path, &entries, 0, alphasort);
+	if(count < 0)
+	{
+		perror(path);
+		return -1;
+	}
+	for(i = 0; i < count; ++i)
+	{
+		if(entries[i]->d_name[0] != '.')
+		{
+			char* child = malloc(strlen(path) + strlen(entries[i]->d_name) + 2);
+			sprintf(child, "%s/%s", path, entries[i]->d_name);
+			tool_walk_path(child, file_fn, user);
+			free(child);
+		}
+		free(entries[i]);
+	}
+	free(entries);
+	return 0;
+}
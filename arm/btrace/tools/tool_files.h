@@ -0,0 +1,74 @@
+/*
+ * The MIT License
+ *
+ * Copyright (c) 2013 Rakesh D Nair
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef _TOOL_FILES_H_
+#define _TOOL_FILES_H_
+
+/*
+ * Input files of the host side btrace tools: little endian fields of
+ * target dumps, bt_snapshot_t files unwound against a linked image, and
+ * walking the files given on the command line, directories included.
+ */
+
+#include <sys/stat.h>
+
+#include "arm_btrace.h"
+#include "elf32_image.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*snapshot file loaded for unwinding*/
+typedef struct ToolSnapshot {
+	const elf32_image_t* image;
+	bt_snapshot_t        header;
+	bt_uint32_t*         stack;   /* header.num_words captured words */
+	bt_mem_reader_t      reader;  /* stack from the file, the rest from image */
+} tool_snapshot_t;
+
+/*called for every file found by tool_walk_path*/
+typedef int (*ToolFileFnPtr)(void* user, const char* path, const struct stat* st);
+
+/*value of the count byte little endian field at bytes*/
+extern bt_uint32_t tool_get_le( const unsigned char* bytes, int count );
+
+/* loads the snapshot at path, reading everything but its stack from
+ * image. Returns 0 on success, < 0 on error (message printed to stderr).
+ * snapshot->reader points into snapshot, which must not be copied.*/
+extern int tool_snapshot_load( tool_snapshot_t* snapshot, const elf32_image_t* image, const char* path );
+extern void tool_snapshot_free( tool_snapshot_t* snapshot );
+
+/* calls file_fn for path, or for every file below it if it is a
+ * directory, in name order and skipping names starting with '.'.
+ * Returns < 0 if path cannot be read (message printed to stderr), else
+ * 0 for a directory or what file_fn returned.*/
+extern int tool_walk_path( const char* path, ToolFileFnPtr file_fn, void* user );
+
+#ifdef __cplusplus
+} /*extern C */
+#endif
+
+#endif /*_TOOL_FILES_H_*/
@@ -100,6 +100,13 @@ extern "C" {
 #define IS_BRANCH(_opcode)               _IS_PART_EQUAL(_opcode, 0x0E000000, 0x0A000000)
 #define IS_BRANCH_EXCHANGE(_opcode,_sts) _IS_PART_EQUAL(_opcode, 0x0FFFFF10, 0x012FFF10)
 
+/*instructions found just before a return address: BL, BLX #imm, BLX rX,
+  and BX rX or LDR PC after "mov lr, pc" in old style indirect calls*/
+#define IS_CALL_SITE(_opcode)            (_IS_PART_EQUAL(_opcode, 0x0F000000, 0x0B000000) || \
+                                          _IS_PART_EQUAL(_opcode, 0xFE000000, 0xFA000000) || \
+                                          _IS_PART_EQUAL(_opcode, 0x0FFFFFD0, 0x012FFF10) || \
+                                          _IS_PART_EQUAL(_opcode, 0x0C50F000, 0x0410F000))
+
 /*helper macros to identify operand registers, offsets and shifts*/
 #define IS_LDST_DST_REG(_opcode,_regid)  ((((_opcode) >> 16) & 0xF) == (_regid))
 #define IS_LDST_REG2(_opcode,_regid)     ((((_opcode) >> 12) & 0xF) == (_regid))
@@ -107,6 +114,10 @@ extern "C" {
 #define IS_OPERAND_REG(_opcode,_regid)   ((((_opcode) >> 16) & 0xF) == (_regid))
 #define GET_OPERAND_SHIFT(_opcode)       (((_opcode) >> 8) & 0xF)
 #define GET_IMMEDIATE_OPERAND(_opcode)   ((_opcode) & 0xFF)
+/*8 bit immediate rotated right by twice the 4 bit rotate field*/
+#define GET_ROTATE_AMOUNT(_opcode)       ((((_opcode) >> 8) & 0xF) << 1)
+#define GET_ROTATED_IMMEDIATE(_opcode)   ((GET_IMMEDIATE_OPERAND(_opcode) >> GET_ROTATE_AMOUNT(_opcode)) | \
+                                          (GET_IMMEDIATE_OPERAND(_opcode) << ((32 - GET_ROTATE_AMOUNT(_opcode)) & 31)))
 
 /**/
 #define IS_NOT_CONDITIONAL(_opcode) 	 _IS_PART_EQUAL(_opcode, OPCODE_COND_MASK,0xE0000000)
@@ -121,9 +132,36 @@ extern "C" {
 #define IS_PUSH(_opcode) ((((_opcode) & 0xFFFF0000) == 0xE92D0000) || \
 			                 (((_opcode) & 0xFFFF0000) == 0xE52D0000) )
 
+/* Instruction classes for table driven decoders. The IS_ADD, IS_SUB,
+ * IS_SINGLE_DATA, IS_BLOCK_DATA and IS_LDC_STC tests depend only on bits
+ * 27:20, so OPCODE_CLASS_256 evaluates them at compile time for all 256
+ * values of those bits as the initializer of a table indexed by
+ * OPCODE_CLASS_INDEX. ADD and SUB tests overlap and may both be set.*/
+#define OPCODE_CLASS_ADD      0x01
+#define OPCODE_CLASS_SUB      0x02
+#define OPCODE_CLASS_SINGLE   0x04
+#define OPCODE_CLASS_BLOCK    0x08
+#define OPCODE_CLASS_LDC_STC  0x10
+
+#define OPCODE_CLASS_INDEX(_opcode)  (((_opcode) >> 20) & 0xFF)
+
+#define OPCODE_CLASS(_bits) \
+	((IS_ADD((_bits) << 20)         ? OPCODE_CLASS_ADD     : 0) | \
+	 (IS_SUB((_bits) << 20)         ? OPCODE_CLASS_SUB     : 0) | \
+	 (IS_SINGLE_DATA((_bits) << 20) ? OPCODE_CLASS_SINGLE  : 0) | \
+	 (IS_BLOCK_DATA((_bits) << 20)  ? OPCODE_CLASS_BLOCK   : 0) | \
+	 (IS_LDC_STC((_bits) << 20)     ? OPCODE_CLASS_LDC_STC : 0))
+
+#define OPCODE_CLASS_4(_b)   OPCODE_CLASS(_b),        OPCODE_CLASS((_b) + 1),   OPCODE_CLASS((_b) + 2),    OPCODE_CLASS((_b) + 3)
+#define OPCODE_CLASS_16(_b)  OPCODE_CLASS_4(_b),      OPCODE_CLASS_4((_b) + 4), OPCODE_CLASS_4((_b) + 8),  OPCODE_CLASS_4((_b) + 12)
+#define OPCODE_CLASS_64(_b)  OPCODE_CLASS_16(_b),     OPCODE_CLASS_16((_b) + 16), OPCODE_CLASS_16((_b) + 32), OPCODE_CLASS_16((_b) + 48)
+#define OPCODE_CLASS_256     OPCODE_CLASS_64(0),      OPCODE_CLASS_64(64),      OPCODE_CLASS_64(128),      OPCODE_CLASS_64(192)
+
 /*constants related to CPU mode.*/
 #define CPSR_MODE_MASK        0x0000001F
+#define CPSR_USR_MODE         0x00000010
 #define CPSR_SYS_MODE         0x0000001F
+#define CPSR_SVC_MODE         0x00000013
 #define CPSR_IRQ_MODE         0x00000012
 #define CPSR_FIQ_MODE         0x00000011
 #define CPSR_UND_MODE         0x0000001B